@@ -0,0 +1,103 @@
+// Retune benchmark, needs the DMA (run as root on the Pi) : transmits a carrier through
+// hopdmasync and hops between channels every burst, for three channel plans :
+//  fast   : channels 25 kHz apart, same PLL integer part, center switch only
+//  slow   : channels one PLL integer step apart, fifo drained then PLL reprogrammed
+//  legacy : former sendiq 4444 path, clock disabled, recentered and enabled again
+// For each it prints the retune call latency (min/mean/max us) and the samples lost, that is the
+// samples the DMA should have played during the run minus the ones queued.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <vector>
+#include "hopdmasync.h"
+
+#define IQBURST 4000
+
+static volatile bool running=true;
+
+static void terminate(int num)
+{
+	running=false;
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+enum {plan_fast,plan_slow,plan_legacy};
+
+static void run(const char *Name,int PlanType,uint64_t Frequency,uint32_t SampleRate,int Hops)
+{
+	int FifoSize=IQBURST*4;
+	hopdmasync iqtest(Frequency,SampleRate,14,FifoSize,MODE_IQ);
+	iqtest.SetPLLMasterLoop(3,4,0);
+	std::vector<uint64_t> Frequencies;
+	for(int i=0;i<4;i++)
+	{
+		if(PlanType==plan_fast) Frequencies.push_back(Frequency+i*25000);
+		else Frequencies.push_back(Frequency+i*(XOSC_FREQUENCY/iqtest.PllFixDivider));
+		iqtest.AddChannel(Frequencies.back());
+	}
+	std::complex<float> CIQBuffer[IQBURST];
+	for(int i=0;i<IQBURST;i++) CIQBuffer[i]=std::complex<float>(0.5,0);
+	// Fill the fifo before timing
+	for(int i=0;i<FifoSize/IQBURST;i++) iqtest.SetIQSamples(CIQBuffer,IQBURST,1);
+
+	double Min=1e9,Max=0,Sum=0;
+	uint64_t Queued=FifoSize-iqtest.GetBufferAvailable();
+	double Start=now();
+	for(int Hop=0;(Hop<Hops)&&running;Hop++)
+	{
+		int Channel=Hop%Frequencies.size();
+		double t0=now();
+		if(PlanType==plan_legacy)
+		{
+			iqtest.clkgpio::disableclk(4);
+			iqtest.clkgpio::SetAdvancedPllMode(true);
+			iqtest.clkgpio::SetCenterFrequency(Frequencies[Channel],SampleRate);
+			iqtest.clkgpio::SetFrequency(0);
+			iqtest.clkgpio::enableclk(4);
+		}
+		else iqtest.Retune(Channel);
+		double Latency=(now()-t0)*1e6;
+		if(Latency<Min) Min=Latency;
+		if(Latency>Max) Max=Latency;
+		Sum+=Latency;
+		iqtest.SetIQSamples(CIQBuffer,IQBURST,1);
+		Queued+=IQBURST;
+	}
+	double Elapsed=now()-Start;
+	// Whatever is still in the fifo was not due yet
+	double Played=Elapsed*SampleRate-(FifoSize-iqtest.GetBufferAvailable());
+	double Lost=Played-Queued;
+	if(Lost<0) Lost=0;
+	fprintf(stderr,"%-7s : %d hops, retune %.1f/%.1f/%.1f us (min/mean/max), %.0f samples lost (%.2f per hop)",
+		Name,Hops,Min,Sum/Hops,Max,Lost,Lost/Hops);
+	if(PlanType!=plan_legacy) fprintf(stderr,", %lu fast %lu slow",iqtest.GetFastRetunes(),iqtest.GetSlowRetunes());
+	fprintf(stderr,"\n");
+	iqtest.stop();
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t Frequency=(argc>1)?(uint64_t)atof(argv[1]):434000000;
+	uint32_t SampleRate=(argc>2)?atoi(argv[2]):200000;
+	int Hops=(argc>3)?atoi(argv[3]):200;
+
+	for (int i = 0; i < 64; i++) {
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = terminate;
+		sigaction(i, &sa, NULL);
+	}
+	fprintf(stderr,"Hopping around %llu Hz at %u S/s, one hop per %d samples burst\n",(unsigned long long)Frequency,SampleRate,IQBURST);
+	run("fast",plan_fast,Frequency,SampleRate,Hops);
+	run("slow",plan_slow,Frequency,SampleRate,Hops);
+	run("legacy",plan_legacy,Frequency,SampleRate,Hops);
+	return 0;
+}
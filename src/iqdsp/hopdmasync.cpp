@@ -0,0 +1,94 @@
+#include "hopdmasync.h"
+#include <unistd.h>
+#include <time.h>
+
+hopdmasync::hopdmasync(uint64_t TuneFrequency,uint32_t SR,int Channel,uint32_t FifoSize,int Mode):iqdmasync(TuneFrequency,SR,Channel,FifoSize,Mode)
+{
+	SampleRate=SR;
+	this->FifoSize=FifoSize;
+	FastRetunes=SlowRetunes=LostSamples=0;
+	Tuned.Frequency=CentralFrequency;
+	Tuned.Divider=PllFixDivider;
+	Tuned.Mult=(uint32_t)(((double)CentralFrequency*PllFixDivider)/XOSC_FREQUENCY);
+}
+
+// Divider librpitx chooses for this frequency, without touching the running clock
+hopdmasync::hopchannel hopdmasync::Plan(uint64_t Frequency)
+{
+	hopchannel Channel;
+	int CurrentDivider=PllFixDivider;
+	ComputeBestLO(Frequency,SampleRate);
+	Channel.Divider=PllFixDivider;
+	PllFixDivider=CurrentDivider;
+	Channel.Frequency=Frequency;
+	Channel.Mult=(uint32_t)(((double)Frequency*Channel.Divider)/XOSC_FREQUENCY);
+	return Channel;
+}
+
+int hopdmasync::AddChannel(uint64_t Frequency)
+{
+	Channels.push_back(Plan(Frequency));
+	return (int)Channels.size()-1;
+}
+
+bool hopdmasync::IsFastRetune(int Channel)
+{
+	if((Channel<0)||(Channel>=(int)Channels.size())) return false;
+	return (Channels[Channel].Divider==Tuned.Divider)&&(Channels[Channel].Mult==Tuned.Mult);
+}
+
+static long elapsed_us(const struct timespec &Start)
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC,&Now);
+	return (Now.tv_sec-Start.tv_sec)*1000000+(Now.tv_nsec-Start.tv_nsec)/1000;
+}
+
+// Wait until the DMA has played the samples queued with the previous setting, at most one fifo
+void hopdmasync::Drain()
+{
+	struct timespec Start;
+	clock_gettime(CLOCK_MONOTONIC,&Start);
+	long MaxWaitUs=(long)(((uint64_t)FifoSize*1000000)/SampleRate)+1000;
+	while((GetBufferAvailable()<(int)FifoSize-1)&&(elapsed_us(Start)<MaxWaitUs))
+		usleep(100);
+}
+
+bool hopdmasync::Apply(const hopchannel &Channel)
+{
+	if((Channel.Divider==Tuned.Divider)&&(Channel.Mult==Tuned.Mult))
+	{
+		// Next samples are computed against the new center : exact at the burst boundary
+		CentralFrequency=Channel.Frequency;
+		FastRetunes++;
+	}
+	else
+	{
+		Drain();
+		struct timespec Empty;
+		clock_gettime(CLOCK_MONOTONIC,&Empty);
+		if(Channel.Divider!=Tuned.Divider)
+		{
+			PllFixDivider=Channel.Divider;
+			SetClkDivFrac(PllFixDivider,0);
+		}
+		CentralFrequency=Channel.Frequency;
+		SetMasterMultFrac(Channel.Mult,GetMasterFrac(0));
+		SlowRetunes++;
+		// The fifo is dry from the drain (half a poll period on average) until the next burst is queued
+		LostSamples+=((uint64_t)(elapsed_us(Empty)+50)*SampleRate)/1000000;
+	}
+	Tuned=Channel;
+	return true;
+}
+
+bool hopdmasync::Retune(int Channel)
+{
+	if((Channel<0)||(Channel>=(int)Channels.size())) return false;
+	return Apply(Channels[Channel]);
+}
+
+bool hopdmasync::RetuneFrequency(uint64_t Frequency)
+{
+	return Apply(Plan(Frequency));
+}
@@ -0,0 +1,48 @@
+#ifndef HOPDMASYNC_H
+#define HOPDMASYNC_H
+
+// iqdmasync with a fast retune between precomputed channels
+//
+// Each channel keeps the master PLL divider and integer multiplier librpitx would choose for it.
+// Retune() is called between two SetIQSamples bursts and never disables the clock :
+//  - same divider and integer part : only the center used to compute the queued samples changes,
+//    the switch is exact at the burst boundary and no sample is lost.
+//  - otherwise the samples already queued (computed for the old PLL setting) are played first,
+//    then the PLL is reprogrammed : the latency is bounded by the DMA fifo depth.
+
+#include <librpitx/librpitx.h>
+#include <stdint.h>
+#include <vector>
+
+class hopdmasync : public iqdmasync
+{
+	protected:
+	struct hopchannel {
+		uint64_t Frequency;
+		int Divider;
+		uint32_t Mult;
+	};
+	std::vector<hopchannel> Channels;
+	hopchannel Tuned;
+	uint32_t SampleRate;
+	uint32_t FifoSize;
+	unsigned long FastRetunes,SlowRetunes;
+	unsigned long LostSamples;	// Estimate of the samples the fifo ran dry during slow retunes
+
+	hopchannel Plan(uint64_t Frequency);
+	void Drain();
+	bool Apply(const hopchannel &Channel);
+
+	public:
+	hopdmasync(uint64_t TuneFrequency,uint32_t SR,int Channel,uint32_t FifoSize,int Mode);
+	int AddChannel(uint64_t Frequency);
+	bool Retune(int Channel);
+	bool RetuneFrequency(uint64_t Frequency);
+	int GetChannels() {return (int)Channels.size();}
+	bool IsFastRetune(int Channel);
+	unsigned long GetFastRetunes() {return FastRetunes;}
+	unsigned long GetSlowRetunes() {return SlowRetunes;}
+	unsigned long GetLostSamples() {return LostSamples;}
+};
+
+#endif
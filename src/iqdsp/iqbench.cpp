@@ -0,0 +1,195 @@
+// Micro-benchmark of the sendiq input stage : prints input samples/s per input format
+// for the vectorized conversion kernels and the former per-sample loop, then the resampler
+// throughput and realtime factor for typical input rates, and finally the syscalls and CPU time
+// of a looped file playback through fread/fseek against the mmap reader, on the build host.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "iqconvert.h"
+#include "iqresampler.h"
+#include "iqreader.h"
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define IQBURST 4000
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+// Former sendiq conversion, kept as reference
+template<typename T> static int legacy(const T *IQBuffer,int nbread,std::complex<float> *CIQBuffer,int Decimation,float Offset,float Div)
+{
+	int CplxSampleNumber=0;
+	for(int i=0;i<nbread/2;i++)
+	{
+		if(i%Decimation==0)
+		{
+			CIQBuffer[CplxSampleNumber++]=std::complex<float>((IQBuffer[i*2]-Offset)/Div,(IQBuffer[i*2+1]-Offset)/Div);
+		}
+	}
+	return CplxSampleNumber;
+}
+
+template<typename T> static void run(const char *Name,int Type,float Offset,float Div,double Seconds)
+{
+	std::vector<T> In(IQBURST*2);
+	for(size_t i=0;i<In.size();i++) In[i]=(T)(rand()%200);
+	std::complex<float> Out[IQBURST];
+	static const int Decimations[]={1,4};
+	for(int d=0;d<2;d++)
+	{
+		int Decimation=Decimations[d];
+		double Rates[2];
+		for(int pass=0;pass<2;pass++)
+		{
+			size_t Done=0;
+			volatile float Sink=0;
+			double Start=now(),Elapsed=0;
+			while(Elapsed<Seconds)
+			{
+				for(int k=0;k<64;k++)
+				{
+					if(pass==0) iqconvert(Type,In.data(),IQBURST,Out,Decimation);
+					else legacy(In.data(),IQBURST*2,Out,Decimation,Offset,Div);
+					Sink+=Out[0].real();
+					Done+=IQBURST;
+				}
+				Elapsed=now()-Start;
+			}
+			Rates[pass]=Done/Elapsed;
+		}
+		printf("%-6s decim %d : %8.2f Msamples/s (per-sample loop %8.2f Msamples/s, x%.2f)\n",Name,Decimation,Rates[0]/1e6,Rates[1]/1e6,Rates[0]/Rates[1]);
+	}
+}
+
+static void resample(double InRate,double OutRate,double Seconds)
+{
+	iqresampler Resampler(InRate,OutRate);
+	std::vector<std::complex<float> > In(IQBURST),Out(Resampler.MaxOutput(IQBURST));
+	for(size_t i=0;i<In.size();i++) In[i]=std::complex<float>((rand()%200)/100.0-1.0,(rand()%200)/100.0-1.0);
+	size_t Done=0;
+	volatile float Sink=0;
+	double Start=now(),Elapsed=0;
+	while(Elapsed<Seconds)
+	{
+		for(int k=0;k<16;k++)
+		{
+			size_t n=Resampler.Process(In.data(),IQBURST,Out.data());
+			Sink+=Out[n/2].real();
+			Done+=IQBURST;
+		}
+		Elapsed=now()-Start;
+	}
+	printf("resample %8.0f -> %6.0f (%-9s, %3d phases, %3d taps) : %8.2f Msamples/s in, realtime x%.1f\n",
+		InRate,OutRate,Resampler.IsRational()?"rational":"arbitrary",Resampler.GetPhases(),Resampler.GetTaps(),Done/Elapsed/1e6,Done/Elapsed/InRate);
+}
+
+// Read syscalls issued by this process so far, from task I/O accounting
+static unsigned long syscr()
+{
+	unsigned long Value=0;
+	FILE *f=fopen("/proc/self/io","r");
+	if(f==NULL) return 0;
+	char Line[128];
+	while(fgets(Line,sizeof(Line),f)!=NULL)
+		if(sscanf(Line,"syscr: %lu",&Value)==1) break;
+	fclose(f);
+	return Value;
+}
+
+static double cputime()
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF,&ru);
+	return ru.ru_utime.tv_sec+ru.ru_utime.tv_usec*1e-6+ru.ru_stime.tv_sec+ru.ru_stime.tv_usec*1e-6;
+}
+
+// Plays Loops times a 16 MB i16 file by 4000 samples bursts, as sendiq does in loop mode
+static void playback(int Loops)
+{
+	char FileName[]="/tmp/iqbenchXXXXXX";
+	int fd=mkstemp(FileName);
+	if(fd<0) return;
+	std::vector<short> Chunk(1<<20);
+	for(size_t i=0;i<Chunk.size();i++) Chunk[i]=rand();
+	for(int i=0;i<8;i++)
+		if(write(fd,Chunk.data(),Chunk.size()*sizeof(short))<0) break;
+	close(fd);
+	size_t Pairs=8*Chunk.size()/2;
+	std::complex<float> Out[IQBURST];
+	volatile float Sink=0;
+
+	// fread/fseek path
+	FILE *iqfile=fopen(FileName,"rb");
+	static short IQBuffer[IQBURST*2];
+	unsigned long Syscalls=syscr(),Seeks=0;
+	double Cpu=cputime(),Start=now();
+	size_t Done=0;
+	for(int l=0;l<Loops;)
+	{
+		int nbread=fread(IQBuffer,sizeof(short),IQBURST*2,iqfile);
+		if(nbread>0)
+		{
+			Sink+=Out[iqconvert(typeiq_i16,IQBuffer,nbread/2,Out)-1].real();
+			Done+=nbread/2;
+		}
+		else
+		{
+			fseek(iqfile,0,SEEK_SET);
+			Seeks++;
+			l++;
+		}
+	}
+	double Wall=now()-Start;
+	printf("playback fread/fseek : %8lu syscalls (%lu read, %lu lseek), cpu %6.3f s, %8.2f Msamples/s\n",
+		syscr()-Syscalls+Seeks,syscr()-Syscalls,Seeks,cputime()-Cpu,Done/Wall/1e6);
+	fclose(iqfile);
+
+	// mmap reader path
+	iqreader Reader;
+	Reader.Open(FileName,iqconvert_pairsize(typeiq_i16),true);
+	Syscalls=syscr();
+	Cpu=cputime();
+	Start=now();
+	Done=0;
+	while(Done<Pairs*Loops)
+	{
+		const void *Data;
+		size_t n=Reader.Read(&Data,IQBURST);
+		Sink+=Out[iqconvert(typeiq_i16,Data,n,Out)-1].real();
+		Done+=n;
+	}
+	Wall=now()-Start;
+	printf("playback mmap        : %8lu syscalls (%lu read, %lu madvise), cpu %6.3f s, %8.2f Msamples/s\n",
+		Reader.GetSyscalls()+syscr()-Syscalls,syscr()-Syscalls,Reader.GetSyscalls(),cputime()-Cpu,Done/Wall/1e6);
+	Reader.Close();
+	unlink(FileName);
+}
+
+int main(int argc,char **argv)
+{
+	double Seconds=(argc>1)?atof(argv[1]):0.5;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	printf("iqconvert kernels : NEON\n");
+#elif defined(__SSE2__)
+	printf("iqconvert kernels : SSE2\n");
+#else
+	printf("iqconvert kernels : scalar\n");
+#endif
+	run<short>("i16",typeiq_i16,0.0f,32768.0f,Seconds);
+	run<unsigned char>("u8",typeiq_u8,127.5f,128.0f,Seconds);
+	run<float>("float",typeiq_float,0.0f,1.0f,Seconds);
+	run<double>("double",typeiq_double,0.0f,1.0f,Seconds);
+	resample(2400000,200000,Seconds);
+	resample(1024000,200000,Seconds);
+	resample(250000,200000,Seconds);
+	resample(1234567,200000,Seconds);
+	playback(8);
+	return 0;
+}
@@ -0,0 +1,144 @@
+#ifndef IQCONTROL_H
+#define IQCONTROL_H
+
+// Shared memory control block between sendiq and partner programs (C or C++).
+//
+// sendiq -m {token} creates (or attaches) a SysV shared memory segment of sizeof(iqcontrol_block)
+// with the given key, initializes it and sets magic last. Partner programs attach the same key,
+// check magic/version, then queue commands with iqcontrol_push().
+//
+// Commands go through a bounded ring of IQCONTROL_SLOTS slots : each slot carries a sequence
+// number so several partners may push concurrently, sendiq is the single consumer.
+// sendiq checks the ring once per burst, for every input type.
+//
+// Each command carries a timestamp, the index of the output sample it applies at : sendiq cuts
+// its burst at that sample so the change is sample accurate in the stream sent to the DMA.
+// 0 (or any index already sent) means as soon as possible. The index of the next output sample is
+// published in the block, read it with iqcontrol_samples() to schedule relative to now.
+//
+//      Command       Meaning                  data
+//       1111         Switch to I/Q mode       N/A
+//       2222         Switch to Freq & A mode  N/A
+//       3333         Set drive level          Drive level {0..7}
+//       4444         Change Frequency         Frequency in Hz
+//       5555         Switch to channel        Channel index (sendiq -c list)
+//
+// Only 32 bits atomics are used so that it works on ARMv6 without libatomic.
+
+#include <stdint.h>
+
+#define IQCONTROL_MAGIC 0x31435153 // "SQC1"
+#define IQCONTROL_VERSION 1
+#define IQCONTROL_SLOTS 64
+
+#define IQCONTROL_MODE_IQ 1111
+#define IQCONTROL_MODE_FREQ_A 2222
+#define IQCONTROL_DRIVE 3333
+#define IQCONTROL_FREQUENCY 4444
+#define IQCONTROL_CHANNEL 5555
+
+typedef struct {
+	uint32_t sequence;	// Slot ownership, see iqcontrol_push/iqcontrol_peek
+	uint32_t command;
+	uint64_t timestamp;	// Output sample index to apply at
+	double data;
+} iqcontrol_command;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t samplerate;	// Output sample rate the timestamps count in
+	uint32_t head;		// Next slot to be claimed by a partner
+	uint32_t tail;		// Next slot to be consumed by sendiq
+	uint32_t samples_seq;	// Odd while samples is being updated
+	uint32_t applied;	// Commands applied so far
+	uint64_t samples;	// Index of the next output sample
+	iqcontrol_command command[IQCONTROL_SLOTS];
+} iqcontrol_block;
+
+// sendiq side : reset the block and publish it
+static inline void iqcontrol_init(iqcontrol_block *b,uint32_t samplerate)
+{
+	__atomic_store_n(&b->magic,0,__ATOMIC_RELAXED);
+	b->version=IQCONTROL_VERSION;
+	b->slots=IQCONTROL_SLOTS;
+	b->samplerate=samplerate;
+	b->head=0;
+	b->tail=0;
+	b->samples_seq=0;
+	b->applied=0;
+	b->samples=0;
+	for(uint32_t i=0;i<IQCONTROL_SLOTS;i++) b->command[i].sequence=i;
+	__atomic_store_n(&b->magic,IQCONTROL_MAGIC,__ATOMIC_RELEASE);
+}
+
+// Partner side : returns 0 when queued, -1 if the block is not ready or the ring is full
+static inline int iqcontrol_push(iqcontrol_block *b,uint32_t command,double data,uint64_t timestamp)
+{
+	if(__atomic_load_n(&b->magic,__ATOMIC_ACQUIRE)!=IQCONTROL_MAGIC) return -1;
+	if(b->version!=IQCONTROL_VERSION) return -1;
+	uint32_t pos=__atomic_load_n(&b->head,__ATOMIC_RELAXED);
+	for(;;)
+	{
+		iqcontrol_command *slot=&b->command[pos%IQCONTROL_SLOTS];
+		int32_t diff=(int32_t)(__atomic_load_n(&slot->sequence,__ATOMIC_ACQUIRE)-pos);
+		if(diff==0)
+		{
+			if(__atomic_compare_exchange_n(&b->head,&pos,pos+1,1,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+			{
+				slot->command=command;
+				slot->data=data;
+				slot->timestamp=timestamp;
+				__atomic_store_n(&slot->sequence,pos+1,__ATOMIC_RELEASE);
+				return 0;
+			}
+		}
+		else if(diff<0) return -1;
+		else pos=__atomic_load_n(&b->head,__ATOMIC_RELAXED);
+	}
+}
+
+// sendiq side : copies the oldest queued command, returns 0 if there is none
+static inline int iqcontrol_peek(iqcontrol_block *b,iqcontrol_command *cmd)
+{
+	uint32_t pos=b->tail;
+	iqcontrol_command *slot=&b->command[pos%IQCONTROL_SLOTS];
+	if(__atomic_load_n(&slot->sequence,__ATOMIC_ACQUIRE)!=pos+1) return 0;
+	cmd->command=slot->command;
+	cmd->data=slot->data;
+	cmd->timestamp=slot->timestamp;
+	return 1;
+}
+
+// sendiq side : releases the slot returned by iqcontrol_peek
+static inline void iqcontrol_pop(iqcontrol_block *b)
+{
+	uint32_t pos=b->tail;
+	__atomic_store_n(&b->command[pos%IQCONTROL_SLOTS].sequence,pos+IQCONTROL_SLOTS,__ATOMIC_RELEASE);
+	__atomic_store_n(&b->tail,pos+1,__ATOMIC_RELEASE);
+	__atomic_store_n(&b->applied,b->applied+1,__ATOMIC_RELEASE);
+}
+
+// sendiq side : publish the index of the next output sample
+static inline void iqcontrol_publish(iqcontrol_block *b,uint64_t samples)
+{
+	__atomic_store_n(&b->samples_seq,b->samples_seq+1,__ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	b->samples=samples;
+	__atomic_store_n(&b->samples_seq,b->samples_seq+1,__ATOMIC_RELEASE);
+}
+
+// Partner side : index of the next output sample
+static inline uint64_t iqcontrol_samples(iqcontrol_block *b)
+{
+	for(;;)
+	{
+		uint32_t seq=__atomic_load_n(&b->samples_seq,__ATOMIC_ACQUIRE);
+		uint64_t samples=b->samples;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(((seq&1)==0)&&(__atomic_load_n(&b->samples_seq,__ATOMIC_RELAXED)==seq)) return samples;
+	}
+}
+
+#endif
@@ -0,0 +1,179 @@
+#include "iqconvert.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IQCONVERT_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define IQCONVERT_SSE2
+#endif
+
+size_t iqconvert_pairsize(int InputType)
+{
+	switch(InputType)
+	{
+		case typeiq_i16:return 2*sizeof(short);
+		case typeiq_u8:return 2*sizeof(unsigned char);
+		case typeiq_float:return 2*sizeof(float);
+		case typeiq_double:return 2*sizeof(double);
+	}
+	return 0;
+}
+
+int iqconvert_type(const char *Name)
+{
+	if(strcmp(Name,"i16")==0) return typeiq_i16;
+	if(strcmp(Name,"u8")==0) return typeiq_u8;
+	if(strcmp(Name,"float")==0) return typeiq_float;
+	if(strcmp(Name,"double")==0) return typeiq_double;
+	return -1;
+}
+
+// Every kernel computes Out = In*Gain+Offset on the interleaved I/Q words.
+// Vector part only runs without decimation, the remaining pairs go through the strided scalar loop.
+
+static size_t convert_i16(const short *In,size_t Count,float *Out,int Decimation,float Gain)
+{
+	size_t i=0;
+	if(Decimation==1)
+	{
+#if defined(IQCONVERT_NEON)
+		for(;i+4<=Count;i+=4)
+		{
+			int16x8_t v=vld1q_s16(In+i*2);
+			vst1q_f32(Out+i*2,vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))),Gain));
+			vst1q_f32(Out+i*2+4,vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))),Gain));
+		}
+#elif defined(IQCONVERT_SSE2)
+		const __m128 g=_mm_set1_ps(Gain);
+		for(;i+4<=Count;i+=4)
+		{
+			__m128i v=_mm_loadu_si128((const __m128i *)(In+i*2));
+			__m128i lo=_mm_srai_epi32(_mm_unpacklo_epi16(v,v),16);
+			__m128i hi=_mm_srai_epi32(_mm_unpackhi_epi16(v,v),16);
+			_mm_storeu_ps(Out+i*2,_mm_mul_ps(_mm_cvtepi32_ps(lo),g));
+			_mm_storeu_ps(Out+i*2+4,_mm_mul_ps(_mm_cvtepi32_ps(hi),g));
+		}
+#endif
+	}
+	size_t n=i;
+	for(;i<Count;i+=Decimation,n++)
+	{
+		Out[n*2]=In[i*2]*Gain;
+		Out[n*2+1]=In[i*2+1]*Gain;
+	}
+	return n;
+}
+
+static size_t convert_u8(const unsigned char *In,size_t Count,float *Out,int Decimation,float Gain,float Offset)
+{
+	size_t i=0;
+	if(Decimation==1)
+	{
+#if defined(IQCONVERT_NEON)
+		const float32x4_t o=vdupq_n_f32(Offset);
+		for(;i+4<=Count;i+=4)
+		{
+			uint16x8_t v=vmovl_u8(vld1_u8(In+i*2));
+			vst1q_f32(Out+i*2,vmlaq_n_f32(o,vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))),Gain));
+			vst1q_f32(Out+i*2+4,vmlaq_n_f32(o,vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))),Gain));
+		}
+#elif defined(IQCONVERT_SSE2)
+		const __m128 g=_mm_set1_ps(Gain);
+		const __m128 o=_mm_set1_ps(Offset);
+		const __m128i zero=_mm_setzero_si128();
+		for(;i+8<=Count;i+=8)
+		{
+			__m128i v=_mm_loadu_si128((const __m128i *)(In+i*2));
+			__m128i w[2]={_mm_unpacklo_epi8(v,zero),_mm_unpackhi_epi8(v,zero)};
+			for(int k=0;k<2;k++)
+			{
+				__m128 lo=_mm_cvtepi32_ps(_mm_unpacklo_epi16(w[k],zero));
+				__m128 hi=_mm_cvtepi32_ps(_mm_unpackhi_epi16(w[k],zero));
+				_mm_storeu_ps(Out+i*2+k*8,_mm_add_ps(_mm_mul_ps(lo,g),o));
+				_mm_storeu_ps(Out+i*2+k*8+4,_mm_add_ps(_mm_mul_ps(hi,g),o));
+			}
+		}
+#endif
+	}
+	size_t n=i;
+	for(;i<Count;i+=Decimation,n++)
+	{
+		Out[n*2]=In[i*2]*Gain+Offset;
+		Out[n*2+1]=In[i*2+1]*Gain+Offset;
+	}
+	return n;
+}
+
+static size_t convert_float(const float *In,size_t Count,float *Out,int Decimation,float Gain)
+{
+	size_t i=0;
+	if(Decimation==1)
+	{
+		if(Gain==1.0f)
+		{
+			if(Out!=In) memmove(Out,In,Count*2*sizeof(float));
+			return Count;
+		}
+#if defined(IQCONVERT_NEON)
+		for(;i+2<=Count;i+=2)
+			vst1q_f32(Out+i*2,vmulq_n_f32(vld1q_f32(In+i*2),Gain));
+#elif defined(IQCONVERT_SSE2)
+		const __m128 g=_mm_set1_ps(Gain);
+		for(;i+2<=Count;i+=2)
+			_mm_storeu_ps(Out+i*2,_mm_mul_ps(_mm_loadu_ps(In+i*2),g));
+#endif
+	}
+	size_t n=i;
+	for(;i<Count;i+=Decimation,n++)
+	{
+		Out[n*2]=In[i*2]*Gain;
+		Out[n*2+1]=In[i*2+1]*Gain;
+	}
+	return n;
+}
+
+static size_t convert_double(const double *In,size_t Count,float *Out,int Decimation,float Gain)
+{
+	size_t i=0;
+	if(Decimation==1)
+	{
+#if defined(IQCONVERT_NEON) && defined(__aarch64__)
+		for(;i+2<=Count;i+=2)
+		{
+			float32x4_t v=vcombine_f32(vcvt_f32_f64(vld1q_f64(In+i*2)),vcvt_f32_f64(vld1q_f64(In+i*2+2)));
+			vst1q_f32(Out+i*2,vmulq_n_f32(v,Gain));
+		}
+#elif defined(IQCONVERT_SSE2)
+		const __m128 g=_mm_set1_ps(Gain);
+		for(;i+2<=Count;i+=2)
+		{
+			__m128 v=_mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(In+i*2)),_mm_cvtpd_ps(_mm_loadu_pd(In+i*2+2)));
+			_mm_storeu_ps(Out+i*2,_mm_mul_ps(v,g));
+		}
+#endif
+	}
+	size_t n=i;
+	for(;i<Count;i+=Decimation,n++)
+	{
+		Out[n*2]=(float)In[i*2]*Gain;
+		Out[n*2+1]=(float)In[i*2+1]*Gain;
+	}
+	return n;
+}
+
+size_t iqconvert(int InputType,const void *In,size_t Count,std::complex<float> *Out,int Decimation,float Scale)
+{
+	if(Decimation<1) Decimation=1;
+	float *Outf=reinterpret_cast<float *>(Out); // std::complex<float> is laid out as float[2]
+	switch(InputType)
+	{
+		case typeiq_i16:return convert_i16((const short *)In,Count,Outf,Decimation,Scale/32768.0f);
+		case typeiq_u8:return convert_u8((const unsigned char *)In,Count,Outf,Decimation,Scale/128.0f,-127.5f*Scale/128.0f);
+		case typeiq_float:return convert_float((const float *)In,Count,Outf,Decimation,Scale);
+		case typeiq_double:return convert_double((const double *)In,Count,Outf,Decimation,Scale);
+	}
+	return 0;
+}
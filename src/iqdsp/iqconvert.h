@@ -0,0 +1,22 @@
+#ifndef IQCONVERT_H
+#define IQCONVERT_H
+
+#include <complex>
+#include <stddef.h>
+
+// Interleaved I/Q input formats accepted by sendiq/rpitx
+enum {typeiq_i16,typeiq_u8,typeiq_float,typeiq_double};
+
+// Size in bytes of one interleaved I/Q pair, 0 for an unknown type
+size_t iqconvert_pairsize(int InputType);
+
+// Parse "i16","u8","float","double" : returns -1 if unknown
+int iqconvert_type(const char *Name);
+
+// Convert Count interleaved I/Q pairs from In to normalized complex samples (-1..1) multiplied by Scale,
+// keeping one pair every Decimation. Out must hold (Count+Decimation-1)/Decimation samples.
+// Returns the number of complex samples written.
+// Kernels are NEON (arm, when built with -mfpu=neon or on aarch64) or SSE2 (x86) with a scalar fallback
+size_t iqconvert(int InputType,const void *In,size_t Count,std::complex<float> *Out,int Decimation=1,float Scale=1.0f);
+
+#endif
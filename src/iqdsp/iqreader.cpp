@@ -0,0 +1,153 @@
+#include "iqreader.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+iqreader::iqreader()
+{
+	fd=-1;
+	Map=NULL;
+	MapSize=0;
+	PairSize=1;
+	Loop=false;
+	Syscalls=0;
+	Loops=0;
+	Running=NULL;
+	Offset=0;
+	AdvisedUpTo=0;
+	WrapAdvised=false;
+	Pending=0;
+}
+
+iqreader::~iqreader()
+{
+	Close();
+}
+
+bool iqreader::Open(const char *FileName,size_t Size,bool LoopMode)
+{
+	Close();
+	PairSize=Size;
+	Loop=LoopMode;
+	Syscalls=0;
+	Loops=0;
+	Offset=0;
+	Pending=0;
+	if(strcmp(FileName,"-")==0)
+		fd=STDIN_FILENO;
+	else
+		fd=open(FileName,O_RDONLY);
+	if(fd<0) return false;
+
+	struct stat st;
+	if((fd!=STDIN_FILENO)&&(fstat(fd,&st)==0)&&S_ISREG(st.st_mode)&&((size_t)st.st_size>=PairSize))
+	{
+		MapSize=(st.st_size/PairSize)*PairSize;
+		void *p=mmap(NULL,MapSize,PROT_READ,MAP_PRIVATE,fd,0);
+		if(p!=MAP_FAILED)
+		{
+			Map=(unsigned char *)p;
+			madvise(Map,MapSize,MADV_SEQUENTIAL);
+			Syscalls++;
+			AdvisedUpTo=0;
+			WrapAdvised=false;
+			Advise();
+			return true;
+		}
+		MapSize=0;
+	}
+	return true;
+}
+
+void iqreader::Close()
+{
+	if(Map!=NULL) munmap(Map,MapSize);
+	Map=NULL;
+	MapSize=0;
+	if((fd>=0)&&(fd!=STDIN_FILENO)) close(fd);
+	fd=-1;
+}
+
+// Ask for the next IQREADER_READAHEAD bytes once the advised window is half consumed.
+// At the end of the file in loop mode, the start of the file is requested before wrapping
+void iqreader::Advise()
+{
+	if(AdvisedUpTo>=MapSize)
+	{
+		if(!Loop||WrapAdvised) return;
+		madvise(Map,(MapSize<IQREADER_READAHEAD)?MapSize:IQREADER_READAHEAD,MADV_WILLNEED);
+		Syscalls++;
+		WrapAdvised=true;
+		return;
+	}
+	if(AdvisedUpTo-Offset>IQREADER_READAHEAD/2) return;
+	size_t Len=MapSize-AdvisedUpTo;
+	if(Len>IQREADER_READAHEAD) Len=IQREADER_READAHEAD;
+	madvise(Map+AdvisedUpTo,Len,MADV_WILLNEED);
+	Syscalls++;
+	AdvisedUpTo+=Len;
+}
+
+size_t iqreader::Read(const void **Data,size_t MaxPairs)
+{
+	if(fd<0) return 0;
+	if(Map!=NULL)
+	{
+		if(Offset>=MapSize)
+		{
+			if(!Loop) return 0;
+			Offset=0;
+			Loops++;
+			AdvisedUpTo=WrapAdvised?((MapSize<IQREADER_READAHEAD)?MapSize:IQREADER_READAHEAD):0;
+			WrapAdvised=false;
+		}
+		size_t Len=MaxPairs*PairSize;
+		if(Offset+Len>MapSize) Len=MapSize-Offset;
+		*Data=Map+Offset;
+		Offset+=Len;
+		Advise();
+		return Len/PairSize;
+	}
+
+	// Fill a whole burst like fread() did, keeping an incomplete pair for the next call
+	if(Buffer.size()<MaxPairs*PairSize) Buffer.resize(MaxPairs*PairSize);
+	memcpy(Buffer.data(),Partial,Pending);
+	size_t Len=Pending;
+	size_t Want=MaxPairs*PairSize;
+	bool Rewound=false;
+	while(Len<Want)
+	{
+		ssize_t n=read(fd,&Buffer[Len],Want-Len);
+		Syscalls++;
+		if(n<0)
+		{
+			// A signal is not the end of the input, only the caller can stop here
+			if(errno==EINTR)
+			{
+				if((Running!=NULL)&&!*Running) break;
+				continue;
+			}
+			return 0;
+		}
+		if(n==0)
+		{
+			if((Len>=PairSize)||!Loop||Rewound) break;
+			// Looping a file that could not be mapped
+			Syscalls++;
+			if(lseek(fd,0,SEEK_SET)<0) break;
+			Rewound=true;
+			Loops++;
+			Len=0;	// Drop a trailing incomplete pair
+			continue;
+		}
+		Len+=n;
+	}
+	size_t Pairs=Len/PairSize;
+	Pending=Len-Pairs*PairSize;
+	memcpy(Partial,&Buffer[Pairs*PairSize],Pending);
+	*Data=Buffer.data();
+	return Pairs;
+}
@@ -0,0 +1,52 @@
+#ifndef IQREADER_H
+#define IQREADER_H
+
+#include <stddef.h>
+#include <vector>
+
+// Burst reader for interleaved I/Q files.
+// Regular files are mmapped : bursts point straight into the mapped pages, the kernel is told the
+// access is sequential and the next IQREADER_READAHEAD bytes are requested ahead of use.
+// Loop mode is then an index wrap, without any syscall.
+// Pipes, stdin and files that cannot be mapped fall back to read() into an internal buffer.
+
+#define IQREADER_READAHEAD (1<<20)
+
+class iqreader
+{
+	public:
+	iqreader();
+	~iqreader();
+	// FileName "-" is stdin. Returns false if the input cannot be opened
+	bool Open(const char *FileName,size_t PairSize,bool Loop);
+	void Close();
+	// Points *Data to at most MaxPairs I/Q pairs and returns their number : 0 means end of input.
+	// Data stays valid until the next call
+	size_t Read(const void **Data,size_t MaxPairs);
+	bool IsMapped() const {return Map!=NULL;}
+	unsigned long GetSyscalls() const {return Syscalls;}	// read/lseek/madvise issued since Open
+	unsigned long GetLoops() const {return Loops;}
+	// A read interrupted by a signal resumes, unless *Running is false by then (NULL : always resumes)
+	void SetRunning(const volatile bool *Running) {this->Running=Running;}
+
+	private:
+	int fd;
+	size_t PairSize;
+	bool Loop;
+	unsigned long Syscalls;
+	unsigned long Loops;
+	const volatile bool *Running;
+	// mmap path
+	unsigned char *Map;
+	size_t MapSize;	// Whole pairs only
+	size_t Offset;
+	size_t AdvisedUpTo;
+	bool WrapAdvised;
+	void Advise();
+	// read() path
+	std::vector<unsigned char> Buffer;
+	size_t Pending;	// Bytes of an incomplete pair kept from the previous read
+	unsigned char Partial[2*sizeof(double)];
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "iqresampler.h"
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IQRESAMPLER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define IQRESAMPLER_SSE2
+#endif
+
+#define PI 3.14159265358979323846
+
+static double bessel_i0(double x)
+{
+	double Sum=1.0,Term=1.0;
+	for(int k=1;k<50;k++)
+	{
+		Term*=(x/(2.0*k))*(x/(2.0*k));
+		Sum+=Term;
+		if(Term<Sum*1e-12) break;
+	}
+	return Sum;
+}
+
+static uint64_t gcd64(uint64_t a,uint64_t b)
+{
+	while(b!=0)
+	{
+		uint64_t t=a%b;
+		a=b;
+		b=t;
+	}
+	return a;
+}
+
+iqresampler::iqresampler(double InRate,double OutRate,float Attenuation,float Transition)
+{
+	Ratio=InRate/OutRate;
+	// Rational ratio when both rates are integers and the reduced interpolation fits the phase budget
+	uint64_t L=0,M=0;
+	Rational=false;
+	if((InRate==floor(InRate))&&(OutRate==floor(OutRate)))
+	{
+		uint64_t g=gcd64((uint64_t)InRate,(uint64_t)OutRate);
+		L=(uint64_t)OutRate/g;
+		M=(uint64_t)InRate/g;
+		Rational=(L<=IQRESAMPLER_PHASES);
+	}
+	if(Rational)
+	{
+		Phases=L;
+		Step=M<<32;
+	}
+	else
+	{
+		Phases=IQRESAMPLER_PHASES;
+		Step=(uint64_t)llround(Ratio*Phases*4294967296.0);
+	}
+
+	// Kaiser design at the upsampled rate Phases*InRate
+	double LowRate=(InRate<OutRate)?InRate:OutRate;
+	double UpRate=InRate*Phases;
+	double Cutoff=0.5*LowRate/UpRate;	// cycles per upsampled sample
+	double DeltaW=2*PI*Transition*LowRate/UpRate;
+	double Beta;
+	if(Attenuation>50) Beta=0.1102*(Attenuation-8.7);
+	else if(Attenuation>21) Beta=0.5842*pow(Attenuation-21,0.4)+0.07886*(Attenuation-21);
+	else Beta=0;
+	int Length=(int)ceil((Attenuation-8)/(2.285*DeltaW));
+	Taps=(Length+Phases-1)/Phases;
+	if(Taps<2) Taps=2;
+	Length=Taps*Phases;
+	TapsPadded=(Taps+3)&~3;
+
+	std::vector<double> Proto(Length);
+	double Sum=0;
+	for(int k=0;k<Length;k++)
+	{
+		double t=k-(Length-1)/2.0;
+		double x=2*Cutoff*t;
+		double Sinc=(fabs(x)<1e-12)?1.0:sin(PI*x)/(PI*x);
+		double r=2.0*k/(Length-1)-1.0;
+		double Window=bessel_i0(Beta*sqrt(1-r*r))/bessel_i0(Beta);
+		Proto[k]=2*Cutoff*Sinc*Window;
+		Sum+=Proto[k];
+	}
+
+	// Phase p uses h[p+j*Phases] against x[n-j] : stored reversed so the window reads forward in time
+	Coefs.assign((size_t)Phases*TapsPadded*2,0.0f);
+	for(int p=0;p<Phases;p++)
+	{
+		float *c=&Coefs[(size_t)p*TapsPadded*2];
+		for(int j=0;j<Taps;j++)
+		{
+			float h=Proto[p+j*Phases]*Phases/Sum;
+			c[(TapsPadded-1-j)*2]=h;
+			c[(TapsPadded-1-j)*2+1]=h;
+		}
+	}
+	Reset();
+}
+
+void iqresampler::Reset()
+{
+	History.assign(TapsPadded-1,std::complex<float>(0,0));
+	Time=0;
+}
+
+size_t iqresampler::MaxOutput(size_t InCount) const
+{
+	return (size_t)(InCount/Ratio)+2;
+}
+
+// Complex dot product of Count interleaved I/Q samples with doubled real coefficients
+static inline std::complex<float> dot(const float *x,const float *c,int Count)
+{
+#if defined(IQRESAMPLER_NEON)
+	float32x4_t acc0=vdupq_n_f32(0),acc1=vdupq_n_f32(0);
+	for(int i=0;i<Count*2;i+=8)
+	{
+		acc0=vmlaq_f32(acc0,vld1q_f32(x+i),vld1q_f32(c+i));
+		acc1=vmlaq_f32(acc1,vld1q_f32(x+i+4),vld1q_f32(c+i+4));
+	}
+	float32x4_t acc=vaddq_f32(acc0,acc1);
+	float32x2_t s=vadd_f32(vget_low_f32(acc),vget_high_f32(acc));
+	return std::complex<float>(vget_lane_f32(s,0),vget_lane_f32(s,1));
+#elif defined(IQRESAMPLER_SSE2)
+	__m128 acc0=_mm_setzero_ps(),acc1=_mm_setzero_ps();
+	for(int i=0;i<Count*2;i+=8)
+	{
+		acc0=_mm_add_ps(acc0,_mm_mul_ps(_mm_loadu_ps(x+i),_mm_loadu_ps(c+i)));
+		acc1=_mm_add_ps(acc1,_mm_mul_ps(_mm_loadu_ps(x+i+4),_mm_loadu_ps(c+i+4)));
+	}
+	__m128 acc=_mm_add_ps(acc0,acc1);
+	acc=_mm_add_ps(acc,_mm_movehl_ps(acc,acc));
+	float s[4];
+	_mm_storeu_ps(s,acc);
+	return std::complex<float>(s[0],s[1]);
+#else
+	float re=0,im=0;
+	for(int i=0;i<Count*2;i+=2)
+	{
+		re+=x[i]*c[i];
+		im+=x[i+1]*c[i+1];
+	}
+	return std::complex<float>(re,im);
+#endif
+}
+
+size_t iqresampler::Process(const std::complex<float> *In,size_t InCount,std::complex<float> *Out)
+{
+	// History keeps TapsPadded-1 samples so that every window of TapsPadded samples ending on x[n] is
+	// contiguous : the padding coefficients are zero
+	size_t HistoryLen=TapsPadded-1;
+	History.resize(HistoryLen+InCount);
+	memcpy(&History[HistoryLen],In,InCount*sizeof(std::complex<float>));
+	const float *x=reinterpret_cast<const float *>(History.data());
+
+	size_t NbOut=0;
+	for(;;)
+	{
+		uint64_t t=Time>>32;
+		uint64_t n=t/Phases;
+		if(n>=InCount) break;
+		int p=t%Phases;
+		// Window x[n-TapsPadded+1..n] starts at History[n], padding taps are at the front of each phase
+		Out[NbOut++]=dot(x+n*2,&Coefs[(size_t)p*TapsPadded*2],TapsPadded);
+		Time+=Step;
+	}
+	Time-=((uint64_t)InCount*Phases)<<32;
+	memmove(History.data(),&History[InCount],HistoryLen*sizeof(std::complex<float>));
+	History.resize(HistoryLen);
+	return NbOut;
+}
@@ -0,0 +1,43 @@
+#ifndef IQRESAMPLER_H
+#define IQRESAMPLER_H
+
+#include <complex>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming polyphase FIR resampler for complex samples.
+// InRate/OutRate is reduced to L/M : when L is small enough every output uses one of the L
+// exact phases, otherwise the ratio is handled as arbitrary with IQRESAMPLER_PHASES phases and
+// a 32.32 fixed point time accumulator.
+// The prototype low-pass is a Kaiser windowed sinc, cut at the lowest Nyquist of the two rates,
+// with Transition (fraction of the lowest rate) and Attenuation (dB) setting the number of taps.
+
+#define IQRESAMPLER_PHASES 256
+
+class iqresampler
+{
+	public:
+	iqresampler(double InRate,double OutRate,float Attenuation=60.0f,float Transition=0.2f);
+	// Resample InCount samples, Out must hold at least MaxOutput(InCount) samples.
+	// Returns the number of samples written to Out
+	size_t Process(const std::complex<float> *In,size_t InCount,std::complex<float> *Out);
+	size_t MaxOutput(size_t InCount) const;
+	void Reset();
+	int GetTaps() const {return Taps;} // Taps per phase, i.e. MAC per output sample
+	int GetPhases() const {return Phases;}
+	bool IsRational() const {return Rational;}
+
+	private:
+	double Ratio;	// InRate/OutRate
+	int Phases;
+	int Taps;
+	int TapsPadded;	// Taps rounded up for the vector loop
+	bool Rational;
+	uint64_t Step;	// Output period in phase units, 32.32 fixed point
+	uint64_t Time;	// Position of the next output in phase units, 32.32 fixed point
+	std::vector<float> Coefs;	// Per phase, reversed, each tap doubled to match interleaved I/Q
+	std::vector<std::complex<float> > History;	// Taps-1 previous samples followed by the current block
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <string.h>
+
+// Single writer snapshot of a plain struct T.
+// The writer never waits, readers copy the whole value and retry if a store ran meanwhile,
+// so a reader in a real time loop never blocks or allocates and never sees a half updated T.
+
+template<typename T> class seqlock
+{
+	public:
+	seqlock()
+	{
+		Sequence.store(0,std::memory_order_relaxed);
+		memset(&Value,0,sizeof(T));
+	}
+
+	void Store(const T &NewValue)
+	{
+		unsigned s=Sequence.load(std::memory_order_relaxed);
+		Sequence.store(s+1,std::memory_order_relaxed);	// Odd : write in progress
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(&Value,&NewValue,sizeof(T));
+		Sequence.store(s+2,std::memory_order_release);
+	}
+
+	void Load(T &Out) const
+	{
+		unsigned s1,s2;
+		do
+		{
+			s1=Sequence.load(std::memory_order_acquire);
+			memcpy(&Out,&Value,sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			s2=Sequence.load(std::memory_order_relaxed);
+		} while((s1&1)||(s1!=s2));
+	}
+
+	// Changes each time a new value is stored, lets a reader skip unchanged snapshots
+	unsigned GetVersion() const {return Sequence.load(std::memory_order_acquire);}
+
+	private:
+	alignas(64) std::atomic<unsigned> Sequence;
+	T Value;
+};
+
+#endif
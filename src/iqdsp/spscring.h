@@ -0,0 +1,76 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <string.h>
+
+// Lock-free single producer / single consumer ring of T.
+// Capacity is rounded up to a power of two, head and tail are free running counters
+// written by one side only, each on its own cache line.
+
+template<typename T> class spscring
+{
+	public:
+	spscring(size_t MinCapacity)
+	{
+		Capacity=1;
+		while(Capacity<MinCapacity) Capacity<<=1;
+		Mask=Capacity-1;
+		Buffer.resize(Capacity);
+		Head.store(0,std::memory_order_relaxed);
+		Tail.store(0,std::memory_order_relaxed);
+	}
+
+	size_t GetCapacity() const {return Capacity;}
+
+	// Consumer side view of the number of samples ready
+	size_t Available() const
+	{
+		return Head.load(std::memory_order_acquire)-Tail.load(std::memory_order_relaxed);
+	}
+
+	// Producer side view of the free room
+	size_t Free() const
+	{
+		return Capacity-(Head.load(std::memory_order_relaxed)-Tail.load(std::memory_order_acquire));
+	}
+
+	// Producer : copies up to Count items, returns the number pushed
+	size_t Push(const T *Items,size_t Count)
+	{
+		size_t h=Head.load(std::memory_order_relaxed);
+		size_t Room=Capacity-(h-Tail.load(std::memory_order_acquire));
+		if(Count>Room) Count=Room;
+		size_t Start=h&Mask;
+		size_t First=(Count<Capacity-Start)?Count:Capacity-Start;
+		memcpy(&Buffer[Start],Items,First*sizeof(T));
+		memcpy(&Buffer[0],Items+First,(Count-First)*sizeof(T));
+		Head.store(h+Count,std::memory_order_release);
+		return Count;
+	}
+
+	// Consumer : copies up to Count items, returns the number popped
+	size_t Pop(T *Items,size_t Count)
+	{
+		size_t t=Tail.load(std::memory_order_relaxed);
+		size_t Ready=Head.load(std::memory_order_acquire)-t;
+		if(Count>Ready) Count=Ready;
+		size_t Start=t&Mask;
+		size_t First=(Count<Capacity-Start)?Count:Capacity-Start;
+		memcpy(Items,&Buffer[Start],First*sizeof(T));
+		memcpy(Items+First,&Buffer[0],(Count-First)*sizeof(T));
+		Tail.store(t+Count,std::memory_order_release);
+		return Count;
+	}
+
+	private:
+	size_t Capacity;
+	size_t Mask;
+	std::vector<T> Buffer;
+	alignas(64) std::atomic<size_t> Head;	// Written by the producer
+	alignas(64) std::atomic<size_t> Tail;	// Written by the consumer
+};
+
+#endif
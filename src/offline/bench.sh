@@ -0,0 +1,56 @@
+#!/bin/sh
+# Runs each modulator built by "make offline" against the null sink, as fast as possible.
+# Prints one JSON line per case : samples, signal/wall/cpu seconds, samples/s and realtime factor
+# (both against cpu time) and peak RSS. Tools which were not built are reported as skipped.
+# Usage : offline/bench.sh [output.json]   (from src/)
+
+BIN=offline/bin
+ROOT=..
+OUT=${1:-/dev/stdout}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+export RPITX_SINK=null
+export RPITX_BENCH="$TMP/bench.json"
+unset RPITX_SINK_REALTIME
+
+# 10 s of i16 I/Q at 48 kS/s (sendiq carries the csdr SSB chain), its content does not matter
+head -c 1920000 /dev/urandom >"$TMP/iq48.raw"
+head -c 1920000 /dev/urandom >"$TMP/iq400.raw"
+
+# run name seconds(0 = until done) tool args...
+run()
+{
+	NAME=$1
+	LIMIT=$2
+	TOOL=$3
+	shift 3
+	if [ ! -x "$BIN/$TOOL" ]; then
+		echo "{\"name\":\"$NAME\",\"skipped\":\"$TOOL not built\"}" >>"$RPITX_BENCH"
+		return
+	fi
+	if [ "$LIMIT" -gt 0 ]; then
+		RPITX_BENCH_NAME=$NAME timeout -s INT "$LIMIT" "$BIN/$TOOL" "$@" >/dev/null 2>&1 </dev/null
+	else
+		RPITX_BENCH_NAME=$NAME "$BIN/$TOOL" "$@" >/dev/null 2>&1 <"${STDIN:-/dev/null}"
+	fi
+}
+
+run pifmrds-mpx 3 pifmrds -freq 107.9 -audio $ROOT/stereo_44100.wav
+run pifmrds-rds 3 pifmrds -freq 107.9 -ps BENCH -rt "rpitx offline bench"
+run sstv-martin1 0 pisstv $ROOT/picture.rgb 144.5e6
+printf '1:rpitx offline benchmark, pocsag 1200 baud message long enough to span a few batches' >"$TMP/pocsag.txt"
+STDIN="$TMP/pocsag.txt" run pocsag 0 pocsag -f 466.23e6
+run lora-sf7 0 pilora 434000000 7 125000 hex 0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF
+run lora-sf12 0 pilora 434000000 12 125000 hex 0123456789ABCDEF
+run fsq 0 pifsq "rpitx offline benchmark for fsq" 14.097e6
+run ft8 0 pift8 "CQ F5OEO JN08" 14.074e6
+run opera 0 piopera F5OEO 0.5 7.0386e6
+run chirp 2 pichirp 434e6 100000 5
+run morse 0 morse 434e6 20 "CQ CQ DE F5OEO RPITX OFFLINE BENCH K"
+run rtty 0 pirtty 434e6 1000 "RYRYRY THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG"
+run dvbs 0 dvbrf
+run ssb-sendiq 0 sendiq -i "$TMP/iq48.raw" -s 48000 -f 434e6 -t i16
+run sendiq-resample 0 sendiq -i "$TMP/iq400.raw" -s 400000 -f 434e6 -t i16
+
+cat "$RPITX_BENCH" >>"$OUT"
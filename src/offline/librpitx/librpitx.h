@@ -0,0 +1,221 @@
+#ifndef OFFLINE_LIBRPITX_H
+#define OFFLINE_LIBRPITX_H
+
+// Offline stand-in for librpitx : the classes and methods used by the tools of this tree, with the
+// DMA replaced by a sink recording the exact stream each transmitter would have sent.
+// Build a tool with -Ioffline and offline/offlinesink.cpp instead of -lrpitx (see make offline).
+//
+// Environment
+//  RPITX_SINK=null|path     null (default) only counts samples, a path records them as text
+//  RPITX_SINK_REALTIME=1    consume the fifo at the sample rate like the DMA, default is as fast as
+//                           possible : the fifo is never full, so the tools never wait on it. Their
+//                           own sleeps are real, cpu time in the bench counts only their work
+//  RPITX_BENCH=path         append a JSON line (samples, signal/wall/cpu time, samples/s, realtime
+//                           factor against cpu time, peak RSS) at exit, named RPITX_BENCH_NAME
+//
+// Recorded lines are "<time ns> <object> <kind> <values>", time from the object sample clock
+// (wall clock for a bare clkgpio) :
+//  F frequency sample (Hz) [amplitude in MODE_FREQ_A]  I i q  A amplitude  P phase index
+//  S symbol  O ook value duration(us)  C center frequency (Hz)  T frequency offset (Hz)
+//  E gpio clock enabled(1)/disabled(0)
+// Each object is introduced by "# <object> <class> <rate>".
+// At exit a summary per object is printed on stderr.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <complex>
+
+#define MODE_IQ 0
+#define MODE_FREQ_A 1
+
+#define XOSC_FREQUENCY 19200000
+
+void dbg_setlevel(int Level);
+int dbg_getlevel();
+void dbg_printf(int Level,const char *fmt,...);
+
+// One recorded stream per transmitter object
+class offlinesink
+{
+	protected:
+	int Id;
+	const char *Class;
+	double Rate;			// Samples per second, 0 for wall clock time
+	uint64_t Samples;
+	bool Introduced;
+	int64_t Now();
+	void Introduce();
+
+	public:
+	offlinesink();
+	~offlinesink();
+	void Setup(const char *Class,double Rate);
+	void Sample(char Kind,double a);
+	void Sample(char Kind,double a,double b);
+	void Event(char Kind,double a);
+	void Event(char Kind,double a,double b);
+	void Skip(uint64_t Count) {Samples+=Count;}
+	int GetId() {return Id;}
+	const char *GetClass() {return Class;}
+	uint64_t GetSamples() {return Samples;}
+	double GetRate() {return Rate;}
+};
+
+class gpio
+{
+	public:
+	gpio() {}
+};
+
+class generalgpio : public gpio
+{
+	public:
+	int setmode(uint32_t gpio,uint32_t mode) {return 0;}
+	int setpulloff(uint32_t gpio) {return 0;}
+};
+
+class padgpio : public gpio
+{
+	public:
+	int setlevel(int level) {return 0;}
+};
+
+class clkgpio : public gpio
+{
+	protected:
+	uint64_t CentralFrequency;
+	double clk_ppm;
+	offlinesink Sink;
+
+	public:
+	int PllFixDivider;
+	bool ModulateFromMasterPLL;
+	clkgpio();
+	~clkgpio() {}
+	int SetPllNumber(int PllNo,int MashType) {return 0;}
+	uint64_t GetPllFrequency(int PllNo);
+	void print_clock_tree() {}
+	int SetFrequency(double Frequency);
+	int SetClkDivFrac(uint32_t Div,uint32_t Frac) {return 0;}
+	void SetPhase(bool inversed) {}
+	void SetAdvancedPllMode(bool Advanced) {ModulateFromMasterPLL=Advanced;}
+	int SetCenterFrequency(uint64_t Frequency,int Bandwidth);
+	double GetFrequencyResolution();
+	double GetRealFrequency(double Frequency) {return Frequency;}
+	int ComputeBestLO(uint64_t Frequency,int Bandwidth);
+	int SetMasterMultFrac(uint32_t Mult,uint32_t Frac) {return 0;}
+	uint32_t GetMasterFrac(double Frequency);
+	void enableclk(int gpio) {Sink.Event('E',gpio,1);}
+	void disableclk(int gpio) {Sink.Event('E',gpio,0);}
+	void Setppm(double ppm) {clk_ppm=ppm;}
+	void SetppmFromNTP() {}
+};
+
+class dma
+{
+	public:
+	void start() {}
+	void stop() {}
+};
+
+// Fifo bookkeeping : the "DMA" consumes instantly, or at Rate with RPITX_SINK_REALTIME
+class bufferdma : public dma
+{
+	protected:
+	uint32_t buffersize;
+	offlinesink *Stream;
+	bool Realtime;
+	double Start;
+	uint64_t Consumed();
+	void Pace();			// Wait for a free slot, like a full DMA fifo
+
+	public:
+	bufferdma(uint32_t FifoSize);
+	int GetBufferAvailable();
+	int GetUserMemIndex();
+	int PushSample(int Index) {return 0;}
+};
+
+class iqdmasync : public bufferdma, public clkgpio
+{
+	protected:
+	uint32_t SampleRate;
+
+	public:
+	int ModeIQ;
+	iqdmasync(uint64_t TuneFrequency,uint32_t SR,int Channel,uint32_t FifoSize,int Mode);
+	void SetPLLMasterLoop(int iqdmasyncPLLNo,int SecondPLL,int MultGain) {}
+	void SetIQSample(uint32_t Index,std::complex<float> sample,int Harmonic);
+	void SetIQSamples(std::complex<float> *sample,size_t Size,int Harmonic);
+};
+
+class ngfmdmasync : public bufferdma, public clkgpio
+{
+	protected:
+	uint32_t SampleRate;
+
+	public:
+	ngfmdmasync(uint64_t TuneFrequency,uint32_t SR,int Channel,uint32_t FifoSize,bool UsePwm=false);
+	void SetFrequencySample(uint32_t Index,float Frequency);
+	void SetFrequencySamples(float *sample,size_t Size);
+};
+
+class amdmasync : public bufferdma, public clkgpio
+{
+	protected:
+	uint32_t SampleRate;
+
+	public:
+	amdmasync(uint64_t TuneFrequency,uint32_t SR,int Channel,uint32_t FifoSize);
+	void SetAmSample(uint32_t Index,float Amplitude);
+	void SetAmSamples(float *sample,size_t Size);
+};
+
+class phasedmasync : public bufferdma, public clkgpio
+{
+	protected:
+	uint32_t SampleRate;
+	int NumbPhase;
+
+	public:
+	phasedmasync(uint64_t TuneFrequency,uint32_t SampleRate,int NumberOfPhase,int Channel,uint32_t FifoSize);
+	void SetPhase(uint32_t Index,int Phase);
+	void SetPhaseSamples(int *sample,size_t Size);
+};
+
+class fskburst : public bufferdma, public clkgpio
+{
+	protected:
+	float SymbolRate;
+	float FreqDeviation;
+	size_t Upsample;
+
+	public:
+	fskburst(uint64_t TuneFrequency,float SymbolRate,float Deviation,int Channel,uint32_t FifoSize,size_t upsample=1,float RatioRamp=0);
+	void SetSymbols(unsigned char *Symbols,uint32_t Size);
+};
+
+class ookburst : public bufferdma, public clkgpio
+{
+	protected:
+	float SymbolRate;
+	size_t Upsample;
+
+	public:
+	ookburst(uint64_t TuneFrequency,float SymbolRate,int Channel,uint32_t FifoSize,size_t upsample=1,float RatioRamp=0);
+	void SetSymbols(unsigned char *Symbols,uint32_t Size);
+};
+
+class ookbursttiming : public ookburst
+{
+	public:
+	struct SampleOOKTiming {
+		unsigned char value;
+		size_t duration;	// us
+	};
+	ookbursttiming(uint64_t TuneFrequency,size_t MaxMessageDuration);
+	void SendMessage(SampleOOKTiming *TabElementOOK,size_t Size);
+};
+
+#endif
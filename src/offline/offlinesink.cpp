@@ -0,0 +1,444 @@
+// Sink side of the offline librpitx stand-in, see librpitx/librpitx.h
+#include <librpitx/librpitx.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <vector>
+#include <string>
+
+static int DebugLevel=0;
+
+void dbg_setlevel(int Level)
+{
+	DebugLevel=Level;
+}
+
+int dbg_getlevel()
+{
+	return DebugLevel;
+}
+
+void dbg_printf(int Level,const char *fmt,...)
+{
+	if(Level>DebugLevel) return;
+	va_list args;
+	va_start(args,fmt);
+	vfprintf(stderr,fmt,args);
+	va_end(args);
+}
+
+static double monotonic()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static double ProcessStart=monotonic();
+
+// *----- Shared state of all the sinks
+struct sinksummary {
+	int Id;
+	std::string Class;
+	uint64_t Samples;
+	double Rate;
+};
+
+struct sinkstate {
+	FILE *Out;
+	bool Realtime;
+	double Start;
+	const char *Bench;		// RPITX_BENCH : file the benchmark line is appended to
+	int Objects;
+	std::vector<offlinesink *> Live;
+	std::vector<sinksummary> Done;
+};
+
+static void print_summary();
+
+static sinkstate &state()
+{
+	static sinkstate *State=NULL;
+	if(State==NULL)
+	{
+		State=new sinkstate;
+		State->Out=NULL;
+		State->Objects=0;
+		State->Start=monotonic();
+		const char *Sink=getenv("RPITX_SINK");
+		if((Sink!=NULL)&&(strcmp(Sink,"null")!=0)&&(Sink[0]!=0))
+		{
+			State->Out=fopen(Sink,"w");
+			if(State->Out==NULL) fprintf(stderr,"offline : cannot open %s, using null sink\n",Sink);
+			else setvbuf(State->Out,NULL,_IOFBF,1<<20);
+		}
+		const char *Realtime=getenv("RPITX_SINK_REALTIME");
+		State->Realtime=(Realtime!=NULL)&&(atoi(Realtime)!=0);
+		State->Bench=getenv("RPITX_BENCH");
+		atexit(print_summary);
+	}
+	return *State;
+}
+
+// One JSON line per process : throughput against CPU time so that it does not depend on the host load
+static void print_bench(const std::vector<sinksummary> &All)
+{
+	sinkstate &State=state();
+	struct rusage ru;
+	getrusage(RUSAGE_SELF,&ru);
+	double Cpu=ru.ru_utime.tv_sec+ru.ru_utime.tv_usec*1e-6+ru.ru_stime.tv_sec+ru.ru_stime.tv_usec*1e-6;
+	double Wall=monotonic()-ProcessStart;
+	uint64_t Samples=0;
+	double Signal=0;
+	std::string Classes;
+	for(size_t i=0;i<All.size();i++)
+	{
+		if(All[i].Rate<=0) continue;
+		// Tools like morse transmit with one object after the other
+		Samples+=All[i].Samples;
+		Signal+=All[i].Samples/All[i].Rate;
+		if(("+"+Classes+"+").find("+"+All[i].Class+"+")!=std::string::npos) continue;
+		if(!Classes.empty()) Classes+="+";
+		Classes+=All[i].Class;
+	}
+	const char *Name=getenv("RPITX_BENCH_NAME");
+	if(Name==NULL) Name=program_invocation_short_name;
+	FILE *f=fopen(State.Bench,"a");
+	if(f==NULL) return;
+	fprintf(f,"{\"name\":\"%s\",\"class\":\"%s\",\"samples\":%llu,\"signal_s\":%.3f,\"wall_s\":%.4f,\"cpu_s\":%.4f,"
+		"\"samples_per_s\":%.0f,\"realtime_factor\":%.1f,\"peak_rss_kb\":%ld}\n",
+		Name,Classes.c_str(),(unsigned long long)Samples,Signal,Wall,Cpu,
+		(Cpu>0)?Samples/Cpu:0,(Cpu>0)?Signal/Cpu:0,ru.ru_maxrss);
+	fclose(f);
+}
+
+static void print_summary()
+{
+	sinkstate &State=state();
+	std::vector<sinksummary> All(State.Done);
+	for(size_t i=0;i<State.Live.size();i++)
+	{
+		sinksummary Summary={State.Live[i]->GetId(),State.Live[i]->GetClass(),State.Live[i]->GetSamples(),State.Live[i]->GetRate()};
+		All.push_back(Summary);
+	}
+	for(size_t i=0;i<All.size();i++)
+	{
+		if(All[i].Rate>0)
+			fprintf(stderr,"offline : %d %s %llu samples, %.3f s of signal\n",All[i].Id,All[i].Class.c_str(),(unsigned long long)All[i].Samples,All[i].Samples/All[i].Rate);
+		else
+			fprintf(stderr,"offline : %d %s\n",All[i].Id,All[i].Class.c_str());
+	}
+	if(State.Out) fflush(State.Out);
+	if((State.Bench!=NULL)&&(State.Bench[0]!=0)) print_bench(All);
+}
+
+// *----- offlinesink
+offlinesink::offlinesink()
+{
+	sinkstate &State=state();
+	Id=State.Objects++;
+	Class="clkgpio";
+	Rate=0;
+	Samples=0;
+	Introduced=false;
+	State.Live.push_back(this);
+}
+
+offlinesink::~offlinesink()
+{
+	sinkstate &State=state();
+	sinksummary Summary={Id,Class,Samples,Rate};
+	State.Done.push_back(Summary);
+	for(size_t i=0;i<State.Live.size();i++)
+		if(State.Live[i]==this) {State.Live.erase(State.Live.begin()+i);break;}
+}
+
+void offlinesink::Setup(const char *Class,double Rate)
+{
+	this->Class=Class;
+	this->Rate=Rate;
+}
+
+int64_t offlinesink::Now()
+{
+	if(Rate>0) return (int64_t)((Samples*1e9)/Rate);
+	return (int64_t)((monotonic()-state().Start)*1e9);
+}
+
+void offlinesink::Introduce()
+{
+	Introduced=true;
+	fprintf(state().Out,"# %d %s %.9g\n",Id,Class,Rate);
+}
+
+void offlinesink::Sample(char Kind,double a)
+{
+	FILE *Out=state().Out;
+	if(Out)
+	{
+		if(!Introduced) Introduce();
+		fprintf(Out,"%lld %d %c %.9g\n",(long long)Now(),Id,Kind,a);
+	}
+	Samples++;
+}
+
+void offlinesink::Sample(char Kind,double a,double b)
+{
+	FILE *Out=state().Out;
+	if(Out)
+	{
+		if(!Introduced) Introduce();
+		fprintf(Out,"%lld %d %c %.9g %.9g\n",(long long)Now(),Id,Kind,a,b);
+	}
+	Samples++;
+}
+
+void offlinesink::Event(char Kind,double a)
+{
+	FILE *Out=state().Out;
+	if(Out==NULL) return;
+	if(!Introduced) Introduce();
+	fprintf(Out,"%lld %d %c %.9g\n",(long long)Now(),Id,Kind,a);
+}
+
+void offlinesink::Event(char Kind,double a,double b)
+{
+	FILE *Out=state().Out;
+	if(Out==NULL) return;
+	if(!Introduced) Introduce();
+	fprintf(Out,"%lld %d %c %.9g %.9g\n",(long long)Now(),Id,Kind,a,b);
+}
+
+// *----- clkgpio
+clkgpio::clkgpio()
+{
+	CentralFrequency=0;
+	clk_ppm=0;
+	PllFixDivider=8;
+	ModulateFromMasterPLL=false;
+}
+
+uint64_t clkgpio::GetPllFrequency(int PllNo)
+{
+	return CentralFrequency*PllFixDivider;
+}
+
+int clkgpio::SetFrequency(double Frequency)
+{
+	Sink.Event('T',Frequency);
+	return 0;
+}
+
+int clkgpio::SetCenterFrequency(uint64_t Frequency,int Bandwidth)
+{
+	CentralFrequency=Frequency;
+	ComputeBestLO(Frequency,Bandwidth);
+	Sink.Event('C',(double)Frequency);
+	return 0;
+}
+
+double clkgpio::GetFrequencyResolution()
+{
+	return (double)XOSC_FREQUENCY/(PllFixDivider*(double)(1<<20));
+}
+
+// Approximation of the librpitx choice : smallest divider keeping the PLL above 600 MHz
+int clkgpio::ComputeBestLO(uint64_t Frequency,int Bandwidth)
+{
+	if(Frequency==0) return -1;
+	int Divider=1;
+	while((Frequency*Divider<600000000ULL)&&(Divider<4095)) Divider++;
+	PllFixDivider=Divider;
+	return 0;
+}
+
+uint32_t clkgpio::GetMasterFrac(double Frequency)
+{
+	double FloatMult=((CentralFrequency+Frequency)*PllFixDivider)/(double)XOSC_FREQUENCY;
+	uint32_t freqctl=(uint32_t)(FloatMult*(double)(1<<20));
+	return freqctl&0xFFFFF;
+}
+
+// *----- bufferdma
+bufferdma::bufferdma(uint32_t FifoSize)
+{
+	buffersize=FifoSize;
+	Stream=NULL;
+	Realtime=state().Realtime;
+	Start=monotonic();
+}
+
+uint64_t bufferdma::Consumed()
+{
+	uint64_t Written=Stream->GetSamples();
+	if(!Realtime) return Written;
+	uint64_t Played=(uint64_t)((monotonic()-Start)*Stream->GetRate());
+	return (Played<Written)?Played:Written;
+}
+
+int bufferdma::GetBufferAvailable()
+{
+	return buffersize-(int)(Stream->GetSamples()-Consumed());
+}
+
+int bufferdma::GetUserMemIndex()
+{
+	return (int)(Stream->GetSamples()%buffersize);
+}
+
+void bufferdma::Pace()
+{
+	while(Realtime&&(GetBufferAvailable()<=0)) usleep(100);
+}
+
+// *----- Transmitters
+iqdmasync::iqdmasync(uint64_t TuneFrequency,uint32_t SR,int Channel,uint32_t FifoSize,int Mode):bufferdma(FifoSize)
+{
+	SampleRate=SR;
+	ModeIQ=Mode;
+	Stream=&Sink;
+	Sink.Setup("iqdmasync",SR);
+	SetCenterFrequency(TuneFrequency,SR);
+}
+
+void iqdmasync::SetIQSample(uint32_t Index,std::complex<float> sample,int Harmonic)
+{
+	if(ModeIQ==MODE_FREQ_A) Sink.Sample('F',sample.real(),sample.imag());
+	else Sink.Sample('I',sample.real(),sample.imag());
+}
+
+void iqdmasync::SetIQSamples(std::complex<float> *sample,size_t Size,int Harmonic)
+{
+	for(size_t i=0;i<Size;i++)
+	{
+		Pace();
+		SetIQSample(GetUserMemIndex(),sample[i],Harmonic);
+	}
+}
+
+ngfmdmasync::ngfmdmasync(uint64_t TuneFrequency,uint32_t SR,int Channel,uint32_t FifoSize,bool UsePwm):bufferdma(FifoSize)
+{
+	SampleRate=SR;
+	Stream=&Sink;
+	Sink.Setup("ngfmdmasync",SR);
+	SetCenterFrequency(TuneFrequency,SR);
+}
+
+void ngfmdmasync::SetFrequencySample(uint32_t Index,float Frequency)
+{
+	Sink.Sample('F',Frequency);
+}
+
+void ngfmdmasync::SetFrequencySamples(float *sample,size_t Size)
+{
+	for(size_t i=0;i<Size;i++)
+	{
+		Pace();
+		Sink.Sample('F',sample[i]);
+	}
+}
+
+amdmasync::amdmasync(uint64_t TuneFrequency,uint32_t SR,int Channel,uint32_t FifoSize):bufferdma(FifoSize)
+{
+	SampleRate=SR;
+	Stream=&Sink;
+	Sink.Setup("amdmasync",SR);
+	SetCenterFrequency(TuneFrequency,SR);
+}
+
+void amdmasync::SetAmSample(uint32_t Index,float Amplitude)
+{
+	Sink.Sample('A',Amplitude);
+}
+
+void amdmasync::SetAmSamples(float *sample,size_t Size)
+{
+	for(size_t i=0;i<Size;i++)
+	{
+		Pace();
+		Sink.Sample('A',sample[i]);
+	}
+}
+
+phasedmasync::phasedmasync(uint64_t TuneFrequency,uint32_t SampleRate,int NumberOfPhase,int Channel,uint32_t FifoSize):bufferdma(FifoSize)
+{
+	this->SampleRate=SampleRate;
+	NumbPhase=NumberOfPhase;
+	Stream=&Sink;
+	Sink.Setup("phasedmasync",SampleRate);
+	SetCenterFrequency(TuneFrequency,SampleRate);
+}
+
+void phasedmasync::SetPhase(uint32_t Index,int Phase)
+{
+	Sink.Sample('P',Phase%NumbPhase);
+}
+
+void phasedmasync::SetPhaseSamples(int *sample,size_t Size)
+{
+	for(size_t i=0;i<Size;i++)
+	{
+		Pace();
+		Sink.Sample('P',sample[i]%NumbPhase);
+	}
+}
+
+fskburst::fskburst(uint64_t TuneFrequency,float SymbolRate,float Deviation,int Channel,uint32_t FifoSize,size_t upsample,float RatioRamp):bufferdma(FifoSize)
+{
+	this->SymbolRate=SymbolRate;
+	FreqDeviation=Deviation;
+	Upsample=upsample;
+	Stream=&Sink;
+	Sink.Setup("fskburst",SymbolRate);
+	SetCenterFrequency(TuneFrequency,(int)Deviation);
+}
+
+void fskburst::SetSymbols(unsigned char *Symbols,uint32_t Size)
+{
+	for(uint32_t i=0;i<Size;i++)
+	{
+		Pace();
+		Sink.Sample('S',Symbols[i]);
+	}
+}
+
+ookburst::ookburst(uint64_t TuneFrequency,float SymbolRate,int Channel,uint32_t FifoSize,size_t upsample,float RatioRamp):bufferdma(FifoSize)
+{
+	this->SymbolRate=SymbolRate;
+	Upsample=upsample;
+	Stream=&Sink;
+	Sink.Setup("ookburst",SymbolRate);
+	SetCenterFrequency(TuneFrequency,(int)SymbolRate);
+}
+
+void ookburst::SetSymbols(unsigned char *Symbols,uint32_t Size)
+{
+	for(uint32_t i=0;i<Size;i++)
+	{
+		Pace();
+		Sink.Sample('S',Symbols[i]);
+	}
+}
+
+// Time base of 1 us, each element lasts its duration
+ookbursttiming::ookbursttiming(uint64_t TuneFrequency,size_t MaxMessageDuration):ookburst(TuneFrequency,1e6,14,MaxMessageDuration)
+{
+	Sink.Setup("ookbursttiming",1e6);
+}
+
+void ookbursttiming::SendMessage(SampleOOKTiming *TabElementOOK,size_t Size)
+{
+	size_t Duration=0;
+	for(size_t i=0;i<Size;i++)
+	{
+		Sink.Sample('O',TabElementOOK[i].value,TabElementOOK[i].duration);
+		if(TabElementOOK[i].duration>1) Sink.Skip(TabElementOOK[i].duration-1);
+		Duration+=TabElementOOK[i].duration;
+	}
+	if(Realtime) usleep(Duration);
+}
@@ -0,0 +1,302 @@
+/*
+    audio_proc.c: wideband AGC, multiband compressor and look-ahead limiter
+    of fm_mpx.c, see audio_proc.h
+*/
+
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "audio_proc.h"
+
+#define PI 3.14159265359
+
+// Crossover frequencies for each band count
+static const float crossovers[AUDIO_PROC_MAX_BANDS+1][AUDIO_PROC_MAX_BANDS-1] = {
+    {0}, {0}, {800}, {200, 3000}, {150, 800, 4000}, {100, 400, 2000, 6000},
+};
+
+#define AGC_TARGET_DB   -18.0f
+#define AGC_RANGE_DB    12.0f
+#define AGC_GATE_DB     -50.0f  // quieter than this (pauses, fades) the AGC holds its gain
+#define AGC_DOWN_S      1.0f
+#define AGC_UP_S        5.0f
+
+#define COMP_THRESHOLD_DB -24.0f
+#define COMP_RATIO      3.0f
+#define COMP_MAKEUP_DB  18.0f  // drives the sum into the limiter
+
+#define LIMITER_RELEASE_S 0.05f
+
+// Keeps filter states away from denormals in silence, they are very slow on the VFP
+#define ANTI_DENORMAL   1e-18f
+
+#define DB_PER_OCTAVE   6.0206f // 20*log10(2) : dB = DB_PER_OCTAVE * log2(linear)
+
+static float subblock_coef(int rate, float seconds) {
+    return 1 - expf(-AUDIO_PROC_SUBBLOCK / (rate * seconds));
+}
+
+// RBJ cookbook biquads, Q = 1/sqrt(2) : Butterworth low/high pass, and the allpass which is
+// the sum of the LR4 low and high pass of the same frequency
+enum { BIQUAD_LP, BIQUAD_HP, BIQUAD_AP };
+
+static void biquad_coefs(int type, float freq, int rate, float *c) {
+    double w0 = 2*PI*freq/rate;
+    double alpha = sin(w0)/(2/sqrt(2.));
+    double cw = cos(w0);
+    double a0 = 1 + alpha;
+    double b0, b1, b2;
+    if(type == BIQUAD_LP) {
+        b0 = (1 - cw)/2; b1 = 1 - cw; b2 = b0;
+    } else if(type == BIQUAD_HP) {
+        b0 = (1 + cw)/2; b1 = -(1 + cw); b2 = b0;
+    } else {
+        b0 = 1 - alpha; b1 = -2*cw; b2 = 1 + alpha;
+    }
+    c[0] = b0/a0; c[1] = b1/a0; c[2] = b2/a0;
+    c[3] = -2*cw/a0; c[4] = (1 - alpha)/a0;
+}
+
+// Lanes 0,1 get type01, lanes 2,3 type23 (-1 : pass through)
+static void biquad4_init(biquad4 *f, int type01, int type23, float freq, int rate) {
+    float c[2][5] = {{1, 0, 0, 0, 0}, {1, 0, 0, 0, 0}};
+    if(type01 >= 0) biquad_coefs(type01, freq, rate, c[0]);
+    if(type23 >= 0) biquad_coefs(type23, freq, rate, c[1]);
+    for(int lane=0; lane<4; lane++) {
+        float *k = c[lane/2];
+        f->b0[lane] = k[0]; f->b1[lane] = k[1]; f->b2[lane] = k[2];
+        f->a1[lane] = k[3]; f->a2[lane] = k[4];
+        f->z1[lane] = 0; f->z2[lane] = 0;
+    }
+}
+
+// The state lives in registers for the whole block, the 4 lanes are independent recursions
+static void biquad4_block(biquad4 *f, v4sf *x, int n) {
+    v4sf b0 = f->b0, b1 = f->b1, b2 = f->b2, a1 = f->a1, a2 = f->a2;
+    v4sf z1 = f->z1, z2 = f->z2;
+    for(int t=0; t<n; t++) {
+        v4sf in = x[t] + ANTI_DENORMAL;
+        v4sf y = b0*in + z1;
+        z1 = b1*in - a1*y + z2;
+        z2 = b2*in - a2*y;
+        x[t] = y;
+    }
+    f->z1 = z1;
+    f->z2 = z2;
+}
+
+void audio_proc_init(audio_proc *p, int rate, int channels, double preemphasis, int bands, float lookahead_ms) {
+    memset(p, 0, sizeof(*p));
+    p->rate = rate;
+    p->channels = channels;
+    if(bands > AUDIO_PROC_MAX_BANDS) bands = AUDIO_PROC_MAX_BANDS;
+    p->bands = bands > 0 ? bands : 0;
+    p->preemphasis_k = preemphasis * rate;
+
+    p->agc_gain = 1;
+    p->agc_down = subblock_coef(rate, AGC_DOWN_S);
+    p->agc_up = subblock_coef(rate, AGC_UP_S);
+
+    for(int j=0; j<p->bands-1; j++) {
+        float freq = crossovers[p->bands][j];
+        if(freq > 0.45f*rate) freq = 0.45f*rate;
+        biquad4_init(&p->split[j][0], BIQUAD_LP, BIQUAD_HP, freq, rate);
+        biquad4_init(&p->split[j][1], BIQUAD_LP, BIQUAD_HP, freq, rate);
+        for(int a=0; a<j; a+=2) biquad4_init(&p->allpass[j][a/2], BIQUAD_AP, a+1 < j ? BIQUAD_AP : -1, freq, rate);
+    }
+    // Low bands react slower than the high ones
+    for(int k=0; k<p->bands; k++) {
+        float pos = p->bands > 1 ? (float)k/(p->bands-1) : 0.5f;
+        band_compressor *c = &p->comp[k];
+        c->threshold = COMP_THRESHOLD_DB;
+        c->ratio = COMP_RATIO;
+        c->makeup = COMP_MAKEUP_DB;
+        c->attack = subblock_coef(rate, 0.020f * powf(0.2f, pos));
+        c->release = subblock_coef(rate, 0.400f * powf(0.4f, pos));
+        c->env = 0;
+        c->gain = powf(10, c->makeup/20);
+    }
+
+    p->lookahead_ms = lookahead_ms;
+    p->lookahead = lookahead_ms * rate / 1000;
+    if(p->lookahead >= AUDIO_PROC_LOOKAHEAD_MAX) {
+        p->lookahead = AUDIO_PROC_LOOKAHEAD_MAX-1;
+        printf("Warning: at %d Hz the limiter look-ahead is limited to %.2f ms.\n", rate, p->lookahead * 1000.0 / rate);
+    }
+    if(p->lookahead < 0) p->lookahead = 0;
+    for(int i=0; i<p->lookahead; i++) p->lim_min[i] = 1;
+    p->lim_sum = p->lookahead;
+    p->lim_gain = 1;
+    p->lim_release = 1 - expf(-1 / (rate * LIMITER_RELEASE_S));
+}
+
+// Slow wideband gain towards AGC_TARGET_DB RMS, applied in place on interleaved L,R
+static void agc(audio_proc *p, float *x, int n) {
+    for(int s=0; s<n; s+=AUDIO_PROC_SUBBLOCK) {
+        int len = n-s < AUDIO_PROC_SUBBLOCK ? n-s : AUDIO_PROC_SUBBLOCK;
+        float power = 0;
+        for(int t=s; t<s+len; t++) power += x[2*t]*x[2*t] + x[2*t+1]*x[2*t+1];
+        power /= 2*len;
+        float level_db = DB_PER_OCTAVE/2 * log2f(power + 1e-20f);
+        if(level_db > AGC_GATE_DB) {
+            float wanted = AGC_TARGET_DB - level_db;
+            if(wanted > AGC_RANGE_DB) wanted = AGC_RANGE_DB;
+            if(wanted < -AGC_RANGE_DB) wanted = -AGC_RANGE_DB;
+            p->agc_gain_db += (wanted - p->agc_gain_db) * (wanted < p->agc_gain_db ? p->agc_down : p->agc_up);
+        }
+        float gain = exp2f(p->agc_gain_db / DB_PER_OCTAVE);
+        float step = (gain - p->agc_gain) / len;
+        float g = p->agc_gain;
+        for(int t=s; t<s+len; t++) {
+            g += step;
+            x[2*t] *= g;
+            x[2*t+1] *= g;
+        }
+        p->agc_gain = gain;
+    }
+}
+
+// Splits x (interleaved L,R) into p->band, lowest band first
+static void split_bands(audio_proc *p, const float *x, int n) {
+    v4sf buf[AUDIO_PROC_BLOCK];
+    float *rest = p->band[p->bands-1];
+    memcpy(rest, x, 2*n*sizeof(float));
+    for(int j=0; j<p->bands-1; j++) {
+        for(int t=0; t<n; t++) buf[t] = (v4sf){rest[2*t], rest[2*t+1], rest[2*t], rest[2*t+1]};
+        biquad4_block(&p->split[j][0], buf, n);
+        biquad4_block(&p->split[j][1], buf, n);
+        float *low = p->band[j];
+        for(int t=0; t<n; t++) {
+            low[2*t] = buf[t][0];
+            low[2*t+1] = buf[t][1];
+            rest[2*t] = buf[t][2];
+            rest[2*t+1] = buf[t][3];
+        }
+        // The bands already split off get the phase of this crossover
+        for(int a=0; a<j; a+=2) {
+            float *b0 = p->band[a];
+            float *b1 = a+1 < j ? p->band[a+1] : NULL;
+            for(int t=0; t<n; t++) buf[t] = (v4sf){b0[2*t], b0[2*t+1], b1 ? b1[2*t] : 0, b1 ? b1[2*t+1] : 0};
+            biquad4_block(&p->allpass[j][a/2], buf, n);
+            for(int t=0; t<n; t++) {
+                b0[2*t] = buf[t][0];
+                b0[2*t+1] = buf[t][1];
+                if(b1) {
+                    b1[2*t] = buf[t][2];
+                    b1[2*t+1] = buf[t][3];
+                }
+            }
+        }
+    }
+}
+
+// Compresses every band (L,R linked) and sums them into out
+static void compress_bands(audio_proc *p, float *out, int n) {
+    memset(out, 0, 2*n*sizeof(float));
+    for(int k=0; k<p->bands; k++) {
+        band_compressor *c = &p->comp[k];
+        const float *x = p->band[k];
+        float slope = 1 - 1/c->ratio;
+        for(int s=0; s<n; s+=AUDIO_PROC_SUBBLOCK) {
+            int len = n-s < AUDIO_PROC_SUBBLOCK ? n-s : AUDIO_PROC_SUBBLOCK;
+            float peak = 0;
+            for(int t=2*s; t<2*(s+len); t++) {
+                float a = fabsf(x[t]);
+                if(a > peak) peak = a;
+            }
+            c->env += (peak - c->env) * (peak > c->env ? c->attack : c->release);
+            float over = DB_PER_OCTAVE * log2f(c->env + 1e-20f) - c->threshold;
+            float gain = exp2f((c->makeup - (over > 0 ? over*slope : 0)) / DB_PER_OCTAVE);
+            float step = (gain - c->gain) / len;
+            float g = c->gain;
+            for(int t=s; t<s+len; t++) {
+                g += step;
+                out[2*t] += x[2*t] * g;
+                out[2*t+1] += x[2*t+1] * g;
+            }
+            c->gain = gain;
+        }
+    }
+}
+
+/*
+ * Peak limiter with look-ahead : the gain needed by each frame is known lookahead frames
+ * before it leaves, a sliding minimum over lookahead+1 frames followed by a box filter of
+ * lookahead frames ramps the gain down in time, without overshoot.
+ * The detector sees the signal pre-emphasized like the FIR will do, so the limit holds on
+ * what is actually transmitted (up to the FIR's own overshoot, the hard limiter takes that).
+ */
+static void lookahead_limiter(audio_proc *p, float *x, int n, float threshold) {
+    int la = p->lookahead;
+    float k = p->preemphasis_k;
+    float min_gain = 1;
+    const unsigned mask = AUDIO_PROC_LOOKAHEAD_MAX-1;
+    // Renormalize the running sum once per block, float errors would add up
+    p->lim_sum = 0;
+    for(int i=0; i<la; i++) p->lim_sum += p->lim_min[i];
+
+    for(int t=0; t<n; t++) {
+        float l = x[2*t], r = x[2*t+1];
+        float pl = fabsf(l + k*(l - p->prev_left));
+        float pr = fabsf(r + k*(r - p->prev_right));
+        p->prev_left = l;
+        p->prev_right = r;
+        float peak = pl > pr ? pl : pr;
+        float needed = peak > threshold ? threshold/peak : 1;
+
+        // Sliding minimum : monotonic queue of the window
+        unsigned now = p->lim_count;
+        while(p->lim_dq_len && p->lim_dq_value[(p->lim_dq_head + p->lim_dq_len - 1) & mask] >= needed) p->lim_dq_len--;
+        p->lim_dq_index[(p->lim_dq_head + p->lim_dq_len) & mask] = now;
+        p->lim_dq_value[(p->lim_dq_head + p->lim_dq_len) & mask] = needed;
+        p->lim_dq_len++;
+        while(now - p->lim_dq_index[p->lim_dq_head] > (unsigned)la) {
+            p->lim_dq_head = (p->lim_dq_head + 1) & mask;
+            p->lim_dq_len--;
+        }
+        float window_min = p->lim_dq_value[p->lim_dq_head];
+
+        p->lim_sum += window_min - p->lim_min[p->lim_box_pos];
+        p->lim_min[p->lim_box_pos] = window_min;
+        if(++p->lim_box_pos == la) p->lim_box_pos = 0;
+        float box = p->lim_sum / la;
+
+        if(box < p->lim_gain) p->lim_gain = box;
+        else p->lim_gain += (box - p->lim_gain) * p->lim_release;
+        if(p->lim_gain < min_gain) min_gain = p->lim_gain;
+
+        // Frame now-(la-1) is the one the box filter protects
+        p->lim_delay[2*(now & mask)] = l;
+        p->lim_delay[2*(now & mask)+1] = r;
+        unsigned out = (now - (la-1)) & mask;
+        x[2*t] = p->lim_delay[2*out] * p->lim_gain;
+        x[2*t+1] = p->lim_delay[2*out+1] * p->lim_gain;
+        p->lim_count++;
+    }
+    p->gain_reduction_db = -DB_PER_OCTAVE * log2f(min_gain);
+}
+
+void audio_proc_process(audio_proc *p, float *frames, int count, float limiter_threshold) {
+    float x[2*AUDIO_PROC_BLOCK] __attribute__((aligned(16)));
+    int ch = p->channels;
+    for(int start=0; start<count; start+=AUDIO_PROC_BLOCK) {
+        int n = count-start < AUDIO_PROC_BLOCK ? count-start : AUDIO_PROC_BLOCK;
+        float *f = frames + start*ch;
+        // Mono runs as L=R, more than 2 channels only the first two are transmitted
+        for(int t=0; t<n; t++) {
+            x[2*t] = f[t*ch];
+            x[2*t+1] = ch > 1 ? f[t*ch+1] : f[t*ch];
+        }
+        if(p->bands > 0) {
+            agc(p, x, n);
+            split_bands(p, x, n);
+            compress_bands(p, x, n);
+        }
+        if(p->lookahead > 0) lookahead_limiter(p, x, n, limiter_threshold);
+        for(int t=0; t<n; t++) {
+            f[t*ch] = x[2*t];
+            if(ch > 1) f[t*ch+1] = x[2*t+1];
+        }
+    }
+}
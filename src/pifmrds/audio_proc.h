@@ -0,0 +1,75 @@
+/*
+    audio_proc.h: broadcast audio processor of fm_mpx.c
+
+    Runs on the decoded PCM at the input rate, before the upsampling FIR :
+      wideband AGC -> 1 to 5 band compressor -> look-ahead peak limiter
+    The bands come from a tree of Linkwitz-Riley 4th order crossovers with
+    allpass compensation, so with the compressors idle the bands add up flat.
+    Filters run a whole block at a time on 4 lanes (GCC vector extensions :
+    low L,R and high L,R of a crossover, or L,R of two bands for the allpasses),
+    NEON or SSE where available, else 4 independent recursions for the VFP.
+*/
+
+#ifndef AUDIO_PROC_H
+#define AUDIO_PROC_H
+
+#define AUDIO_PROC_MAX_BANDS 5
+#define AUDIO_PROC_BLOCK 256        // frames filtered per pass
+#define AUDIO_PROC_SUBBLOCK 16      // frames per gain computation, gains are interpolated in between
+#define AUDIO_PROC_LOOKAHEAD_MAX 512 // frames, power of 2 : 2.5 ms up to 204.8 kHz
+
+typedef float v4sf __attribute__((vector_size(16)));
+
+// Transposed direct form II, independent coefficients and state per lane
+typedef struct {
+    v4sf b0, b1, b2, a1, a2;
+    v4sf z1, z2;
+} biquad4;
+
+typedef struct {
+    float threshold;    // dBFS
+    float ratio;
+    float makeup;       // dB
+    float attack;       // envelope coefficients per subblock
+    float release;
+    float env;
+    float gain;         // linear, at the end of the last subblock
+} band_compressor;
+
+typedef struct {
+    int rate;
+    int channels;
+    int bands;          // 0 : processor off
+    float preemphasis_k; // tau*rate, limiter detector only
+
+    // Wideband AGC, slowly rides the input level towards its target
+    float agc_gain_db;
+    float agc_gain;
+    float agc_down, agc_up;
+
+    biquad4 split[AUDIO_PROC_MAX_BANDS-1][2];                   // LR4 = 2 Butterworth biquads, lanes LP,LP,HP,HP
+    biquad4 allpass[AUDIO_PROC_MAX_BANDS-1][AUDIO_PROC_MAX_BANDS/2]; // bands below crossover j, two per biquad
+    band_compressor comp[AUDIO_PROC_MAX_BANDS];
+    float band[AUDIO_PROC_MAX_BANDS][2*AUDIO_PROC_BLOCK] __attribute__((aligned(16)));
+
+    // Look-ahead limiter : sliding minimum of the needed gain, then a box filter as long as the window
+    float lookahead_ms;
+    int lookahead;      // frames, 0 : off
+    unsigned lim_count; // frames through the limiter, wraps
+    float lim_delay[2*AUDIO_PROC_LOOKAHEAD_MAX];
+    float lim_min[AUDIO_PROC_LOOKAHEAD_MAX];
+    int lim_box_pos;
+    float lim_sum;
+    unsigned lim_dq_index[AUDIO_PROC_LOOKAHEAD_MAX]; // increasing minimums of the window, oldest first
+    float lim_dq_value[AUDIO_PROC_LOOKAHEAD_MAX];
+    int lim_dq_head, lim_dq_len;
+    float lim_gain, lim_release;
+    float prev_left, prev_right;
+    float gain_reduction_db; // limiter, largest of the last block
+} audio_proc;
+
+void audio_proc_init(audio_proc *p, int rate, int channels, double preemphasis, int bands, float lookahead_ms);
+// frames : count interleaved frames of p->channels samples, processed in place
+void audio_proc_process(audio_proc *p, float *frames, int count, float limiter_threshold);
+
+#endif
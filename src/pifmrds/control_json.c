@@ -0,0 +1,187 @@
+/*
+    JSON requests on the pifmrds control socket.
+
+    One request per line, a flat object :
+      {"cmd":"set", "ps":"MyRadio", "rt":"Now playing ...", "pty":10, "id":12}
+      {"cmd":"status", "id":13}
+    A set request is all or nothing : every key is checked first, then the whole
+    batch is queued at once and applied together at the next RDS group.
+    Keys map to the line commands of control_pipe.c, see json_keys below ; pi and ecc
+    are hex strings as on the pipe, switches take true/false.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#include "control_pipe.h"
+
+static const struct {
+    const char *key;
+    const char *command;
+    int is_bool;        // true/false sent as ON/OFF
+} json_keys[] = {
+    {"ps", "PS", 0}, {"rt", "RT", 0}, {"rtb", "RTB", 0}, {"pi", "PI", 0},
+    {"ta", "TA", 1}, {"tp", "TP", 1}, {"ms", "MS", 1}, {"ab", "AB", 1},
+    {"ct", "CT", 1}, {"di", "DI", 0}, {"pty", "PTY", 0}, {"ptyn", "PTN", 0},
+    {"rtplus", "RTP", 0}, {"ecc", "ECC", 0}, {"power", "PWR", 0}, {"rds", "RDS", 1},
+    {"deviation", "DEV", 0}, {"gain", "GAI", 0}, {"stereo", "STR", 1},
+    {"compressor", "COM", 1}, {"compressor_decay", "COD", 0}, {"compressor_attack", "COA", 0},
+    {"compressor_max_gain_recip", "CMG", 0}, {"limiter", "LIM", 0}, {"rds_volume", "RDV", 0},
+    {"pause", "PAU", 1}, {"mpx", "MPX", 1},
+};
+
+#define JSON_MAX_KEYS 32
+#define JSON_VALUE_SIZE 128
+
+static const char *skip_ws(const char *p) {
+    while(isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+// Parses a string at p (on the opening quote) into out, returns the position after it or NULL
+static const char *parse_string(const char *p, char *out, int size) {
+    int len = 0;
+    if(*p++ != '"') return NULL;
+    while(*p && *p != '"') {
+        char c = *p++;
+        if(c == '\\') {
+            c = *p++;
+            switch(c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u': { // Latin-1 range only, the RDS character set has no use for more
+                    char hex[5] = {0};
+                    for(int i=0; i<4; i++) {
+                        if(!isxdigit((unsigned char)p[i])) return NULL;
+                        hex[i] = p[i];
+                    }
+                    long code = strtol(hex, NULL, 16);
+                    c = code < 256 ? (char)code : '?';
+                    p += 4;
+                    break;
+                }
+                case 0: return NULL;
+                default: break; // \" \\ \/
+            }
+        }
+        if(len < size-1) out[len++] = c;
+    }
+    if(*p != '"') return NULL;
+    out[len] = 0;
+    return p+1;
+}
+
+// Parses a value into out as text : strings unquoted, numbers and literals as written
+static const char *parse_value(const char *p, char *out, int size, int *is_string) {
+    *is_string = 0;
+    if(*p == '"') {
+        *is_string = 1;
+        return parse_string(p, out, size);
+    }
+    if(strncmp(p, "true", 4) == 0) { snprintf(out, size, "true"); return p+4; }
+    if(strncmp(p, "false", 5) == 0) { snprintf(out, size, "false"); return p+5; }
+    if(strncmp(p, "null", 4) == 0) { snprintf(out, size, "null"); return p+4; }
+    char *end;
+    strtod(p, &end);
+    if(end == p || end-p >= size) return NULL;
+    memcpy(out, p, end-p);
+    out[end-p] = 0;
+    return end;
+}
+
+static void json_escape(const char *in, char *out, int size) {
+    int len = 0;
+    for(; *in && len < size-7; in++) {
+        unsigned char c = *in;
+        if(c == '"' || c == '\\') { out[len++] = '\\'; out[len++] = c; }
+        else if(c < 0x20) len += snprintf(out+len, size-len, "\\u%04x", c);
+        else out[len++] = c;
+    }
+    out[len] = 0;
+}
+
+/*
+ * Handles one JSON request line. Commands of a set request are stored in commands
+ * (the first one carrying the batch size) and their number returned; the response
+ * line is written to response. Returns -1 if the batch needs more than max commands,
+ * the request is then left for later.
+ */
+int control_json_request(char *line, ResultAndArg *commands, int max, char *response, int size, control_status_fn status, int log) {
+    char keys[JSON_MAX_KEYS][32];
+    char values[JSON_MAX_KEYS][JSON_VALUE_SIZE];
+    int strings[JSON_MAX_KEYS];
+    int n = 0;
+    char id[JSON_VALUE_SIZE + 8] = "";
+    char cmd[16] = "";
+    char error[160] = "";
+
+    // Flat object parsing
+    const char *p = skip_ws(line);
+    if(*p++ != '{') snprintf(error, sizeof(error), "not a JSON object");
+    p = skip_ws(p);
+    while(!error[0] && *p != '}') {
+        if(n == JSON_MAX_KEYS) { snprintf(error, sizeof(error), "too many keys"); break; }
+        p = parse_string(p, keys[n], sizeof(keys[n]));
+        if(p) p = skip_ws(p);
+        if(!p || *p++ != ':') { snprintf(error, sizeof(error), "bad key"); break; }
+        p = parse_value(skip_ws(p), values[n], JSON_VALUE_SIZE, &strings[n]);
+        if(!p) { snprintf(error, sizeof(error), "bad value for \"%.32s\"", keys[n]); break; }
+        p = skip_ws(p);
+        if(strcmp(keys[n], "id") == 0) {
+            char escaped[JSON_VALUE_SIZE];
+            json_escape(values[n], escaped, sizeof(escaped));
+            snprintf(id, sizeof(id), strings[n] ? ",\"id\":\"%s\"" : ",\"id\":%s", escaped);
+        } else if(strcmp(keys[n], "cmd") == 0) {
+            snprintf(cmd, sizeof(cmd), "%s", values[n]);
+        } else {
+            n++;
+        }
+        if(*p == ',') p = skip_ws(p+1);
+        else if(*p != '}') snprintf(error, sizeof(error), "expected , or }");
+    }
+
+    int count = 0;
+    if(!error[0] && strcmp(cmd, "status") == 0) {
+        char body[1024] = "{}";
+        if(status) status(body, sizeof(body));
+        snprintf(response, size, "{\"ok\":true%s,\"status\":%s}\n", id, body);
+        return 0;
+    } else if(!error[0] && strcmp(cmd, "set") != 0) {
+        snprintf(error, sizeof(error), "cmd must be \"set\" or \"status\"");
+    }
+
+    // Map every key to its line command, nothing is queued unless all are valid
+    for(int k=0; k<n && !error[0]; k++) {
+        int found = -1;
+        for(unsigned j=0; j<sizeof(json_keys)/sizeof(json_keys[0]); j++) {
+            if(strcmp(keys[k], json_keys[j].key) == 0) found = j;
+        }
+        if(found < 0) { snprintf(error, sizeof(error), "unknown key \"%.32s\"", keys[k]); break; }
+        const char *value = values[k];
+        if(json_keys[found].is_bool) {
+            if(strcmp(value, "true") == 0) value = "ON";
+            else if(strcmp(value, "false") == 0) value = "OFF";
+        }
+        if(count == max) return -1;
+        char text[JSON_VALUE_SIZE + 8];
+        snprintf(text, sizeof(text), "%s %s\n", json_keys[found].command, value);
+        commands[count] = parse_control_line(text, log);
+        if(commands[count].res < 0) { snprintf(error, sizeof(error), "invalid value for \"%.32s\"", keys[k]); break; }
+        commands[count].batch = 0;
+        count++;
+    }
+    if(error[0]) {
+        char escaped[sizeof(error)+32];
+        json_escape(error, escaped, sizeof(escaped));
+        snprintf(response, size, "{\"ok\":false%s,\"error\":\"%s\"}\n", id, escaped);
+        return 0;
+    }
+    if(count) commands[0].batch = count;
+    snprintf(response, size, "{\"ok\":true%s,\"queued\":%d}\n", id, count);
+    return count;
+}
@@ -5,80 +5,216 @@
     See https://github.com/Miegl/PiFmAdv
 */
 
+#define _GNU_SOURCE // accept4
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "rds.h"
 #include "control_pipe.h"
 
-#define CTL_BUFFER_SIZE 70
+#define CTL_BUFFER_SIZE 2048 // Room for a JSON batch
+#define CTL_MAX_SOURCES 16
 
-int fd;
-FILE *f_ctl;
+/* Every control input (the FIFO, the socket, its clients) is watched by one
+ * epoll set. Input is split in lines per source, so commands arriving together
+ * are all parsed and a line is never cut by the buffer size.
+ * Lines starting with { are JSON requests (control_json.c), answered on socket clients.
+ */
+typedef struct {
+	int fd;
+	int listening;
+	int client;
+	int len;
+	char buf[CTL_BUFFER_SIZE];
+} control_source;
+
+int epfd = -1;
+control_source sources[CTL_MAX_SOURCES];
+char *socket_path = NULL;
+control_status_fn status_fn = NULL;
+
+void set_control_status(control_status_fn status) {
+	status_fn = status;
+}
+
+static int add_source(int fd, int listening, int client) {
+	if(epfd < 0) {
+		epfd = epoll_create1(0);
+		if(epfd < 0) return -1;
+		for(int i=0; i<CTL_MAX_SOURCES; i++) sources[i].fd = -1;
+	}
+	for(int i=0; i<CTL_MAX_SOURCES; i++) {
+		if(sources[i].fd >= 0) continue;
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = &sources[i];
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) return -1;
+		sources[i].fd = fd;
+		sources[i].listening = listening;
+		sources[i].client = client;
+		sources[i].len = 0;
+		return 0;
+	}
+	return -1;
+}
+
+static void remove_source(control_source *src) {
+	epoll_ctl(epfd, EPOLL_CTL_DEL, src->fd, NULL);
+	close(src->fd);
+	src->fd = -1;
+}
 
 /*
  * Opens a file (pipe) to be used to control the RDS coder, in non-blocking mode.
  */
 int open_control_pipe(char *filename)
 {
-	fd = open(filename, O_RDWR | O_NONBLOCK);
+	int fd = open(filename, O_RDWR | O_NONBLOCK); // Read-write : no hang up when a writer goes away
 	if(fd == -1) return -1;
+	if(add_source(fd, 0, 0) < 0) {
+		close(fd);
+		return -1;
+	}
+	return 0;
+}
 
-	int flags;
-	flags = fcntl(fd, F_GETFL, 0);
-	flags |= O_NONBLOCK;
-	if( fcntl(fd, F_SETFL, flags) == -1 ) return -1;
+/*
+ * Listens on a Unix stream socket, each connected client sends the same line commands as the pipe
+ * or JSON requests.
+ */
+int open_control_socket(char *path)
+{
+	struct sockaddr_un addr;
+	if(strlen(path) >= sizeof(addr.sun_path)) return -1;
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if(fd == -1) return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0 || add_source(fd, 1, 0) < 0) {
+		close(fd);
+		return -1;
+	}
+	socket_path = path;
+	return 0;
+}
 
-	f_ctl = fdopen(fd, "r");
-	if(f_ctl == NULL) return -1;
+ResultAndArg parse_control_line(char *fifo, int log);
 
-	return 0;
+/*
+ * Parses the complete lines buffered for a source, keeps the unfinished one.
+ * A JSON batch is only taken if all its commands fit in max, else it waits for the next call.
+ */
+static int split_lines(control_source *src, ResultAndArg *commands, int max, int log) {
+	int count = 0;
+	int start = 0;
+	for(int i=0; i<src->len && count<max; i++) {
+		// A line filling the whole buffer is taken as is
+		if(src->buf[i] != '\n' && !(start == 0 && i == CTL_BUFFER_SIZE-1)) continue;
+		char line[CTL_BUFFER_SIZE+1];
+		memcpy(line, src->buf+start, i+1-start);
+		line[i+1-start] = 0;
+		if(line[0] == '{') {
+			char response[1280];
+			int n = control_json_request(line, commands+count, max-count, response, sizeof(response), status_fn, log);
+			if(n < 0 && count > 0) break;
+			if(n < 0) {
+				snprintf(response, sizeof(response), "{\"ok\":false,\"error\":\"batch too large\"}\n");
+				n = 0;
+			}
+			// Replies never block : a client that does not read them loses them
+			if(src->client && send(src->fd, response, strlen(response), MSG_NOSIGNAL) < 0 && log==1) printf("Control reply lost\n");
+			count += n;
+			start = i+1;
+			continue;
+		}
+		start = i+1;
+		ResultAndArg cmd = parse_control_line(line, log);
+		if(cmd.res >= 0) commands[count++] = cmd;
+	}
+	memmove(src->buf, src->buf+start, src->len-start);
+	src->len -= start;
+	return count;
 }
 
 /*
- * Polls the control file (pipe), non-blockingly, and if a command is received,
- * processes it and updates the RDS data.
+ * Waits up to timeout_ms for control input, then parses every complete line received.
+ * Returns the number of commands stored in commands (at most max, the other lines
+ * stay buffered for the next call).
  */
-ResultAndArg poll_control_pipe(int log) {
-	ResultAndArg resarg;
-	static char buf[CTL_BUFFER_SIZE];
+int wait_control_commands(ResultAndArg *commands, int max, int timeout_ms, int log) {
+	int count = 0;
+	struct epoll_event events[CTL_MAX_SOURCES];
 
-	char *fifo = fgets(buf, CTL_BUFFER_SIZE, f_ctl);
+	// Lines left over by a previous call first
+	for(int i=0; i<CTL_MAX_SOURCES && count<max; i++) {
+		if(sources[i].fd >= 0 && !sources[i].listening) count += split_lines(&sources[i], commands+count, max-count, log);
+	}
+	if(count == max || epfd < 0) return count;
 
-	if(fifo == NULL) {
-		resarg.res = -1;
-		return resarg;
+	int n = epoll_wait(epfd, events, CTL_MAX_SOURCES, count ? 0 : timeout_ms);
+	for(int e=0; e<n; e++) {
+		control_source *src = (control_source *)events[e].data.ptr;
+		if(src->listening) {
+			int client = accept4(src->fd, NULL, NULL, SOCK_NONBLOCK);
+			if(client >= 0 && add_source(client, 0, 1) < 0) close(client);
+			continue;
+		}
+		// A full buffer still holds a batch waiting for room, the fd stays ready (level-triggered)
+		int room = CTL_BUFFER_SIZE - src->len;
+		int len = room ? read(src->fd, src->buf + src->len, room) : 0;
+		if((len == 0 && room) || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+			remove_source(src); // Client went away
+			continue;
+		}
+		if(len > 0) src->len += len;
+		if(count < max) count += split_lines(src, commands+count, max-count, log);
 	}
+	return count;
+}
+
+/*
+ * Parses one command line. The RDS commands are only applied by apply_rds_command,
+ * so they can be handed to the thread that owns the RDS encoder.
+ */
+ResultAndArg parse_control_line(char *fifo, int log) {
+	ResultAndArg resarg;
+	resarg.res = -1;
+	resarg.arg[0] = 0;
+	resarg.arg_int = 0;
+	resarg.batch = 1;
+	char *argp = NULL;
 
 	if(strlen(fifo) > 3 && fifo[2] == ' ') {
 		char *arg = fifo+3;
-		resarg.arg = fifo+3;
 		if(arg[strlen(arg)-1] == '\n') arg[strlen(arg)-1] = 0;
+		argp = arg;
 		if(fifo[0] == 'P' && fifo[1] == 'S') {
 			arg[8] = 0;
-			set_rds_ps(arg);
 			if(log==1) printf("PS set to: \"%s\"\n", arg);
 			resarg.res =  CONTROL_PIPE_PS_SET;
 		}
 		else if(fifo[0] == 'R' && fifo[1] == 'T') {
 			arg[64] = 0;
-			set_rds_ab(0);
-			set_rds_rt(arg);
+			resarg.arg_int = 0; // A/B flag
 			if(log==1) printf("RT A set to: \"%s\"\n", arg);
 			resarg.res = CONTROL_PIPE_RT_SET;
 		}
         else if(fifo[0] == 'P' && fifo[1] == 'I') {
 			arg[4] = 0;
-			set_rds_pi((uint16_t) strtol(arg, NULL, 16));
 			if(log==1) printf("PI set to: \"%s\"\n", arg);
 			resarg.res = CONTROL_PIPE_PI_SET;
 		}
 		else if(fifo[0] == 'T' && fifo[1] == 'A') {
 			int ta = ( strcmp(arg, "ON") == 0 );
-			set_rds_ta(ta);
+			resarg.arg_int = ta;
 			if(log==1) {
 				printf("Set TA to ");
 				if(ta) printf("ON\n"); else printf("OFF\n");
@@ -87,7 +223,7 @@ ResultAndArg poll_control_pipe(int log) {
 		}
 		else if(fifo[0] == 'T' && fifo[1] == 'P') {
 			int tp = ( strcmp(arg, "ON") == 0 );
-			set_rds_tp(tp);
+			resarg.arg_int = tp;
 			if(log==1) {
 				printf("Set TP to ");
 				if(tp) printf("ON\n"); else printf("OFF\n");
@@ -96,7 +232,7 @@ ResultAndArg poll_control_pipe(int log) {
 		}
 		else if(fifo[0] == 'M' && fifo[1] == 'S') {
 			int ms = ( strcmp(arg, "ON") == 0 );
-			set_rds_ms(ms);
+			resarg.arg_int = ms;
 			if(log==1) {
 				printf("Set MS to ");
 				if(ms) printf("ON\n"); else printf("OFF\n");
@@ -105,7 +241,7 @@ ResultAndArg poll_control_pipe(int log) {
 		}
 		else if(fifo[0] == 'A' && fifo[1] == 'B') {
 			int ab = ( strcmp(arg, "ON") == 0 );
-			set_rds_ab(ab);
+			resarg.arg_int = ab;
 			if(log==1) {
 				printf("Set AB to ");
 				if(ab) printf("ON\n"); else printf("OFF\n");
@@ -122,7 +258,8 @@ ResultAndArg poll_control_pipe(int log) {
 		} else if(fifo[0] == 'D' && fifo[1] == 'I') {
 			int di = atoi(arg);
 			if (di >= 0 && di <= 0xF) {
-				set_rds_di(di);
+				resarg.arg_int = di;
+				resarg.res = CONTROL_PIPE_DI_SET;
 				if(log==1) {
 					printf("Set DI to %d\n", di);
 				}
@@ -130,16 +267,16 @@ ResultAndArg poll_control_pipe(int log) {
 			else {
 				printf("Wrong DI range, range is 0-15\n");
 			}
-			resarg.res = CONTROL_PIPE_GENERIC_SET;
 		} 
 	} else if(strlen(fifo) > 4 && fifo[3] == ' ') {
 		char *arg = fifo+4;
-		resarg.arg = fifo+4;
 		if(arg[strlen(arg)-1] == '\n') arg[strlen(arg)-1] = 0;
+		argp = arg;
 		if(fifo[0] == 'P' && fifo[1] == 'T' && fifo[2] == 'Y') {
 			int pty = atoi(arg);
 			if (pty >= 0 && pty <= 31) {
-				set_rds_pty(pty);
+				resarg.arg_int = pty;
+				resarg.res = CONTROL_PIPE_PTY_SET;
 				if(log==1) {
 					if (!pty) {
 						printf("PTY disabled\n");
@@ -151,12 +288,22 @@ ResultAndArg poll_control_pipe(int log) {
 			else {
 				printf("Wrong PTY identifier! The PTY range is 0 - 31.\n");
 			}
-			resarg.res = CONTROL_PIPE_PTY_SET;
+		} else if(fifo[0] == 'P' && fifo[1] == 'T' && fifo[2] == 'N') {
+			arg[8] = 0;
+			if(log==1) printf("PTYN set to: \"%s\"\n", arg);
+			resarg.res = CONTROL_PIPE_PTYN_SET;
+		} else if(fifo[0] == 'R' && fifo[1] == 'T' && fifo[2] == 'P') {
+			int t[6];
+			if(sscanf(arg, "%d,%d,%d,%d,%d,%d", &t[0], &t[1], &t[2], &t[3], &t[4], &t[5]) == 6) {
+				if(log==1) printf("RT+ tags set to: %s\n", arg);
+				resarg.res = CONTROL_PIPE_RTPLUS_SET;
+			} else {
+				printf("Wrong RT+ tags, format is type,start,len,type,start,len\n");
+			}
 		} else if(fifo[0] == 'E' && fifo[1] == 'C' && fifo[2] == 'C') {
 			arg[3] = 0;
-			set_rds_ecc((uint16_t) strtol(arg, NULL, 16));
 			if(log==1) printf("ECC set to: \"%s\"\n", arg);
-			resarg.res = CONTROL_PIPE_GENERIC_SET;
+			resarg.res = CONTROL_PIPE_ECC_SET;
 		} else if(fifo[0] == 'P' && fifo[1] == 'W' && fifo[2] == 'R') {
 			int power_level = atoi(arg);
 			resarg.arg_int = power_level;
@@ -164,8 +311,7 @@ ResultAndArg poll_control_pipe(int log) {
 			resarg.res = CONTROL_PIPE_PWR_SET;
 		} else if(fifo[0] == 'R' && fifo[1] == 'T' && fifo[2] == 'B') {
 			arg[64] = 0;
-			set_rds_ab(1);
-			set_rds_rt(arg);
+			resarg.arg_int = 1; // A/B flag
 			if(log==1) printf("RT B set to: \"%s\"\n", arg);
 			resarg.res = CONTROL_PIPE_RT_SET;
 		} else if(fifo[0] == 'R' && fifo[1] == 'D' && fifo[2] == 'S') {
@@ -183,7 +329,6 @@ ResultAndArg poll_control_pipe(int log) {
 				printf("\n");
 			}
 			resarg.res = CONTROL_PIPE_DEVIATION_SET;
-			resarg.arg = arg;
 		} else if(fifo[0] == 'G' && fifo[1] == 'A' && fifo[2] == 'I') {
 			if(log==1) {
 				printf("Set Gain to ");
@@ -191,7 +336,6 @@ ResultAndArg poll_control_pipe(int log) {
 				printf("\n");
 			}
 			resarg.res = CONTROL_PIPE_GAIN_SET;
-			resarg.arg = arg;
 		} else if(fifo[0] == 'S' && fifo[1] == 'T' && fifo[2] == 'R') {
 			int togg = ( strcmp(arg, "OFF") == 0 );
 			if(log==1) {
@@ -207,7 +351,6 @@ ResultAndArg poll_control_pipe(int log) {
 				printf("\n");
 			}
 			resarg.res = CONTROL_PIPE_COMPRESSORDECAY_SET;
-			resarg.arg = arg;
 		} else if(fifo[0] == 'C' && fifo[1] == 'O' && fifo[2] == 'A') {
 			if(log==1) {
 				printf("Set Compressor Attack to ");
@@ -215,7 +358,6 @@ ResultAndArg poll_control_pipe(int log) {
 				printf("\n");
 			}
 			resarg.res = CONTROL_PIPE_COMPRESSORATTACK_SET;
-			resarg.arg = arg;
 		} else if(fifo[0] == 'R' && fifo[1] == 'D' && fifo[2] == 'V') {
 			if(log==1) {
 				printf("Set RDS Volume to ");
@@ -223,7 +365,6 @@ ResultAndArg poll_control_pipe(int log) {
 				printf("\n");
 			}
 			resarg.res = CONTROL_PIPE_RDSVOL_SET;
-			resarg.arg = arg;
 		} else if(fifo[0] == 'P' && fifo[1] == 'A' && fifo[2] == 'U') {
 			int togg = ( strcmp(arg, "ON") == 0 );
 			if(log==1) {
@@ -255,7 +396,6 @@ ResultAndArg poll_control_pipe(int log) {
 				printf("\n");
 			}
 			resarg.res = CONTROL_PIPE_COMPRESSORMAXGAINRECIP_SET;
-			resarg.arg = arg;
 		} else if(fifo[0] == 'L' && fifo[1] == 'I' && fifo[2] == 'M') {
 			if(atof(arg) < 4) {
 				if(log==1) {
@@ -264,7 +404,6 @@ ResultAndArg poll_control_pipe(int log) {
 					printf("\n");
 				}
 				resarg.res = CONTROL_PIPE_LIMITERTHRESHOLD_SET;
-				resarg.arg = arg;
 			} else {
 				if(log==1) {
 					printf("Limiter threshold was not set, thresholds larger than 4 are not allowed\n");
@@ -272,11 +411,41 @@ ResultAndArg poll_control_pipe(int log) {
 			}
 		}
 	}
+	if(argp && resarg.res >= 0) {
+		strncpy(resarg.arg, argp, CTL_ARG_SIZE-1);
+		resarg.arg[CTL_ARG_SIZE-1] = 0;
+	}
 	return resarg;
 }
 
+/*
+ * Applies a parsed RDS command to the encoder. Returns 0 for the other commands.
+ */
+int apply_rds_command(ResultAndArg *cmd) {
+	switch(cmd->res) {
+		case CONTROL_PIPE_PS_SET: set_rds_ps(cmd->arg); break;
+		case CONTROL_PIPE_RT_SET: set_rds_ab(cmd->arg_int); set_rds_rt(cmd->arg); break;
+		case CONTROL_PIPE_PI_SET: set_rds_pi((uint16_t) strtol(cmd->arg, NULL, 16)); break;
+		case CONTROL_PIPE_TA_SET: set_rds_ta(cmd->arg_int); break;
+		case CONTROL_PIPE_TP_SET: set_rds_tp(cmd->arg_int); break;
+		case CONTROL_PIPE_MS_SET: set_rds_ms(cmd->arg_int); break;
+		case CONTROL_PIPE_AB_SET: set_rds_ab(cmd->arg_int); break;
+		case CONTROL_PIPE_PTY_SET: set_rds_pty(cmd->arg_int); break;
+		case CONTROL_PIPE_DI_SET: set_rds_di(cmd->arg_int); break;
+		case CONTROL_PIPE_ECC_SET: set_rds_ecc((uint16_t) strtol(cmd->arg, NULL, 16)); break;
+		case CONTROL_PIPE_PTYN_SET: set_rds_ptyn(cmd->arg); break;
+		case CONTROL_PIPE_RTPLUS_SET: set_rds_rtplus(cmd->arg); break;
+		default: return 0;
+	}
+	return 1;
+}
+
 int close_control_pipe() {
-	if(f_ctl) fclose(f_ctl);
-	if(fd) return close(fd);
-	else return 0;
+	for(int i=0; i<CTL_MAX_SOURCES && epfd>=0; i++) {
+		if(sources[i].fd >= 0) remove_source(&sources[i]);
+	}
+	if(socket_path) unlink(socket_path);
+	if(epfd >= 0) close(epfd);
+	epfd = -1;
+	return 0;
 }
@@ -28,13 +28,28 @@
 #define CONTROL_PIPE_COMPRESSORMAXGAINRECIP_SET 21
 #define CONTROL_PIPE_LIMITERTHRESHOLD_SET 22
 #define CONTROL_PIPE_GENERIC_SET 23
+#define CONTROL_PIPE_DI_SET 24
+#define CONTROL_PIPE_ECC_SET 25
+#define CONTROL_PIPE_PTYN_SET 26
+#define CONTROL_PIPE_RTPLUS_SET 27
+
+#define CTL_ARG_SIZE 128
 
 typedef struct {
     int res;
-    char *arg;
+    char arg[CTL_ARG_SIZE];
     int arg_int;
+    int batch;      // Commands to apply together starting with this one, 0 inside a batch
 } ResultAndArg;
 
+// Fills json with the status object returned by {"cmd":"status"}
+typedef void (*control_status_fn)(char *json, int size);
+
 extern int open_control_pipe(char *filename);
+extern int open_control_socket(char *path);
 extern int close_control_pipe();
-extern ResultAndArg poll_control_pipe(int log);
+extern int wait_control_commands(ResultAndArg *commands, int max, int timeout_ms, int log);
+extern ResultAndArg parse_control_line(char *line, int log);
+extern int apply_rds_command(ResultAndArg *cmd);
+extern void set_control_status(control_status_fn status);
+extern int control_json_request(char *line, ResultAndArg *commands, int max, char *response, int size, control_status_fn status, int log);
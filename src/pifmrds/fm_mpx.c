@@ -28,64 +28,144 @@
 #include <stddef.h>
 #include <sndfile.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
 
 #include "rds.h"
+#include "mpx_fir.h"
+#include "pcm_ring.h"
+#include "audio_proc.h"
+#include "stereo_enc.h"
+#include "playlist.h"
+#include "mpx_kernel.h"
 
 
 #define PI 3.14159265359
 
 #define FIR_PHASES    (32)
-#define FIR_TAPS      (32) // MUST be a power of 2 for the circular buffer
+#define FIR_TAPS      (32) // multiple of 8 (see mpx_fir.h)
+// -resampler best : longer Blackman windowed filter, finer phases with linear interpolation between them
+#define FIR_BEST_PHASES (256)
+#define FIR_BEST_TAPS   (64)
+// The fast filter's Hamming window works out to its 0.08 floor for every tap and the sinc is not
+// scaled by the phase count, so its gain is 0.08/FIR_PHASES. The levels of everything after it
+// are set for that, the best filter is scaled to match.
+#define FIR_GAIN      (0.08/FIR_PHASES)
 
 size_t length;
 
-// coefficients of the low-pass FIR filter
-float low_pass_fir[FIR_PHASES][FIR_TAPS];
-
-float carrier_38[] = {0.0, 0.8660254037844386, 0.8660254037844388, 1.2246467991473532e-16, -0.8660254037844384, -0.8660254037844386};
-
-float carrier_19[] = {0.0, 0.5, 0.8660254037844386, 1.0, 0.8660254037844388, 0.5, 1.2246467991473532e-16, -0.5, -0.8660254037844384, -1.0, -0.8660254037844386, -0.5};
-
-int phase_38 = 0;
-int phase_19 = 0;
-
-float downsample_factor;
+int fir_taps, fir_phases, fir_interpolate;
+// coefficients of the low-pass FIR filter, by phase then tap. One more phase than used, the
+// first one shifted by a tap, so that interpolation can always look at the next phase.
+float low_pass_fir[(FIR_BEST_PHASES+1)*FIR_BEST_TAPS];
+// same, reversed for the doubled delay line, and duplicated for interleaved stereo (see mpx_fir.h)
+float low_pass_fir_mono[(FIR_BEST_PHASES+1)*FIR_BEST_TAPS] __attribute__((aligned(16)));
+float low_pass_fir_stereo[(FIR_BEST_PHASES+1)*2*FIR_BEST_TAPS] __attribute__((aligned(16)));
+
+// Audio path up to the stereo encoder (mpx_kernel.h). Rational resampling : 228000/in_rate is
+// kern.up/kern.down in lowest terms, in integers so the output never drifts.
+mpx_kernel kern;
+mpx_kernel_fn kernel_run = NULL;
+unsigned kernel_flags;
+fm_mpx_data *kernel_data;       // settings of the block being made, for refill_audio
 
 int raw_;
 
 float *audio_buffer;
-int audio_index = 0;
-int audio_len = 0;
-float audio_pos;
 
-float fir_buffer_left[FIR_TAPS] = {0};
-float fir_buffer_right[FIR_TAPS] = {0};
-int fir_index = 0;
+float fir_line[2*2*FIR_BEST_TAPS] = {0}; // doubled delay line, L,R interleaved in stereo
 int channels;
-float left_max=0, right_max=0;  // start compressor with low gain
+float compressor_gain=1;        // gain applied at the end of the last block, for the status
 
-SNDFILE *inf;
+// Multiband processor and look-ahead limiter on the decoded PCM, set up again when their settings change
+audio_proc proc;
+int in_rate;
+double preemphasis_tau;
 
-float clip(float input, float threshold) {
-    if (input > threshold) {
-        return threshold;
-    } else if (input < -threshold) {
-        return -threshold;
-    }
-    return input;
+// Stereo generator, fed with a block of 228 kHz L and R, set up again when the oversampling changes
+stereo_enc enc;
+stereo_enc_fn enc_run = NULL;
+unsigned enc_flags;
+float *block_left, *block_right;
+
+SNDFILE *inf;
+playlist list;
+int playing_list = 0;
+int composite_input = 0;        // inf is a ready made multiplex, see fm_mpx_open_composite
+#define COMPOSITE_ATTENUATION 90   // dB, stop band of its resampling filter
+#define COMPOSITE_MAX_TAPS 512      // full stop band up to about 2 MHz of input
+#define COMPOSITE_MAX_PHASES 512
+float *composite_fir = NULL;
+float *composite_line = NULL;   // doubled delay line, 2*taps
+
+// Audio decode stage : a thread reads the file into the PCM ring, the MPX generator pops from it
+// and never waits on the storage or the pipe.
+#define PCM_RING_SECONDS 2
+#define PCM_PREBUFFER_SECONDS 0.2
+#define DECODE_CHUNK 4096 // frames per sf_read_float
+
+pcm_ring pcm;
+float *decode_chunk = NULL;
+pthread_t decode_thread;
+int decode_running = 0;
+// Shared with the decode thread : flags through release/acquire, counters relaxed
+int decode_stop = 0;
+int decode_done = 0;   // input ended (raw stdin closed) or failed
+int decode_error = 0;
+int pcm_primed = 0;
+size_t pcm_prebuffer;
+unsigned long pcm_underruns = 0;
+unsigned long decode_reads = 0;
+float decode_max_read_ms = 0;
+
+static double monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e3 + ts.tv_nsec*1e-6;
 }
 
-float limiter(float input, float threshold, int enable) {
-    if(enable == 1) {
-        if (fabsf(input) > threshold) {
-            return (input > 0) ? threshold : -threshold;
+static void *decode_audio(void *arg) {
+    float *chunk = decode_chunk;
+    while(!__atomic_load_n(&decode_stop, __ATOMIC_ACQUIRE)) {
+        double start = monotonic_ms();
+        int len = playing_list ? playlist_read(&list, chunk, DECODE_CHUNK) * channels : sf_read_float(inf, chunk, DECODE_CHUNK * channels);
+        float took = monotonic_ms() - start;
+        float max_ms;
+        __atomic_load(&decode_max_read_ms, &max_ms, __ATOMIC_RELAXED);
+        if(took > max_ms) __atomic_store(&decode_max_read_ms, &took, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&decode_reads, 1, __ATOMIC_RELAXED);
+        if(playing_list && len == 0) {
+            fprintf(stderr, "No playable track left in the playlist, terminating\n");
+            __atomic_store_n(&decode_error, 1, __ATOMIC_RELEASE);
+            break;
+        }
+        if(len < 0) {
+            fprintf(stderr, "Error reading audio\n");
+            __atomic_store_n(&decode_error, 1, __ATOMIC_RELEASE);
+            break;
+        }
+        if(len == 0) {
+            if( sf_seek(inf, 0, SEEK_SET) < 0 ) {
+                if(!raw_) {
+                    fprintf(stderr, "Could not rewind in audio file, terminating\n");
+                    __atomic_store_n(&decode_error, 1, __ATOMIC_RELEASE);
+                }
+                break;
+            }
+            continue;
+        }
+        int pushed = 0;
+        while(pushed < len && !__atomic_load_n(&decode_stop, __ATOMIC_ACQUIRE)) {
+            pushed += pcm_ring_push(&pcm, chunk + pushed, len - pushed);
+            if(pushed < len) usleep(2000);
         }
-        return input;
-    } else {
-        return input;
     }
+    __atomic_store_n(&decode_done, 1, __ATOMIC_RELEASE);
+    return NULL;
 }
 
 float *alloc_empty_buffer(size_t length) {
@@ -97,14 +177,240 @@ float *alloc_empty_buffer(size_t length) {
     return p;
 }
 
+// Next input frames for the kernel, from the PCM ring
+static int refill_audio(mpx_kernel *k) {
+    fm_mpx_data *data = kernel_data;
+    // Offline there is no deadline, the decoder is waited for
+    while(data->wait_for_audio && pcm_ring_available(&pcm) < (size_t)channels && !__atomic_load_n(&decode_done, __ATOMIC_ACQUIRE)) usleep(200);
+    // Whole frames only, the decoder may be in the middle of one
+    size_t available = pcm_ring_available(&pcm);
+    available -= available % channels;
+    if(available > length - length % channels) available = length - length % channels;
+    int len = pcm_ring_pop(&pcm, audio_buffer, available);
+    if(len == 0) {
+        if(__atomic_load_n(&decode_error, __ATOMIC_ACQUIRE)) return -1;
+        // Decoder late (or input over) : one frame of silence, the multiplex goes on
+        if(!__atomic_load_n(&decode_done, __ATOMIC_ACQUIRE)) pcm_underruns++;
+        for(int c=0; c<channels; c++) audio_buffer[c] = 0;
+        len = channels;
+    }
+    if(proc.bands > 0 || proc.lookahead > 0) audio_proc_process(&proc, audio_buffer, len/channels, data->limiter_threshold);
+    k->frame_index = 0;
+    k->frame_len = len;
+    return 0;
+}
+
+// Resampling filter of the audio, with pre-emphasis
+static void make_audio_filter(int in_samplerate, double preemphasis, float cutoff_freq, int resampler) {
+    // Choose a cutoff frequency for the low-pass FIR filter
+    if(in_samplerate/2 < cutoff_freq) cutoff_freq = in_samplerate/2 * .8;
+
+    fir_interpolate = resampler == RESAMPLER_BEST;
+    fir_taps = fir_interpolate ? FIR_BEST_TAPS : FIR_TAPS;
+    fir_phases = fir_interpolate ? FIR_BEST_PHASES : FIR_PHASES;
+   
+    // Create the low-pass FIR filter, with pre-emphasis
+    double window, firlowpass, firpreemph, sincpos;
+    double taup, deltap, bp, ap, a0, a1, b1;
+    if(preemphasis != 0) {
+    // IIR pre-emphasis filter
+    // Reference material:    http://jontio.zapto.org/hda1/preempiir.pdf
+        double tau=preemphasis;
+        double delta=1/(2*PI*20000);//double delta=1.96e-6;
+        taup=1.0/(2.0*(in_samplerate*fir_phases))/tan(  1.0/(2*tau*(in_samplerate*fir_phases) ));
+        deltap=1.0/(2.0*(in_samplerate*fir_phases))/tan(  1.0/(2*delta*(in_samplerate*fir_phases) ));
+        bp=sqrt( -taup*taup + sqrt(taup*taup*taup*taup + 8.0*taup*taup*deltap*deltap) ) / 2.0 ;
+        ap=sqrt( 2*bp*bp + taup*taup );
+        a0=( 2.0*ap + 1.0/(in_samplerate*fir_phases) )/(2.0*bp + 1.0/(in_samplerate*fir_phases) );
+        a1=(-2.0*ap + 1.0/(in_samplerate*fir_phases) )/(2.0*bp + 1.0/(in_samplerate*fir_phases) );
+        b1=( 2.0*bp - 1.0/(in_samplerate*fir_phases) )/(2.0*bp + 1.0/(in_samplerate*fir_phases) );
+    }
+    double x=0,y=0;
+    double dc=0;
+    int total = fir_taps*fir_phases;
+ 
+    for(int i=0; i<fir_taps; i++) { 
+     for(int j=0; j<fir_phases; j++) {
+        int mi=i*fir_phases + j+1;// match indexing of Matlab script
+        sincpos = (mi)-(((total)+1.0)/2.0); // offset by 0.5 so sincpos!=0 (causes NaN x/0 )
+        //printf("%d=%f \n",mi ,sincpos); 
+        firlowpass = sin(2 * PI * cutoff_freq * sincpos / (in_samplerate*fir_phases) ) / (PI * sincpos) ; 
+                                        // Find the combined impulse response
+        if(preemphasis != 0) {
+            y=a0*firlowpass + a1*x + b1*y; 
+        } else {
+            y=firlowpass; 
+        }
+        x=firlowpass;                   // of FIR low-pass and IIR pre-emphasis
+        firpreemph=y;                   // y could be replaced by firpreemph but this
+                                        // matches the example in the reference material
+
+
+        if(fir_interpolate) {
+            window = .42 - .5 * cos(2*PI * mi / (total+1)) + .08 * cos(4*PI * mi / (total+1)); // Blackman window
+        } else {
+            window = (.54 - .46 * cos(2*PI * (mi) / (double) FIR_TAPS*FIR_PHASES )) ; // Hamming window
+        }
+        dc += firlowpass * window;
+        low_pass_fir[j*fir_taps + i] = firpreemph * window; 
+      }
+    }
+    if(fir_interpolate) {
+        for(int i=0; i<total; i++) low_pass_fir[i] *= FIR_GAIN*fir_phases/dc;
+    }
+    for(int i=0; i<fir_taps; i++) {
+        low_pass_fir[fir_phases*fir_taps + i] = i+1 < fir_taps ? low_pass_fir[i+1] : 0;
+    }
+
+    for(int j=0; j<=fir_phases; j++) {
+        for(int i=0; i<fir_taps; i++) {
+            low_pass_fir_mono[j*fir_taps + i] = low_pass_fir[j*fir_taps + fir_taps-1-i];
+            low_pass_fir_stereo[j*2*fir_taps + 2*i] = low_pass_fir[j*fir_taps + fir_taps-1-i];
+            low_pass_fir_stereo[j*2*fir_taps + 2*i+1] = low_pass_fir[j*fir_taps + fir_taps-1-i];
+        }
+    }
+
+    printf("Created low-pass FIR filter for audio channels, with cutoff at %.1f Hz\n", cutoff_freq);
+
+    if( 0 )
+    {
+      printf("f = [ ");
+      for(int i=0; i<fir_taps; i++) { 
+        for(int j=0; j<fir_phases; j++) {
+          printf("%.5f ", low_pass_fir[j*fir_taps + i]);
+        }
+      }
+      printf("]; \n");
+    }
+    kern.fir_mono = low_pass_fir_mono;
+    kern.fir_stereo = low_pass_fir_stereo;
+}
+
+static double bessel_i0(double x) {
+    double sum = 1, term = 1;
+    for(int k=1; k<100 && term > 1e-12*sum; k++) {
+        term *= (x/(2*k)) * (x/(2*k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Resampling filter of a composite input : Kaiser windowed, flat to 40% of the lower of the two rates
+// and down by COMPOSITE_ATTENUATION from 50%, so pilot, subcarrier and RDS keep their level and phase.
+// One phase per output position when there are not too many, otherwise interpolated between phases.
+static int make_composite_filter(int in_samplerate) {
+    double band = in_samplerate < 228000 ? in_samplerate : 228000;
+    double transition = 2*PI * 0.1*band / in_samplerate; // radians per input sample
+    int taps = ceil((COMPOSITE_ATTENUATION - 7.95) / (2.285 * transition));
+    taps = (taps + 7) & ~7; // multiple of 8 (see mpx_fir.h)
+    if(taps > COMPOSITE_MAX_TAPS) {
+        taps = COMPOSITE_MAX_TAPS;
+        printf("Warning: at %d Hz the composite filter is limited to %d taps, %.0f dB of stop band.\n",
+            in_samplerate, taps, 2.285 * transition * (taps-1) + 7.95);
+    }
+    int phases = kern.up < COMPOSITE_MAX_PHASES ? kern.up : COMPOSITE_MAX_PHASES;
+    int total = taps * phases;
+    double cutoff = 0.45*band / ((double)in_samplerate * phases); // cycles per sample of the prototype
+    double beta = 0.1102 * (COMPOSITE_ATTENUATION - 8.7);
+
+    double *h = (double *)malloc(total * sizeof(double));
+    composite_line = (float *)calloc(2 * taps, sizeof(float));
+    if(h == NULL || composite_line == NULL || posix_memalign((void **)&composite_fir, 16, (phases+1) * taps * sizeof(float)) != 0) {
+        free(h);
+        return -1;
+    }
+    double dc = 0;
+    for(int m=0; m<total; m++) {
+        double t = m - (total-1) / 2.0;
+        double r = 2.0*m / (total-1) - 1;
+        double sinc = t == 0 ? 2*cutoff : sin(2*PI*cutoff*t) / (PI*t);
+        h[m] = sinc * bessel_i0(beta * sqrt(1 - r*r)) / bessel_i0(beta);
+        dc += h[m];
+    }
+    // Tap i of phase j is h[i*phases + j], reversed for the doubled delay line, every phase at unity
+    // gain. The extra phase is the first one shifted by a tap, for the interpolation.
+    for(int j=0; j<=phases; j++) {
+        for(int i=0; i<taps; i++) {
+            int m = j < phases ? i*phases + j : (i+1)*phases;
+            composite_fir[j*taps + taps-1-i] = m < total ? h[m] * phases / dc : 0;
+        }
+    }
+    free(h);
+
+    fir_taps = taps;
+    fir_phases = phases;
+    fir_interpolate = phases < kern.up;
+    kern.fir_mono = composite_fir;
+    kern.fir_stereo = NULL;
+    printf("Created composite filter, %d taps x %d phases%s, flat to %.1f kHz\n", taps, phases,
+        fir_interpolate ? " interpolated" : "", 0.4*band/1000);
+    return 0;
+}
+
+// Filters, buffers and the decode thread, once the input format is known
+static int start_audio(int in_samplerate, int in_channels, double preemphasis, float cutoff_freq, int resampler) {
+    in_rate = in_samplerate;
+    preemphasis_tau = preemphasis;
+    int a = 228000, b = in_samplerate;
+    while(b) { int r = a % b; a = b; b = r; }
+    kern.up = 228000 / a;
+    kern.down = in_samplerate / a;
+    kern.pos = kern.up;
+
+    printf("Input: %d Hz, resampling by %d/%d (%s)\n", in_samplerate, kern.up, kern.down,
+        composite_input ? "composite" : resampler == RESAMPLER_BEST ? "best" : "fast");
+
+    channels = in_channels;
+    if(channels > 1) {
+        printf("%d channels, generating stereo multiplex.\n", channels);
+    } else {
+        printf("1 channel, monophonic operation.\n");
+    }
+
+    if(composite_input) {
+        if(make_composite_filter(in_samplerate) < 0) return -1;
+    } else {
+        make_audio_filter(in_samplerate, preemphasis, cutoff_freq, resampler);
+    }
+
+    audio_buffer = alloc_empty_buffer(length * channels);
+    if(audio_buffer == NULL) return -1;
+    kern.taps = fir_taps;
+    kern.phases = fir_phases;
+    kern.line = composite_input ? composite_line : fir_line;
+    kern.index = 0;
+    kern.frames = audio_buffer;
+    kern.frame_index = kern.frame_len = 0;
+    kern.channels = channels;
+    kern.refill = refill_audio;
+    kern.left_max = kern.right_max = 0; // start compressor with low gain
+    block_left = alloc_empty_buffer(length);
+    block_right = alloc_empty_buffer(length);
+    if(block_left == NULL || block_right == NULL) return -1;
+    enc.oversample = 0;
+
+    decode_chunk = alloc_empty_buffer(DECODE_CHUNK * channels);
+    if(decode_chunk == NULL) return -1;
+    if(pcm_ring_init(&pcm, PCM_RING_SECONDS * in_samplerate * channels) < 0) return -1;
+    pcm_prebuffer = PCM_PREBUFFER_SECONDS * in_samplerate * channels;
+    if(pthread_create(&decode_thread, NULL, decode_audio, NULL) != 0) {
+        fprintf(stderr, "Error: could not start the audio decode thread.\n");
+        return -1;
+    }
+    decode_running = 1;
 
-int fm_mpx_open(char *filename, size_t len, int raw, double preemphasis, int rawSampleRate, int rawChannels, float cutoff_freq) {
+    return 0;
+}
+
+
+int fm_mpx_open(char *filename, size_t len, int raw, double preemphasis, int rawSampleRate, int rawChannels, float cutoff_freq, int resampler) {
     length = len;
     raw_ = raw;
 
     if(filename != NULL) {
         // Open the input file
         SF_INFO sfinfo;
+        memset(&sfinfo, 0, sizeof(sfinfo)); // libsndfile wants format 0 unless raw
 
         if(raw) {
             sfinfo.format = SF_FORMAT_RAW | SF_FORMAT_PCM_16;
@@ -129,77 +435,7 @@ int fm_mpx_open(char *filename, size_t len, int raw, double preemphasis, int raw
             }
         }
             
-        int in_samplerate = sfinfo.samplerate;
-        downsample_factor = 228000. / in_samplerate;
-    
-        printf("Input: %d Hz, upsampling factor: %.2f\n", in_samplerate, downsample_factor);
-
-        channels = sfinfo.channels;
-        if(channels > 1) {
-            printf("%d channels, generating stereo multiplex.\n", channels);
-        } else {
-            printf("1 channel, monophonic operation.\n");
-        }
-    
-        // Choose a cutoff frequency for the low-pass FIR filter
-        if(in_samplerate/2 < cutoff_freq) cutoff_freq = in_samplerate/2 * .8;
-   
-        // Create the low-pass FIR filter, with pre-emphasis
-        double window, firlowpass, firpreemph, sincpos;
-        double taup, deltap, bp, ap, a0, a1, b1;
-        if(preemphasis != 0) {
-        // IIR pre-emphasis filter
-        // Reference material:    http://jontio.zapto.org/hda1/preempiir.pdf
-            double tau=preemphasis;
-            double delta=1/(2*PI*20000);//double delta=1.96e-6;
-            taup=1.0/(2.0*(in_samplerate*FIR_PHASES))/tan(  1.0/(2*tau*(in_samplerate*FIR_PHASES) ));
-            deltap=1.0/(2.0*(in_samplerate*FIR_PHASES))/tan(  1.0/(2*delta*(in_samplerate*FIR_PHASES) ));
-            bp=sqrt( -taup*taup + sqrt(taup*taup*taup*taup + 8.0*taup*taup*deltap*deltap) ) / 2.0 ;
-            ap=sqrt( 2*bp*bp + taup*taup );
-            a0=( 2.0*ap + 1.0/(in_samplerate*FIR_PHASES) )/(2.0*bp + 1.0/(in_samplerate*FIR_PHASES) );
-            a1=(-2.0*ap + 1.0/(in_samplerate*FIR_PHASES) )/(2.0*bp + 1.0/(in_samplerate*FIR_PHASES) );
-            b1=( 2.0*bp - 1.0/(in_samplerate*FIR_PHASES) )/(2.0*bp + 1.0/(in_samplerate*FIR_PHASES) );
-        }
-        double x=0,y=0;
- 
-        for(int i=0; i<FIR_TAPS; i++) { 
-         for(int j=0; j<FIR_PHASES; j++) {
-            int mi=i*FIR_PHASES + j+1;// match indexing of Matlab script
-            sincpos = (mi)-(((FIR_TAPS*FIR_PHASES)+1.0)/2.0); // offset by 0.5 so sincpos!=0 (causes NaN x/0 )
-            //printf("%d=%f \n",mi ,sincpos); 
-            firlowpass = sin(2 * PI * cutoff_freq * sincpos / (in_samplerate*FIR_PHASES) ) / (PI * sincpos) ; 
-                                            // Find the combined impulse response
-            if(preemphasis != 0) {
-                y=a0*firlowpass + a1*x + b1*y; 
-            } else {
-                y=firlowpass; 
-            }
-            x=firlowpass;                   // of FIR low-pass and IIR pre-emphasis
-            firpreemph=y;                   // y could be replaced by firpreemph but this
-                                            // matches the example in the reference material
-
-
-            window = (.54 - .46 * cos(2*PI * (mi) / (double) FIR_TAPS*FIR_PHASES )) ; // Hamming window
-            low_pass_fir[j][i] = firpreemph * window; 
-          }
-        }
-    
-        printf("Created low-pass FIR filter for audio channels, with cutoff at %.1f Hz\n", cutoff_freq);
-    
-        if( 0 )
-        {
-          printf("f = [ ");
-          for(int i=0; i<FIR_TAPS; i++) { 
-            for(int j=0; j<FIR_PHASES; j++) {
-              printf("%.5f ", low_pass_fir[j][i]);
-            }
-          }
-          printf("]; \n");
-        }
-        
-        audio_pos = downsample_factor;
-        audio_buffer = alloc_empty_buffer(length * channels);
-        if(audio_buffer == NULL) return -1;
+        if(start_audio(sfinfo.samplerate, sfinfo.channels, preemphasis, cutoff_freq, resampler) < 0) return -1;
 
     } // end if(filename != NULL)
     else {
@@ -210,176 +446,144 @@ int fm_mpx_open(char *filename, size_t len, int raw, double preemphasis, int raw
     return 0;
 }
 
+int fm_mpx_open_composite(char *filename, size_t len, int raw_format, int rawSampleRate) {
+    length = len;
+    raw_ = raw_format != COMPOSITE_FILE;
+    SF_INFO sfinfo;
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    if(raw_) {
+        sfinfo.format = SF_FORMAT_RAW | (raw_format == COMPOSITE_FLOAT ? SF_FORMAT_FLOAT : SF_FORMAT_PCM_16);
+        sfinfo.samplerate = rawSampleRate;
+        sfinfo.channels = 1;
+    }
+    if(filename[0] == '-') inf = sf_open_fd(fileno(stdin), SFM_READ, &sfinfo, 0);
+    else inf = sf_open(filename, SFM_READ, &sfinfo);
+    if(inf == NULL) {
+        fprintf(stderr, "Error: could not open %s for composite input.\n", filename[0] == '-' ? "stdin" : filename);
+        return -1;
+    }
+    if(sfinfo.channels != 1) {
+        fprintf(stderr, "Error: the composite input must have one channel, not %d.\n", sfinfo.channels);
+        return -1;
+    }
+    printf("Using composite input: %s\n", filename[0] == '-' ? "stdin" : filename);
+    if(sfinfo.samplerate < 120000) printf("Warning: at %d Hz the composite input cannot carry the stereo subcarrier.\n", sfinfo.samplerate);
+    composite_input = 1;
+    // Own filter (make_composite_filter), no pre-emphasis
+    return start_audio(sfinfo.samplerate, 1, 0, 0, RESAMPLER_BEST);
+}
+
+int fm_mpx_open_playlist(char *filename, size_t len, double preemphasis, float cutoff_freq, float crossfade, int resampler) {
+    length = len;
+    raw_ = 0;
+    inf = NULL;
+    if(playlist_open(&list, filename, crossfade) < 0) return -1;
+    playing_list = 1;
+    printf("Using playlist: %s (%d tracks, %s)\n", filename, list.count, crossfade > 0 ? "crossfade" : "gapless");
+    return start_audio(list.rate, list.channels, preemphasis, cutoff_freq, resampler);
+}
+
+void fm_mpx_reload_playlist() {
+    if(playing_list) playlist_reload(&list);
+}
+
 // samples provided by this function are in 0..10: they need to be divided by
 // 10 after.
+// The stages run over the whole block: RDS (or silence) as the base, the audio path of the kernel,
+// then the stereo encoder or, with a composite input, the resampled input added as it is. What is
+// off costs nothing per sample : a stage that is skipped, or a kernel instance without it.
 int fm_mpx_get_samples(float *mpx_buffer, fm_mpx_data *data) {
-    if (audio_buffer != NULL) {
-        *audio_buffer = 0.0;
-    }
-    int stereo_capable = (channels > 1) && (!data->dstereo);
-    if(!data->drds && data->generate_multiplex) get_rds_samples(mpx_buffer, length, stereo_capable, data->rds_ct_enabled, data->rds_volume);
+    int audio = inf != NULL || playing_list;
+    int stereo = audio && !composite_input && channels > 1;
 
-    if(inf == NULL) return 0; // if there is no audio, stop here
-    
-    for(int i=0; i<length; i++) {
-        if(audio_pos >= downsample_factor) {
-            audio_pos -= downsample_factor;
-            
-            if(audio_len <=channels ) {
-                for(int j=0; j<2; j++) { // one retry
-                    audio_len = sf_read_float(inf, audio_buffer, length);
-                    if (audio_len < 0) {
-                        fprintf(stderr, "Error reading audio\n");
-                        return -1;
-                    }
-                    if(audio_len == 0) {
-                        if( sf_seek(inf, 0, SEEK_SET) < 0 ) {
-                            if(!raw_) {
-                                fprintf(stderr, "Could not rewind in audio file, terminating\n");
-                                return -1;
-                            } else {
-                                break;
-                            }
-                        }
-                    } else {
-                        break;
-                    }
-                }
-                audio_index = 0;
-            } else {
-                audio_index += channels;
-                audio_len -= channels;
-            }
+    if(!data->generate_multiplex || data->drds) bzero(mpx_buffer, length * sizeof(float));
+    else get_rds_samples(mpx_buffer, length, stereo && !data->dstereo, data->rds_ct_enabled, data->rds_volume);
 
-           fir_index++;  // fir_index will point to newest valid data soon
-           if(fir_index >= FIR_TAPS) fir_index = 0; 
-           // Store the current sample(s) into the FIR filter's ring buffer
-           fir_buffer_left[fir_index] = audio_buffer[audio_index];
-           if(channels > 1) { 
-               fir_buffer_right[fir_index] =  audio_buffer[audio_index+1]; 
-           }
-        } // if need new sample
-
-        // Polyphase FIR filter
-        float out_left  = 0;
-        float out_right = 0;
-        // Calculate which FIR phase to use
-        //int iphase = FIR_PHASES-1 - ((int) (audio_pos/downsample_factor*FIR_PHASES) );
-        int iphase =  ((int) (audio_pos*FIR_PHASES/downsample_factor) );// I think this is correct
-        //int iphase=FIR_PHASES-1;  // test override
-        //printf("%d %d \n",fir_index,iphase); // diagnostics
-	// Sanity checks
-        if ( iphase < 0 ) {iphase=0; printf("low\n"); }// Seems to run faster with these checks in place
-        if ( iphase >= FIR_PHASES ) {iphase=FIR_PHASES-2; printf("high\n"); }
-		
-        if( channels > 1 )
-        {
-          for(int fi=0; fi<FIR_TAPS; fi++)  // fi = Filter Index
-          {                                 // use bit masking to implement circular buffer
-            out_left+= low_pass_fir[iphase][fi]*fir_buffer_left[(fir_index-fi)&(FIR_TAPS-1)];
-            out_right+=low_pass_fir[iphase][fi]*fir_buffer_right[(fir_index-fi)&(FIR_TAPS-1)];
-          }
-        }
-        else 
-        {
-          for(int fi=0; fi<FIR_TAPS; fi++)  // fi = Filter Index
-          {                                 // use bit masking to implement circular buffer
-            out_left+=low_pass_fir[iphase][fi] * fir_buffer_left[(fir_index-fi)&(FIR_TAPS-1)];
-          }
-        }
+    if(!audio) return 0; // if there is no audio, stop here
 
-        // Multiply by the gain
-        out_left = out_left * data->audio_gain;
-        if(channels > 1) out_right = out_right * data->audio_gain;
-		
-        // Simple broadcast compressor
-        // 
-        // The goal is to get the loudest sounding audio while 
-        // keeping the deviation within legal limits, and 
-        // without degrading the audio quality significantly.  
-        // Don't expect this simple code to match the 
-        // performance of commercial broadcast equipment. 
-        float left_abs, right_abs;
-        // Setting attack to anything other than 1.0 could cause overshoot.
-        left_abs=fabsf(out_left);
-        if( left_abs>left_max ) 
-        {
-           left_max+= (left_abs-left_max)*data->compressor_attack; 
-        }
-        else
-        {
-           left_max*=data->compressor_decay; 
-        }
+    if(!pcm_primed) {
+        // Let the decoder get ahead once, at most a second
+        for(int wait=0; wait<1000 && !__atomic_load_n(&decode_done, __ATOMIC_ACQUIRE) && pcm_ring_available(&pcm) < pcm_prebuffer; wait++) usleep(1000);
+        pcm_primed = 1;
+    }
+    if(!composite_input && (data->processor_bands != proc.bands || data->lookahead_ms != proc.lookahead_ms || proc.channels != channels)) {
+        audio_proc_init(&proc, in_rate, channels, preemphasis_tau, data->processor_bands, data->lookahead_ms);
+    }
 
-        if( channels > 1 )
-        {
-          right_abs=fabsf(out_right);
-          if( right_abs>right_max ) 
-          {
-             right_max+= (right_abs-right_max)*data->compressor_attack;
-          }
-          else
-          {
-             right_max*=data->compressor_decay;
-          }
-          if( 1 )// Experimental joint compressor mode
-          {
-              if( left_max > right_max ) 
-                  right_max=left_max;
-              else if( left_max < right_max ) 
-                  left_max=right_max;
-          }
-          if(data->enablecompressor) out_right=out_right/(right_max+data->compressor_max_gain_recip); // Adjust volume with limited maximum gain
-        }
-        if(data->enablecompressor) out_left= out_left/(left_max+data->compressor_max_gain_recip); // Adjust volume with limited maximum gain
-        if(data->drds) mpx_buffer[i] = 0.0; // before this, there is just rds here, so we can set it to 0
-        if(data->paused) {
-            out_left = 0;
-            if(channels > 1) out_right = 0;
-        }
- 
-        out_left = limiter(out_left, data->limiter_threshold, 1);
-        if( channels==2) out_right = limiter(out_right, data->limiter_threshold, 1);
-
-        out_left = clip(out_left, 1); //max is gonna be 1.0 (0 db), lowest is -1.0 (-inf db)
-        if(channels==2) out_right = clip(out_right, 1);
-
-        // Generate the stereo mpx
-        if(channels == 2 && !data->dstereo) {
-            // 4.5 and 0.9 are the volumes, thats because we dont have 75000 khz of deviation, instead we have 7500 khz, so that needs to be louder by 10 times than normal
-            mpx_buffer[i] +=  4.5*(out_left+out_right) + // Stereo sum signal
-                4.5 * carrier_38[phase_38] * (out_left-out_right) + // Stereo difference signal
-            0.9*carrier_19[phase_19];                  // Stereo pilot tone
-            phase_19++;
-            phase_38++;
-            if(phase_19 >= 12) phase_19 = 0;
-            if(phase_38 >= 6) phase_38 = 0;
-        } else if(channels == 1 || data->dstereo)
-        {
-            if(data->generate_multiplex) {
-                mpx_buffer[i] =  
-                    mpx_buffer[i] +
-                    4.5*out_left;      // Unmodulated monophonic signal
-            }
-        } 
-        if(!data->generate_multiplex) {
-            mpx_buffer[i] = 
-                0.0;
-        }
-            
-        audio_pos++;   
-        
+    // The input is taken at the same pace whatever is on
+    int compress = !composite_input && data->enablecompressor && !proc.bands;
+    unsigned flags = (channels > 1 ? MPX_KERNEL_STEREO : 0) | (fir_interpolate ? MPX_KERNEL_INTERPOLATE : 0) |
+        (compress ? MPX_KERNEL_COMPRESS : 0) | (data->paused || !data->generate_multiplex ? MPX_KERNEL_MUTE : 0);
+    if(kernel_run == NULL || flags != kernel_flags) {
+        kernel_run = mpx_kernel_select(flags);
+        kernel_flags = flags;
     }
+    kernel_data = data;
+    // A composite is taken as it is, 1.0 in for 100% modulation
+    kern.gain = composite_input ? data->audio_gain * 10 : data->audio_gain;
+    kern.attack = data->compressor_attack;
+    kern.decay = data->compressor_decay;
+    kern.max_gain_recip = data->compressor_max_gain_recip;
+    if(kernel_run(&kern, block_left, block_right, length) < 0) return -1;
+    if(!data->generate_multiplex || (composite_input && data->paused)) return 0;
+
+    if(composite_input) {
+        for(int i=0; i<length; i++) mpx_buffer[i] += block_left[i];
+        return 0;
+    }
+
+    // Clipping at the limiter threshold, stereo multiplex, pilot
+    int oversample = data->stereo_oversample > 2 ? 4 : data->stereo_oversample < 1 ? 1 : data->stereo_oversample;
+    if(enc.oversample != oversample) stereo_enc_init(&enc, oversample);
+    flags = stereo_enc_flags(&enc, stereo && !data->dstereo, data->composite_clip);
+    if(enc_run == NULL || flags != enc_flags) {
+        enc_run = stereo_enc_select(flags);
+        enc_flags = flags;
+    }
+    enc_run(&enc, block_left, block_right, mpx_buffer, length, data->limiter_threshold, data->composite_clip);
+    if(proc.bands) compressor_gain = proc.agc_gain;
+    else compressor_gain = compress ? 1/(kern.left_max+data->compressor_max_gain_recip) : 1;
     return 0;
 }
 
 
 int fm_mpx_close() {
-    if(sf_close(inf) ) {
+    if(decode_running) {
+        __atomic_store_n(&decode_stop, 1, __ATOMIC_RELEASE);
+        pthread_cancel(decode_thread); // May be blocked on an idle pipe
+        pthread_join(decode_thread, NULL);
+        decode_running = 0;
+        pcm_ring_free(&pcm);
+        free(decode_chunk);
+    }
+    if(playing_list) {
+        playlist_close(&list);
+        playing_list = 0;
+    }
+    if(inf != NULL && sf_close(inf) ) {
         fprintf(stderr, "Error closing audio file");
     }
     
     if(audio_buffer != NULL) free(audio_buffer);
+    free(block_left);
+    free(block_right);
+    free(composite_fir);
+    free(composite_line);
     
     return 0;
 }
+
+void fm_mpx_get_stats(fm_mpx_stats *stats) {
+    stats->pcm_fill = decode_running ? pcm_ring_available(&pcm) : 0;
+    stats->pcm_capacity = decode_running ? pcm_ring_capacity(&pcm) : 0;
+    stats->pcm_underruns = pcm_underruns;
+    stats->decode_reads = __atomic_load_n(&decode_reads, __ATOMIC_RELAXED);
+    __atomic_load(&decode_max_read_ms, &stats->decode_max_read_ms, __ATOMIC_RELAXED);
+    stats->compressor_gain = compressor_gain;
+    stats->track = playing_list ? list.current.index : -1;
+    // decode_done is set after decode_error, acquiring it first sees both
+    int done = __atomic_load_n(&decode_done, __ATOMIC_ACQUIRE);
+    stats->input_ended = done && !__atomic_load_n(&decode_error, __ATOMIC_ACQUIRE) && (!decode_running || pcm_ring_available(&pcm) == 0);
+    stats->in_rate = in_rate;
+    stats->frames_in = kern.frames_in;
+}
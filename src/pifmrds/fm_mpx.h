@@ -36,8 +36,43 @@ typedef struct {
     int paused;
     int generate_multiplex;
     float limiter_threshold;
+    int processor_bands;        // multiband AGC/compressor (audio_proc.h) : 0 off, 1 to 5 bands
+    float lookahead_ms;         // look-ahead limiter at limiter_threshold : 0 off
+    float composite_clip;       // stereo composite clipper level, 1 = 100% audio modulation : 0 off
+    int stereo_oversample;      // clipper oversampling (stereo_enc.h) : 1, 2 or 4
+    int wait_for_audio;         // offline rendering : wait for the decoder instead of sending silence
 } fm_mpx_data;
 
-int fm_mpx_open(char *filename, size_t len, int raw, double preemphasis, int rawSampleRate, int rawChannels, float cutoff_freq);
+// Fill levels and counters of the audio decode stage
+typedef struct {
+    size_t pcm_fill;            // decoded samples waiting in the PCM ring
+    size_t pcm_capacity;
+    unsigned long pcm_underruns; // input frames replaced by silence because the decoder was late
+    unsigned long decode_reads;
+    float decode_max_read_ms;   // longest single sf_read_float, SD card or stdin hiccups show here
+    float compressor_gain;      // linear, at the end of the last block, AGC gain with the multiband processor (read it from the thread calling fm_mpx_get_samples)
+    int track;                  // playlist index of the track being decoded, -1 without a playlist
+    int input_ended;            // raw input closed and all of it used, the rest would be silence
+    int in_rate;                // Hz, 0 without audio
+    unsigned long long frames_in; // input frames taken by the resampler, in_rate/228000 of the output samples exactly
+} fm_mpx_stats;
+
+#define RESAMPLER_FAST 0        // 32 taps, nearest of 32 phases
+#define RESAMPLER_BEST 1        // 64 taps, 256 phases interpolated, twice the stop band
+
+int fm_mpx_open(char *filename, size_t len, int raw, double preemphasis, int rawSampleRate, int rawChannels, float cutoff_freq, int resampler);
+#define COMPOSITE_FILE 0        // format from the file header
+#define COMPOSITE_S16 1         // raw 16 bits
+#define COMPOSITE_FLOAT 2       // raw native float
+
+// Ready made composite (mono, any rate libsndfile reads, or raw at rawSampleRate) resampled to 228 kHz
+// flat over the multiplex band in place of the audio stages: 1.0 is 100% modulation, RDS is added on
+// top unless disabled
+int fm_mpx_open_composite(char *filename, size_t len, int raw_format, int rawSampleRate);
+// Loops over a playlist (playlist.h), crossfade in seconds or 0 for gapless
+int fm_mpx_open_playlist(char *filename, size_t len, double preemphasis, float cutoff_freq, float crossfade, int resampler);
+// Async-signal-safe, the playlist is read again before the next track
+void fm_mpx_reload_playlist();
 int fm_mpx_get_samples(float *mpx_buffer, fm_mpx_data *data);
 int fm_mpx_close();
+void fm_mpx_get_stats(fm_mpx_stats *stats);
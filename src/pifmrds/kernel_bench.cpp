@@ -0,0 +1,341 @@
+/*
+    kernel_bench.cpp: cost per 228 kHz output sample of each mpx_kernel.h
+    instance against the same loop testing the flags on every sample, as
+    fm_mpx.c did before, with 44.1 kHz input. Likewise for the stereo_enc.h
+    instances, on audio peaking over the limiter threshold. Also checks both
+    give the same output, sample by sample over one second.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "mpx_kernel.h"
+#include "mpx_fir.h"
+#include "stereo_enc.h"
+
+#define OUTPUT_RATE   228000
+#define INPUT_RATE    44100
+#define BLOCK         1140      // 5 ms, as pi_fm_rds
+#define INPUT_LEN     0x10000
+#define THRESHOLD     0.9f      // limiter threshold of the stereo encoder
+#define COMPOSITE     0.9f      // composite clipper level
+
+static float input[INPUT_LEN];
+static int input_pos;
+
+static float fir_mono[2][(256+1)*64] __attribute__((aligned(16)));
+static float fir_stereo[2][(256+1)*2*64] __attribute__((aligned(16)));
+static float line[2*2*64];
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// As fm_mpx.c pops the PCM ring : about a block of frames at a time
+static int refill(mpx_kernel *k) {
+    int len = BLOCK - BLOCK % k->channels;
+    if(input_pos + len > INPUT_LEN) input_pos = 0;
+    k->frames = input + input_pos;
+    input_pos += len;
+    k->frame_index = 0;
+    k->frame_len = len;
+    return 0;
+}
+
+// The same audio path with every setting tested per sample
+static int __attribute__((noinline)) generic(mpx_kernel *k, unsigned flags, float *left, float *right, int n) {
+    int stereo = flags & MPX_KERNEL_STEREO;
+    int mute = flags & MPX_KERNEL_MUTE;
+    for(int i=0; i<n; i++) {
+        while(k->pos >= k->up) {
+            k->pos -= k->up;
+            k->frames_in++;
+            if(k->frame_len <= k->channels) {
+                if(k->refill(k) < 0) return -1;
+            } else {
+                k->frame_index += k->channels;
+                k->frame_len -= k->channels;
+            }
+            k->index++;
+            if(k->index >= k->taps) k->index = 0;
+            const float *frame = k->frames + k->frame_index;
+            if(stereo) {
+                k->line[2*k->index] = k->line[2*(k->index+k->taps)] = frame[0];
+                k->line[2*k->index+1] = k->line[2*(k->index+k->taps)+1] = frame[1];
+            } else {
+                k->line[k->index] = k->line[k->index+k->taps] = frame[0];
+            }
+        }
+        float out_left = 0, out_right = 0;
+        int scaled = k->pos * k->phases;
+        int iphase = scaled / k->up;
+        if(stereo) mpx_fir_stereo(k->line + 2*(k->index+1), k->fir_stereo + iphase*2*k->taps, k->taps, &out_left, &out_right);
+        else out_left = mpx_fir_mono(k->line + k->index+1, k->fir_mono + iphase*k->taps, k->taps);
+        if((flags & MPX_KERNEL_INTERPOLATE) && scaled % k->up) {
+            float next_left = 0, next_right = 0;
+            float frac = (float)(scaled % k->up) / k->up;
+            if(stereo) mpx_fir_stereo(k->line + 2*(k->index+1), k->fir_stereo + (iphase+1)*2*k->taps, k->taps, &next_left, &next_right);
+            else next_left = mpx_fir_mono(k->line + k->index+1, k->fir_mono + (iphase+1)*k->taps, k->taps);
+            out_left += (next_left - out_left) * frac;
+            out_right += (next_right - out_right) * frac;
+        }
+        out_left *= k->gain;
+        if(stereo) out_right *= k->gain;
+        float left_abs = fabsf(out_left);
+        if(left_abs > k->left_max) k->left_max += (left_abs-k->left_max)*k->attack;
+        else k->left_max *= k->decay;
+        if(stereo) {
+            float right_abs = fabsf(out_right);
+            if(right_abs > k->right_max) k->right_max += (right_abs-k->right_max)*k->attack;
+            else k->right_max *= k->decay;
+            if(k->left_max > k->right_max) k->right_max = k->left_max;
+            else if(k->left_max < k->right_max) k->left_max = k->right_max;
+            if(flags & MPX_KERNEL_COMPRESS) out_right = out_right/(k->right_max+k->max_gain_recip);
+        }
+        if(flags & MPX_KERNEL_COMPRESS) out_left = out_left/(k->left_max+k->max_gain_recip);
+        if(mute) {
+            out_left = 0;
+            out_right = 0;
+        }
+        left[i] = out_left;
+        if(stereo) right[i] = out_right;
+        k->pos += k->down;
+    }
+    return 0;
+}
+
+static void setup(mpx_kernel *k, unsigned flags) {
+    int best = (flags & MPX_KERNEL_INTERPOLATE) && !(flags & MPX_KERNEL_MUTE);
+    k->up = 760;
+    k->down = 147;
+    k->pos = k->up;
+    k->frames_in = 0;
+    k->taps = best ? 64 : 32;
+    k->phases = best ? 256 : 32;
+    k->fir_mono = fir_mono[best];
+    k->fir_stereo = fir_stereo[best];
+    k->line = line;
+    k->index = 0;
+    k->frames = input;
+    k->frame_index = k->frame_len = 0;
+    k->channels = flags & MPX_KERNEL_STEREO ? 2 : 1;
+    k->refill = refill;
+    k->gain = 1;
+    k->attack = 1.0;
+    k->decay = 0.999995;
+    k->max_gain_recip = 0.01;
+    k->left_max = k->right_max = 0;
+    for(int i=0; i<2*2*64; i++) line[i] = 0;
+    input_pos = 0;
+}
+
+// ns per output sample over count samples
+static double run(unsigned flags, int specialized, int count) {
+    static float left[BLOCK], right[BLOCK];
+    mpx_kernel k;
+    setup(&k, flags);
+    mpx_kernel_fn kernel = mpx_kernel_select(flags);
+    double start = now();
+    for(int done=0; done<count; done+=BLOCK) {
+        if(specialized) kernel(&k, left, right, BLOCK);
+        else generic(&k, flags, left, right, BLOCK);
+    }
+    double elapsed = now() - start;
+    return elapsed*1e9/count;
+}
+
+// Largest difference between the two over every output sample of count, both channels
+static double compare(unsigned flags, int count) {
+    float *out = (float *)calloc(4 * count, sizeof(float));
+    mpx_kernel k;
+    for(int specialized=0; specialized<2; specialized++) {
+        float *left = out + 2*specialized*count, *right = left + count;
+        setup(&k, flags);
+        mpx_kernel_fn kernel = mpx_kernel_select(flags);
+        for(int done=0; done<count; done+=BLOCK) {
+            if(specialized) kernel(&k, left+done, right+done, BLOCK);
+            else generic(&k, flags, left+done, right+done, BLOCK);
+        }
+    }
+    double diff = 0;
+    for(int i=0; i<2*count; i++) diff = fmax(diff, fabs(out[i] - out[2*count+i]));
+    free(out);
+    return diff;
+}
+
+// The stereo encoder with every setting tested per sample, as stereo_enc.c was
+static inline float clip_error(float x, float threshold) {
+    if(x > threshold) return threshold - x;
+    if(x < -threshold) return -threshold - x;
+    return 0;
+}
+
+static inline float biquad_run(stereo_biquad *f, float x) {
+    float y = f->b0*x + f->z1;
+    f->z1 = f->b1*x - f->a1*y + f->z2;
+    f->z2 = f->b2*x - f->a2*y;
+    return y;
+}
+
+static inline void scatter(stereo_enc *e, float *corr, unsigned tau, int p, float err) {
+    const float *h = e->error_filter[p];
+    unsigned base = tau - STEREO_ENC_DELAY;
+    for(int j=0; j<=2*STEREO_ENC_DELAY; j++) corr[(base + j) & (STEREO_ENC_RING-1)] += err * h[j];
+}
+
+static void __attribute__((noinline)) generic_enc(stereo_enc *e, const float *left, const float *right, float *mpx, int n,
+    int stereo, float threshold, float composite_clip) {
+    const unsigned mask = STEREO_ENC_RING-1;
+    int channels = stereo ? 2 : 1;
+    int os = e->oversample;
+    int budget = n*channels/4;    // CLIP_BUDGET
+    float full_scale = threshold > 1 ? threshold : 1;
+    int composite = stereo && composite_clip > 0;
+    for(int i=0; i<n; i++) {
+        unsigned t = e->count++;
+        e->x[0][t & mask] = left[i];
+        e->x[1][t & mask] = stereo ? right[i] : 0;
+        unsigned tau = t - STEREO_ENC_INTERP;
+        unsigned u = tau - STEREO_ENC_DELAY;
+        float y[2];
+        for(int c=0; c<channels; c++) {
+            float *x = e->x[c];
+            float *corr = e->corr[c];
+            float now = x[tau & mask];
+            float err = clip_error(now, threshold);
+            if(err != 0 && budget > 0) {
+                scatter(e, corr, tau, 0, err);
+                budget--;
+                e->clipped++;
+            }
+            if(os > 1 && (fabsf(now) > 0.7f*threshold || fabsf(x[(tau+1) & mask]) > 0.7f*threshold)) {
+                for(int p=1; p<os; p++) {
+                    float between = 0;
+                    for(int k=0; k<2*STEREO_ENC_INTERP; k++) between += e->interp[p][k] * x[(tau - (STEREO_ENC_INTERP-1) + k) & mask];
+                    err = clip_error(between, threshold);
+                    if(err != 0 && budget > 0) {
+                        scatter(e, corr, tau, p, err);
+                        budget--;
+                    }
+                }
+            }
+            y[c] = x[u & mask] + corr[u & mask];
+            corr[u & mask] = 0;
+            if(!composite && fabsf(y[c]) > full_scale) {
+                y[c] = y[c] > 0 ? full_scale : -full_scale;
+                e->hard_clipped++;
+            }
+        }
+        if(stereo) {
+            float c19 = e->sine[e->phase];
+            float c38 = e->sine[(2*e->phase) % 12];
+            float audio = 4.5f*(y[0]+y[1]) + 4.5f*c38*(y[0]-y[1]);
+            if(composite) {
+                float err = clip_error(audio, 9*composite_clip);
+                err = biquad_run(&e->protect[0], err);
+                err = biquad_run(&e->protect[1], err);
+                err = biquad_run(&e->protect[2], err);
+                audio += err;
+            }
+            mpx[i] += audio + 0.9f*c19;
+        } else {
+            mpx[i] += 4.5f*y[0];
+        }
+        if(++e->phase == 12) e->phase = 0;
+    }
+    for(int k=0; k<3; k++) {
+        if(fabsf(e->protect[k].z1) < 1e-20f) e->protect[k].z1 = 0;
+        if(fabsf(e->protect[k].z2) < 1e-20f) e->protect[k].z2 = 0;
+    }
+}
+
+// 228 kHz L and R for the encoder : tones a little over the threshold, with some noise
+static float enc_left[OUTPUT_RATE], enc_right[OUTPUT_RATE];
+
+// Encodes count samples into mpx (count of them, or a block reused), returns ns per sample
+static double encode(unsigned flags, int specialized, int count, float *mpx, int reuse) {
+    static stereo_enc e;
+    stereo_enc_init(&e, flags & STEREO_ENC_OVERSAMPLE ? 4 : 1);
+    int stereo = flags & STEREO_ENC_STEREO;
+    float composite_clip = flags & STEREO_ENC_COMPOSITE ? COMPOSITE : 0;
+    stereo_enc_fn enc = stereo_enc_select(stereo_enc_flags(&e, stereo, composite_clip));
+    double start = now();
+    for(int done=0; done<count; done+=BLOCK) {
+        int at = done % (OUTPUT_RATE - OUTPUT_RATE % BLOCK);
+        float *out = reuse ? mpx : mpx + done;
+        if(specialized) enc(&e, enc_left+at, enc_right+at, out, BLOCK, THRESHOLD, composite_clip);
+        else generic_enc(&e, enc_left+at, enc_right+at, out, BLOCK, stereo, THRESHOLD, composite_clip);
+    }
+    return (now() - start)*1e9/count;
+}
+
+static double compare_enc(unsigned flags, int count) {
+    float *mpx = (float *)calloc(2 * count, sizeof(float));
+    encode(flags, 0, count, mpx, 0);
+    encode(flags, 1, count, mpx + count, 0);
+    double diff = 0;
+    for(int i=0; i<count; i++) diff = fmax(diff, fabs(mpx[i] - mpx[count+i]));
+    free(mpx);
+    return diff;
+}
+
+static void make_filter(int best) {
+    int taps = best ? 64 : 32, phases = best ? 256 : 32;
+    for(int j=0; j<=phases; j++) {
+        for(int i=0; i<taps; i++) {
+            double x = i*phases + j + 1 - (taps*phases+1.0)/2.0;
+            float c = sin(2*M_PI*15000*x/(INPUT_RATE*phases))/(M_PI*x) * 0.08/32;
+            fir_mono[best][j*taps + taps-1-i] = c;
+            fir_stereo[best][j*2*taps + 2*(taps-1-i)] = fir_stereo[best][j*2*taps + 2*(taps-1-i)+1] = c;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    double seconds = (argc > 1) ? atof(argv[1]) : 10; // of 228 kHz output
+    int count = (int)(seconds*OUTPUT_RATE);
+    srand(1);
+    for(int i=0; i<INPUT_LEN; i++) input[i] = (rand()%20001-10000)/10000.0f;
+    make_filter(0);
+    make_filter(1);
+
+    printf("fm_mpx audio path, %d -> %d Hz, %.0f s of output, per-sample tests against the template instances\n",
+        INPUT_RATE, OUTPUT_RATE, seconds);
+    for(unsigned flags=0; flags<MPX_KERNEL_VARIANTS; flags++) {
+        // Muted, interpolation and compressor make no difference
+        if((flags & MPX_KERNEL_MUTE) && (flags & (MPX_KERNEL_INTERPOLATE | MPX_KERNEL_COMPRESS))) continue;
+        char name[64];
+        snprintf(name, sizeof(name), "%s%s%s%s", flags & MPX_KERNEL_STEREO ? "stereo" : "mono",
+            flags & MPX_KERNEL_INTERPOLATE ? " best" : "", flags & MPX_KERNEL_COMPRESS ? " compressed" : "",
+            flags & MPX_KERNEL_MUTE ? " muted" : "");
+        double before = run(flags, 0, count);
+        double after = run(flags, 1, count);
+        printf("%-24s : tested %6.2f ns/sample (%5.2f%% of a core), instance %6.2f ns/sample (%5.2f%%), x%.2f, max output diff %.2g\n",
+            name, before, before*OUTPUT_RATE*1e-7, after, after*OUTPUT_RATE*1e-7, before/after,
+            compare(flags, OUTPUT_RATE - OUTPUT_RATE % BLOCK));
+    }
+
+    for(int i=0; i<OUTPUT_RATE; i++) {
+        enc_left[i] = 0.95f*sin(2*M_PI*1000*i/OUTPUT_RATE) + 0.05f*input[i % INPUT_LEN];
+        enc_right[i] = 0.95f*sin(2*M_PI*1500*i/OUTPUT_RATE) + 0.05f*input[(i+7) % INPUT_LEN];
+    }
+    printf("stereo encoder, threshold %.2f, per-sample tests against the template instances\n", THRESHOLD);
+    static float mpx[BLOCK];
+    for(unsigned flags=0; flags<STEREO_ENC_VARIANTS; flags++) {
+        // The composite clipper is stereo only
+        if((flags & STEREO_ENC_COMPOSITE) && !(flags & STEREO_ENC_STEREO)) continue;
+        char name[64];
+        snprintf(name, sizeof(name), "%s%s%s", flags & STEREO_ENC_STEREO ? "stereo" : "mono",
+            flags & STEREO_ENC_COMPOSITE ? " composite" : "", flags & STEREO_ENC_OVERSAMPLE ? " oversample 4" : "");
+        double before = encode(flags, 0, count, mpx, 1);
+        double after = encode(flags, 1, count, mpx, 1);
+        printf("%-30s : tested %6.2f ns/sample (%5.2f%% of a core), instance %6.2f ns/sample (%5.2f%%), x%.2f, max output diff %.2g\n",
+            name, before, before*OUTPUT_RATE*1e-7, after, after*OUTPUT_RATE*1e-7, before/after,
+            compare_enc(flags, OUTPUT_RATE - OUTPUT_RATE % BLOCK));
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+    mpx_bench.c: cost per 228 kHz output sample of the fm_mpx audio FIR,
+    former masked circular buffer loop against the mpx_fir.h kernels, in mono
+    and stereo, with 44.1 kHz input. Also checks both give the same output.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "mpx_fir.h"
+
+#define FIR_PHASES    (32)
+#define FIR_TAPS      (32)
+#define OUTPUT_RATE   228000
+#define INPUT_RATE    44100
+
+float low_pass_fir[FIR_PHASES][FIR_TAPS];
+float low_pass_fir_mono[FIR_PHASES][FIR_TAPS] __attribute__((aligned(16)));
+float low_pass_fir_stereo[FIR_PHASES][2*FIR_TAPS] __attribute__((aligned(16)));
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// Runs Count output samples, returns ns per output sample, sum of the outputs in *check
+static double run(int stereo, int legacy, const float *audio, int count, double *check) {
+    float fir_buffer_left[FIR_TAPS] = {0}, fir_buffer_right[FIR_TAPS] = {0};
+    float fir_line[2*2*FIR_TAPS] = {0};
+    int fir_index = 0, audio_index = 0;
+    float downsample_factor = (float)OUTPUT_RATE/INPUT_RATE;
+    float audio_pos = downsample_factor;
+    double sum = 0;
+    double start = now();
+    for(int i=0; i<count; i++) {
+        if(audio_pos >= downsample_factor) {
+            audio_pos -= downsample_factor;
+            float l = audio[(audio_index*2) & 0xFFFF], r = audio[(audio_index*2+1) & 0xFFFF];
+            audio_index++;
+            fir_index++;
+            if(fir_index >= FIR_TAPS) fir_index = 0;
+            if(legacy) {
+                fir_buffer_left[fir_index] = l;
+                fir_buffer_right[fir_index] = r;
+            } else if(stereo) {
+                fir_line[2*fir_index] = fir_line[2*(fir_index+FIR_TAPS)] = l;
+                fir_line[2*fir_index+1] = fir_line[2*(fir_index+FIR_TAPS)+1] = r;
+            } else {
+                fir_line[fir_index] = fir_line[fir_index+FIR_TAPS] = l;
+            }
+        }
+        int iphase = (int)(audio_pos*FIR_PHASES/downsample_factor);
+        if(iphase >= FIR_PHASES) iphase = FIR_PHASES-1;
+        float out_left = 0, out_right = 0;
+        if(legacy) {
+            if(stereo) {
+                for(int fi=0; fi<FIR_TAPS; fi++) {
+                    out_left += low_pass_fir[iphase][fi]*fir_buffer_left[(fir_index-fi)&(FIR_TAPS-1)];
+                    out_right += low_pass_fir[iphase][fi]*fir_buffer_right[(fir_index-fi)&(FIR_TAPS-1)];
+                }
+            } else {
+                for(int fi=0; fi<FIR_TAPS; fi++)
+                    out_left += low_pass_fir[iphase][fi]*fir_buffer_left[(fir_index-fi)&(FIR_TAPS-1)];
+            }
+        } else {
+            if(stereo)
+                mpx_fir_stereo(fir_line + 2*(fir_index+1), low_pass_fir_stereo[iphase], FIR_TAPS, &out_left, &out_right);
+            else
+                out_left = mpx_fir_mono(fir_line + fir_index+1, low_pass_fir_mono[iphase], FIR_TAPS);
+        }
+        sum += out_left + 0.5*out_right;
+        audio_pos++;
+    }
+    double elapsed = now() - start;
+    *check = sum;
+    return elapsed*1e9/count;
+}
+
+int main(int argc, char **argv) {
+    double seconds = (argc > 1) ? atof(argv[1]) : 10; // of 228 kHz output
+    int count = (int)(seconds*OUTPUT_RATE);
+    float *audio = malloc(0x10000*sizeof(float));
+    srand(1);
+    for(int i=0; i<0x10000; i++) audio[i] = (rand()%20001-10000)/10000.0f;
+    for(int j=0; j<FIR_PHASES; j++) {
+        for(int i=0; i<FIR_TAPS; i++) {
+            double x = i*FIR_PHASES + j + 1 - (FIR_TAPS*FIR_PHASES+1.0)/2.0;
+            low_pass_fir[j][i] = sin(2*M_PI*15000*x/(INPUT_RATE*FIR_PHASES))/(M_PI*x);
+        }
+        for(int i=0; i<FIR_TAPS; i++) {
+            low_pass_fir_mono[j][i] = low_pass_fir[j][FIR_TAPS-1-i];
+            low_pass_fir_stereo[j][2*i] = low_pass_fir_stereo[j][2*i+1] = low_pass_fir[j][FIR_TAPS-1-i];
+        }
+    }
+#if defined(MPX_FIR_NEON)
+    const char *kernel = "neon";
+#elif defined(MPX_FIR_SSE2)
+    const char *kernel = "sse2";
+#else
+    const char *kernel = "scalar";
+#endif
+    printf("fm_mpx audio FIR, %d taps x %d phases, %d -> %d Hz, %.0f s of output, %s kernel\n",
+        FIR_TAPS, FIR_PHASES, INPUT_RATE, OUTPUT_RATE, seconds, kernel);
+    for(int stereo=0; stereo<2; stereo++) {
+        double check_legacy, check_new;
+        double legacy = run(stereo, 1, audio, count, &check_legacy);
+        double fast = run(stereo, 0, audio, count, &check_new);
+        printf("%-6s : before %6.2f ns/sample (%5.2f%% of a core), after %6.2f ns/sample (%5.2f%%), x%.2f, output diff %.2g\n",
+            stereo ? "stereo" : "mono", legacy, legacy*OUTPUT_RATE*1e-7, fast, fast*OUTPUT_RATE*1e-7, legacy/fast,
+            fabs(check_legacy-check_new)/(fabs(check_legacy)+1e-9));
+    }
+    free(audio);
+    return 0;
+}
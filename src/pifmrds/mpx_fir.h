@@ -0,0 +1,93 @@
+/*
+    mpx_fir.h: polyphase FIR kernels of fm_mpx.c
+
+    One call filters one output sample : dot product of a filter phase against
+    the last FIR_TAPS input samples. The delay line is doubled (each sample is
+    written at i and i+FIR_TAPS) so that this window is always contiguous,
+    oldest sample first, and the coefficients are stored reversed to match.
+    In stereo the samples are interleaved L,R and every coefficient is
+    duplicated, so a single pass filters both channels.
+    NEON or SSE2 when available, otherwise 4 independent accumulators which
+    keeps the VFP pipeline of the Pi Zero busy.
+*/
+
+#ifndef MPX_FIR_H
+#define MPX_FIR_H
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MPX_FIR_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MPX_FIR_SSE2
+#endif
+
+// x : FIR_TAPS samples, c : FIR_TAPS reversed coefficients (taps multiple of 4)
+static inline float mpx_fir_mono(const float *x, const float *c, int taps) {
+#if defined(MPX_FIR_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    for(int i=0; i<taps; i+=8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(x+i), vld1q_f32(c+i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(x+i+4), vld1q_f32(c+i+4));
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+    float32x2_t s = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#elif defined(MPX_FIR_SSE2)
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    for(int i=0; i<taps; i+=8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x+i), _mm_load_ps(c+i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x+i+4), _mm_load_ps(c+i+4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    return _mm_cvtss_f32(acc0);
+#else
+    float a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+    for(int i=0; i<taps; i+=4) {
+        a0 += x[i]*c[i];
+        a1 += x[i+1]*c[i+1];
+        a2 += x[i+2]*c[i+2];
+        a3 += x[i+3]*c[i+3];
+    }
+    return (a0+a1)+(a2+a3);
+#endif
+}
+
+// x : FIR_TAPS interleaved L,R samples, c : 2*FIR_TAPS reversed duplicated coefficients
+static inline void mpx_fir_stereo(const float *x, const float *c, int taps, float *left, float *right) {
+#if defined(MPX_FIR_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    for(int i=0; i<2*taps; i+=8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(x+i), vld1q_f32(c+i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(x+i+4), vld1q_f32(c+i+4));
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+    float32x2_t s = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0)); // L,R
+    *left = vget_lane_f32(s, 0);
+    *right = vget_lane_f32(s, 1);
+#elif defined(MPX_FIR_SSE2)
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    for(int i=0; i<2*taps; i+=8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x+i), _mm_load_ps(c+i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x+i+4), _mm_load_ps(c+i+4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0)); // L,R in the low lanes
+    *left = _mm_cvtss_f32(acc0);
+    *right = _mm_cvtss_f32(_mm_shuffle_ps(acc0, acc0, 1));
+#else
+    float l0 = 0, r0 = 0, l1 = 0, r1 = 0;
+    for(int i=0; i<2*taps; i+=4) {
+        l0 += x[i]*c[i];
+        r0 += x[i+1]*c[i+1];
+        l1 += x[i+2]*c[i+2];
+        r1 += x[i+3]*c[i+3];
+    }
+    *left = l0+l1;
+    *right = r0+r1;
+#endif
+}
+
+#endif
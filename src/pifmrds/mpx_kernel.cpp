@@ -0,0 +1,118 @@
+/*
+    mpx_kernel.cpp: the instances of the fm_mpx.c audio path, see mpx_kernel.h
+*/
+
+#include <math.h>
+
+#include "mpx_kernel.h"
+#include "mpx_fir.h"
+
+template<unsigned Flags> static int run(mpx_kernel *k, float *left, float *right, int n) {
+    const bool stereo = Flags & MPX_KERNEL_STEREO;
+    const bool mute = Flags & MPX_KERNEL_MUTE;
+    const bool interpolate = !mute && (Flags & MPX_KERNEL_INTERPOLATE);
+    const bool compress = !mute && (Flags & MPX_KERNEL_COMPRESS);
+
+    const int up = k->up, down = k->down, taps = k->taps, phases = k->phases, channels = k->channels;
+    int pos = k->pos, index = k->index;
+    float *line = k->line;
+    const float gain = k->gain, attack = k->attack, decay = k->decay, recip = k->max_gain_recip;
+    float left_max = k->left_max, right_max = k->right_max;
+
+    for(int i=0; i<n; i++) {
+        while(pos >= up) {  // more than once when decimating
+            pos -= up;
+            k->frames_in++;
+            if(k->frame_len <= channels) {
+                if(k->refill(k) < 0) {
+                    k->pos = pos;
+                    k->index = index;
+                    return -1;
+                }
+            } else {
+                k->frame_index += channels;
+                k->frame_len -= channels;
+            }
+
+            index++;  // index will point to newest valid data soon
+            if(index >= taps) index = 0;
+            // Store the current sample(s) twice into the FIR filter's delay line
+            const float *frame = k->frames + k->frame_index;
+            if(stereo) {
+                line[2*index] = line[2*(index+taps)] = frame[0];
+                line[2*index+1] = line[2*(index+taps)+1] = frame[1];
+            } else {
+                line[index] = line[index+taps] = frame[0];
+            }
+        }
+
+        if(mute) {
+            left[i] = 0;
+            if(stereo) right[i] = 0;
+            pos += down;
+            continue;
+        }
+
+        // Polyphase FIR filter. Which phase to use, and how far towards the next one
+        float out_left = 0, out_right = 0;
+        int scaled = pos * phases;
+        int iphase = scaled / up;
+        // The last taps samples start right after the newest one in the doubled line
+        if(stereo) mpx_fir_stereo(line + 2*(index+1), k->fir_stereo + iphase*2*taps, taps, &out_left, &out_right);
+        else out_left = mpx_fir_mono(line + index+1, k->fir_mono + iphase*taps, taps);
+        if(interpolate && scaled % up) {
+            float next_left = 0, next_right = 0;
+            float frac = (float)(scaled % up) / up;
+            if(stereo) mpx_fir_stereo(line + 2*(index+1), k->fir_stereo + (iphase+1)*2*taps, taps, &next_left, &next_right);
+            else next_left = mpx_fir_mono(line + index+1, k->fir_mono + (iphase+1)*taps, taps);
+            out_left += (next_left - out_left) * frac;
+            out_right += (next_right - out_right) * frac;
+        }
+
+        out_left *= gain;
+        if(stereo) out_right *= gain;
+
+        if(compress) {
+            // Simple broadcast compressor
+            //
+            // The goal is to get the loudest sounding audio while
+            // keeping the deviation within legal limits, and
+            // without degrading the audio quality significantly.
+            // Don't expect this simple code to match the
+            // performance of commercial broadcast equipment.
+            // Setting attack to anything other than 1.0 could cause overshoot.
+            float left_abs = fabsf(out_left);
+            if(left_abs > left_max) left_max += (left_abs-left_max)*attack;
+            else left_max *= decay;
+            if(stereo) {
+                float right_abs = fabsf(out_right);
+                if(right_abs > right_max) right_max += (right_abs-right_max)*attack;
+                else right_max *= decay;
+                // Joint compressor, the louder channel sets the gain of both
+                if(left_max > right_max) right_max = left_max;
+                else if(left_max < right_max) left_max = right_max;
+                out_right = out_right/(right_max+recip); // Adjust volume with limited maximum gain
+            }
+            out_left = out_left/(left_max+recip);
+        }
+
+        left[i] = out_left;
+        if(stereo) right[i] = out_right;
+        pos += down;
+    }
+
+    k->pos = pos;
+    k->index = index;
+    k->left_max = left_max;
+    k->right_max = right_max;
+    return 0;
+}
+
+static const mpx_kernel_fn variants[MPX_KERNEL_VARIANTS] = {
+    run<0>, run<1>, run<2>, run<3>, run<4>, run<5>, run<6>, run<7>,
+    run<8>, run<9>, run<10>, run<11>, run<12>, run<13>, run<14>, run<15>,
+};
+
+mpx_kernel_fn mpx_kernel_select(unsigned flags) {
+    return variants[flags % MPX_KERNEL_VARIANTS];
+}
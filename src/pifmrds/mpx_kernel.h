@@ -0,0 +1,58 @@
+/*
+    mpx_kernel.h: per-sample audio path of fm_mpx.c, from the decoded input
+    frames to the 228 kHz left and right given to the stereo encoder: rational
+    resampler with the polyphase FIR (mpx_fir.h), gain and wideband compressor.
+
+    Every combination of the MPX_KERNEL_ flags is its own instance of one C++
+    template (mpx_kernel.cpp), so the loop carries no test of a setting.
+    fm_mpx.c works the flags out of the control state once per block, and only
+    looks up another instance when they change.
+    MPX_KERNEL_MUTE (paused, multiplex off) takes the input at the same pace
+    and keeps the delay line filled, but filters nothing and outputs silence.
+*/
+
+#ifndef MPX_KERNEL_H
+#define MPX_KERNEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MPX_KERNEL_STEREO       1   // interleaved L,R in, both out ; otherwise mono, left only
+#define MPX_KERNEL_INTERPOLATE  2   // linear interpolation between FIR phases (resampler best)
+#define MPX_KERNEL_COMPRESS     4   // wideband compressor after the gain
+#define MPX_KERNEL_MUTE         8   // silence out, input consumed ; ignores INTERPOLATE and COMPRESS
+#define MPX_KERNEL_VARIANTS     16
+
+typedef struct mpx_kernel mpx_kernel;
+
+struct mpx_kernel {
+    // Rational resampler : the newest input frame is pos/up input periods old, down > up decimates
+    int up, down, pos;
+    unsigned long long frames_in;
+    int taps, phases;
+    const float *fir_mono;      // (phases+1) reversed phases of taps, see mpx_fir.h
+    const float *fir_stereo;    // same with every coefficient duplicated
+    float *line;                // doubled delay line, 2*2*taps
+    int index;                  // newest sample in the delay line
+    // Decoded input, interleaved. len counts the samples left from index, the current frame included.
+    const float *frames;
+    int frame_index, frame_len;
+    int channels;
+    int (*refill)(mpx_kernel *k); // new frames (frame_index 0), -1 when the input failed
+    // Level
+    float gain;
+    float attack, decay, max_gain_recip;
+    float left_max, right_max;  // compressor envelopes
+};
+
+// Fills n samples of left (and right in stereo), 0 or -1 from refill
+typedef int (*mpx_kernel_fn)(mpx_kernel *k, float *left, float *right, int n);
+
+mpx_kernel_fn mpx_kernel_select(unsigned flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+/*
+    mpx_purity.c: spectral purity of the stereo multiplex around the pilot and
+    in the RDS band, with clipping audio. Band-limited noise over the limiter
+    threshold is encoded by the former per-channel hard clip with the carrier
+    tables, and by stereo_enc.h at each oversampling factor. The power that lands
+    in 18-20 kHz and 54-60 kHz is given relative to the audio in 0-15 kHz (pilot
+    taken out), along with the cost per 228 kHz sample.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "stereo_enc.h"
+
+#define RATE        228000
+#define SAMPLES     (1<<20)
+#define BLOCK       1140        // pi_fm_rds MPX block
+#define FFT_SIZE    8192
+#define THRESHOLD   0.9f
+#define NOISE_TAPS  511
+
+// Pass if the pilot and RDS bands stay this far under the audio
+#define PROTECTION_DB       60
+#define COMPOSITE_PROTECTION_DB 55 // composite clipper, the 9 kHz notch widths let more through
+
+static float left[SAMPLES], right[SAMPLES], mpx[SAMPLES];
+static stereo_enc enc;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void fft(double *re, double *im, int n) {
+    for(int i=1, j=0; i<n; i++) {
+        int bit = n >> 1;
+        for(; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if(i < j) {
+            double t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for(int len=2; len<=n; len<<=1) {
+        double a = -2*M_PI/len;
+        for(int i=0; i<n; i+=len) {
+            for(int k=0; k<len/2; k++) {
+                double wr = cos(a*k), wi = sin(a*k);
+                double xr = re[i+k+len/2]*wr - im[i+k+len/2]*wi;
+                double xi = re[i+k+len/2]*wi + im[i+k+len/2]*wr;
+                re[i+k+len/2] = re[i+k] - xr;
+                im[i+k+len/2] = im[i+k] - xi;
+                re[i+k] += xr;
+                im[i+k] += xi;
+            }
+        }
+    }
+}
+
+// Welch power spectrum of x, band powers from it
+static double psd[FFT_SIZE/2];
+
+static void spectrum(const float *x, int n) {
+    static double re[FFT_SIZE], im[FFT_SIZE];
+    memset(psd, 0, sizeof(psd));
+    for(int start=0; start+FFT_SIZE<=n; start+=FFT_SIZE/2) {
+        for(int i=0; i<FFT_SIZE; i++) {
+            re[i] = x[start+i] * (0.5 - 0.5*cos(2*M_PI*i/FFT_SIZE));
+            im[i] = 0;
+        }
+        fft(re, im, FFT_SIZE);
+        for(int i=0; i<FFT_SIZE/2; i++) psd[i] += re[i]*re[i] + im[i]*im[i];
+    }
+}
+
+static double band(double low, double high) {
+    double sum = 0;
+    for(int i=(int)(low*FFT_SIZE/RATE); i<=(int)(high*FFT_SIZE/RATE); i++) sum += psd[i];
+    return sum;
+}
+
+// Former fm_mpx.c stereo generation : limiter and clip per channel, 12 and 6 entry carrier tables
+static float carrier_38[] = {0.0, 0.8660254037844386, 0.8660254037844388, 1.2246467991473532e-16, -0.8660254037844384, -0.8660254037844386};
+
+static void legacy(float *out, int n) {
+    int phase_38 = 0;
+    for(int i=0; i<n; i++) {
+        float l = left[i], r = right[i];
+        if(fabsf(l) > THRESHOLD) l = l > 0 ? THRESHOLD : -THRESHOLD;
+        if(fabsf(r) > THRESHOLD) r = r > 0 ? THRESHOLD : -THRESHOLD;
+        out[i] = 4.5*(l+r) + 4.5*carrier_38[phase_38]*(l-r);
+        if(++phase_38 >= 6) phase_38 = 0;
+    }
+}
+
+// Runs the encoder over the whole signal, leaves the multiplex without the pilot in mpx.
+// Without protect the composite clip error goes through unfiltered.
+static double encode(int oversample, float composite_clip, float threshold, int protect) {
+    stereo_enc_init(&enc, oversample);
+    if(!protect) for(int k=0; k<3; k++) enc.protect[k] = (stereo_biquad){1, 0, 0, 0, 0, 0, 0};
+    memset(mpx, 0, sizeof(mpx));
+    double start = now();
+    for(int i=0; i<SAMPLES; i+=BLOCK) {
+        int n = SAMPLES-i < BLOCK ? SAMPLES-i : BLOCK;
+        stereo_enc_process(&enc, left+i, right+i, mpx+i, n, 1, threshold, composite_clip);
+    }
+    double took = (now() - start)*1e9/SAMPLES;
+    for(int i=0; i<SAMPLES; i++) mpx[i] -= 0.9f*enc.sine[i % 12];
+    return took;
+}
+
+static int failures = 0;
+
+static void report(const char *name, double ns, int check, double protection) {
+    double audio = band(20, 15000);
+    double pilot = 10*log10(band(18000, 20000)/audio);
+    double rds = 10*log10(band(54000, 60000)/audio);
+    int ok = pilot < -protection && rds < -protection;
+    printf("%-26s pilot band %6.1f dB   RDS band %6.1f dB   %6.1f ns/sample %s\n", name, pilot, rds, ns,
+        check ? (ok ? "ok" : "FAILED") : "");
+    if(check && !ok) failures++;
+}
+
+int main() {
+    // Uncorrelated L and R : white noise through a 15 kHz windowed sinc, peaks well over the threshold
+    static float h[NOISE_TAPS];
+    static float noise[SAMPLES + NOISE_TAPS];
+    srand(1);
+    for(int k=0; k<NOISE_TAPS; k++) {
+        double t = k - NOISE_TAPS/2;
+        double sinc = t == 0 ? 1 : sin(2*M_PI*14500./RATE*t)/(2*M_PI*14500./RATE*t);
+        h[k] = sinc * (0.42 - 0.5*cos(2*M_PI*k/(NOISE_TAPS-1)) + 0.08*cos(4*M_PI*k/(NOISE_TAPS-1)));
+    }
+    for(int c=0; c<2; c++) {
+        float *out = c ? right : left;
+        for(int i=0; i<SAMPLES+NOISE_TAPS; i++) noise[i] = (double)rand()/RAND_MAX - 0.5;
+        double power = 0;
+        for(int i=0; i<SAMPLES; i++) {
+            double acc = 0;
+            for(int k=0; k<NOISE_TAPS; k++) acc += h[k]*noise[i+k];
+            out[i] = acc;
+            power += acc*acc;
+        }
+        float scale = 0.3/sqrt(power/SAMPLES); // about 0.3% of the samples over 0.9
+        for(int i=0; i<SAMPLES; i++) out[i] *= scale;
+    }
+
+    double start = now();
+    legacy(mpx, SAMPLES);
+    double ns = (now() - start)*1e9/SAMPLES;
+    spectrum(mpx, SAMPLES);
+    report("hard clip, carrier tables", ns, 0, 0);
+
+    for(int os=1; os<=STEREO_ENC_MAX_OVERSAMPLE; os*=2) {
+        char name[64];
+        ns = encode(os, 0, THRESHOLD, 1);
+        spectrum(mpx, SAMPLES);
+        snprintf(name, sizeof(name), "band-limited, x%d", os);
+        report(name, ns, 1, PROTECTION_DB);
+        printf("%26s %lu clipped, %lu over full scale\n", "", enc.clipped, enc.hard_clipped);
+    }
+
+    // Composite clipper : L and R allowed over full scale, the composite clipped at 100%
+    for(int i=0; i<SAMPLES; i++) {
+        left[i] *= 1.3f;
+        right[i] *= 1.3f;
+    }
+    ns = encode(1, 1, 2, 1);
+    spectrum(mpx, SAMPLES);
+    report("composite clip, protected", ns, 1, COMPOSITE_PROTECTION_DB);
+    ns = encode(1, 1, 2, 0);
+    spectrum(mpx, SAMPLES);
+    report("composite clip, plain", ns, 0, 0);
+
+    // Worst case cost : everything far over the threshold
+    for(int i=0; i<SAMPLES; i++) {
+        left[i] *= 10;
+        right[i] *= 10;
+    }
+    for(int os=1; os<=STEREO_ENC_MAX_OVERSAMPLE; os*=2) {
+        ns = encode(os, 0, THRESHOLD, 1);
+        printf("overdriven x%d : %.1f ns/sample, %lu clipped, %lu over budget or full scale\n", os, ns, enc.clipped, enc.hard_clipped);
+    }
+
+    printf(failures ? "FAILED\n" : "PASSED\n");
+    return failures != 0;
+}
@@ -0,0 +1,72 @@
+/*
+    pcm_ring.h: lock-free single producer / single consumer ring of floats,
+    used between the audio decode thread and the MPX generator.
+    Capacity is rounded up to a power of two, head and tail are only written
+    by their own side and published with release/acquire ordering.
+*/
+
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    float *data;
+    size_t mask;
+    size_t head __attribute__((aligned(64)));  // written by the producer
+    size_t tail __attribute__((aligned(64)));  // written by the consumer
+} pcm_ring;
+
+static inline int pcm_ring_init(pcm_ring *r, size_t min_capacity) {
+    size_t capacity = 1;
+    while(capacity < min_capacity) capacity <<= 1;
+    r->data = (float *)malloc(capacity * sizeof(float));
+    if(r->data == NULL) return -1;
+    r->mask = capacity - 1;
+    r->head = 0;
+    r->tail = 0;
+    return 0;
+}
+
+static inline void pcm_ring_free(pcm_ring *r) {
+    free(r->data);
+    r->data = NULL;
+}
+
+static inline size_t pcm_ring_capacity(const pcm_ring *r) {
+    return r->mask + 1;
+}
+
+// Samples ready to pop, also valid as a fill level from any thread
+static inline size_t pcm_ring_available(pcm_ring *r) {
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+static inline size_t pcm_ring_push(pcm_ring *r, const float *in, size_t n) {
+    size_t head = r->head;
+    size_t space = pcm_ring_capacity(r) - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+    if(n > space) n = space;
+    size_t start = head & r->mask;
+    size_t first = pcm_ring_capacity(r) - start;
+    if(first > n) first = n;
+    memcpy(r->data + start, in, first * sizeof(float));
+    memcpy(r->data, in + first, (n - first) * sizeof(float));
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+static inline size_t pcm_ring_pop(pcm_ring *r, float *out, size_t n) {
+    size_t tail = r->tail;
+    size_t available = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+    if(n > available) n = available;
+    size_t start = tail & r->mask;
+    size_t first = pcm_ring_capacity(r) - start;
+    if(first > n) first = n;
+    memcpy(out, r->data + start, first * sizeof(float));
+    memcpy(out + first, r->data, (n - first) * sizeof(float));
+    __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+#endif
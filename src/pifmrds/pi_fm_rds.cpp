@@ -13,6 +13,8 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sndfile.h>
+#include <pthread.h>
+#include <atomic>
 extern "C"
 {
 #include "rds.h"
@@ -20,9 +22,22 @@ extern "C"
 #include "control_pipe.h"
 }
 #include <librpitx/librpitx.h>
+#include "../iqdsp/spscring.h"
+#include "../iqdsp/seqlock.h"
 ngfmdmasync *fmmod;
 #define DATA_SIZE 5000
-static void terminate(int num)
+#define MPX_RING_SIZE (228000/2)     // 0.5s of multiplex between the DSP and the DMA feeder
+#define MPX_PREBUFFER (DATA_SIZE*4)
+#define MPX_BLOCK (228000/200)       // 5ms, DSP block and so the granularity of control changes
+#define CONTROL_QUEUE_SIZE 256
+#define CONTROL_BURST 32              // Also the largest JSON batch
+#define PEAK_WINDOW 228000           // Peak deviation is reported over the last 1 to 2 s
+#define RATE_WINDOW (228000*10)      // Measured input and output rates, over 10 s
+
+volatile sig_atomic_t running = 1;
+volatile sig_atomic_t dumpstats = 0;
+
+static void cleanup(int num)
 {
     delete fmmod;
     fm_mpx_close();
@@ -30,23 +45,46 @@ static void terminate(int num)
     exit(num);
 }
 
+static void terminate(int num)
+{
+    // The feeder loop stops the pipeline, a second signal (or a crash) does not wait for it
+    if(!running || num == SIGSEGV) cleanup(num);
+    running = 0;
+}
+
+static void statshandler(int num)
+{
+    dumpstats = 1;
+}
+
+static void reloadhandler(int num)
+{
+    fm_mpx_reload_playlist();
+}
+
 static void fatal(char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
     vfprintf(stderr, fmt, ap);
     va_end(ap);
-    terminate(0);
+    cleanup(0);
 }
 
 typedef struct tx_data {
     uint32_t carrier_freq;
     char *audio_file;
+    char *playlist;
+    char *composite;
+    int mpxFormat;
+    int mpxSampleRate;
+    float crossfade;
     uint16_t pi;
     uint16_t ecc;
     char *ps;
     char *rt;
     char *control_pipe;
+    char *control_socket;
     uint8_t pty;
     int af_array[100];
     uint8_t raw;
@@ -68,9 +106,255 @@ typedef struct tx_data {
     float rds_volume;
     uint8_t disablestereo;
     uint8_t log;
+    int resampler;
+    uint8_t measure;
     float limiter_threshold;
+    int processor_bands;
+    float lookahead_ms;
+    float composite_clip;
+    int stereo_oversample;
+    char *ptyn;
+    uint16_t eon_pi;
+    char *eon_ps;
+    char *rtplus;
+    char *rds_groups;
 } tx_data;
 
+// Everything the DSP stage reads per block, only changed by the DSP thread itself
+typedef struct {
+    fm_mpx_data mpx;
+    float deviation_scale_factor;
+} tx_settings;
+
+// A parsed control command on its way to the DSP thread
+typedef struct {
+    ResultAndArg cmd;
+    uint64_t received_ns;
+} control_command;
+
+static uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+// Published by the DSP thread after each block, read by status requests
+typedef struct {
+    uint64_t samples;
+    float peak_deviation;       // Hz
+    float compressor_gain;
+    size_t pcm_fill;
+    size_t pcm_capacity;
+    unsigned long pcm_underruns;
+    int track;
+    size_t mpx_fill;
+    size_t mpx_capacity;
+    unsigned long mpx_underruns;
+    unsigned long mpx_waits;
+    unsigned long commands_applied;
+    float latency_max_ms;
+    // Over the last RATE_WINDOW against the system clock. Once the ring is full the output rate is the DMA's.
+    double out_rate;
+    double in_rate;
+    double drift;               // input frames taken minus in_rate/228000 of the output, so at most 1 unless the timebase slips
+} tx_status;
+
+// *----- Control stage : waits on the control pipe and socket, queues every command for the DSP thread
+struct control_context {
+    tx_data *data;
+    spscring<control_command> *Commands;
+};
+
+static void *control_thread(void *arg)
+{
+    control_context *ctx = (control_context *)arg;
+    ResultAndArg commands[CONTROL_BURST];
+    control_command batch[CONTROL_BURST];
+    while(running)
+    {
+        int count = wait_control_commands(commands, CONTROL_BURST, 100, ctx->data->log);
+        uint64_t now = monotonic_ns();
+        for(int i=0; i<count; i+=commands[i].batch) {
+            // A batch is pushed at once, the DSP thread drains it in the same block
+            int n = commands[i].batch;
+            for(int j=0; j<n; j++) {
+                batch[j].cmd = commands[i+j];
+                batch[j].received_ns = now;
+            }
+            while(ctx->Commands->Free() < (size_t)n && running) usleep(1000); // Never drop a command
+            ctx->Commands->Push(batch, n);
+        }
+    }
+    return NULL;
+}
+
+// *----- DSP stage : applies queued commands, multiplex generation and deviation scaling into the ring drained by the DMA feeder (main thread)
+struct dsp_context {
+    tx_data *data;
+    tx_settings Settings;
+    spscring<control_command> *Commands;
+    spscring<float> *Ring;
+    std::atomic<bool> Done;
+    std::atomic<unsigned long> Waits;      // Blocks that waited for the feeder to make room, flow control, not a loss
+    std::atomic<unsigned long> Underruns;  // Feeder found the ring empty
+    // Time from reading a command to applying it
+    std::atomic<unsigned long> Applied;
+    std::atomic<uint64_t> LatencyMaxNs;
+    std::atomic<uint64_t> LatencySumNs;
+    seqlock<tx_status> Status;
+};
+
+static void apply_command(dsp_context *ctx, ResultAndArg *cmd)
+{
+    tx_data *data = ctx->data;
+    fm_mpx_data *mpx = &ctx->Settings.mpx;
+    if(apply_rds_command(cmd)) return;
+    if(cmd->res == CONTROL_PIPE_RDS_SET) {
+        mpx->drds = cmd->arg_int;
+    } else if(cmd->res == CONTROL_PIPE_PWR_SET) {
+        padgpio gpiopad;
+        gpiopad.setlevel(cmd->arg_int);
+    } else if(cmd->res == CONTROL_PIPE_DEVIATION_SET) {
+        data->deviation = atoi(cmd->arg);
+        ctx->Settings.deviation_scale_factor=  0.1 * (data->deviation);
+    } else if(cmd->res == CONTROL_PIPE_STEREO_SET) {
+        mpx->dstereo = cmd->arg_int;
+    } else if(cmd->res == CONTROL_PIPE_GAIN_SET) {
+        mpx->audio_gain = atof(cmd->arg);
+    } else if(cmd->res == CONTROL_PIPE_COMPRESSORDECAY_SET) {
+        mpx->compressor_decay = atof(cmd->arg);
+    } else if(cmd->res == CONTROL_PIPE_COMPRESSORATTACK_SET) {
+        mpx->compressor_attack = atof(cmd->arg);
+    } else if(cmd->res == CONTROL_PIPE_CT_SET) {
+        mpx->rds_ct_enabled = cmd->arg_int;
+    } else if(cmd->res == CONTROL_PIPE_RDSVOL_SET) {
+        mpx->rds_volume = atof(cmd->arg);
+    } else if(cmd->res == CONTROL_PIPE_PAUSE_SET) {
+        mpx->paused = cmd->arg_int;
+    } else if(cmd->res == CONTROL_PIPE_MPXGEN_SET) {
+        mpx->generate_multiplex = cmd->arg_int;
+    } else if(cmd->res == CONTROL_PIPE_COMPRESSOR_SET) {
+        mpx->enablecompressor = cmd->arg_int;
+    } else if(cmd->res == CONTROL_PIPE_COMPRESSORMAXGAINRECIP_SET) {
+        mpx->compressor_max_gain_recip = atof(cmd->arg);
+    } else if(cmd->res == CONTROL_PIPE_LIMITERTHRESHOLD_SET) {
+        mpx->limiter_threshold = atof(cmd->arg);
+    }
+}
+
+static void *dsp_thread(void *arg)
+{
+    dsp_context *ctx = (dsp_context *)arg;
+    // Data structures for baseband data
+    float audio_data[MPX_BLOCK];
+	float devfreq[MPX_BLOCK];
+    int data_len = 0;
+    tx_status status;
+    memset(&status, 0, sizeof(status));
+    float peak = 0, last_peak = 0;
+    int peak_samples = 0;
+    uint64_t rate_start_ns = 0, rate_samples = 0, rate_frames = 0;
+
+    while(running)
+	{
+        // Wait for room first, so the block is generated with the latest commands
+        if(ctx->Ring->Free() < MPX_BLOCK) {
+            ctx->Waits.fetch_add(1, std::memory_order_relaxed);
+            while(ctx->Ring->Free() < MPX_BLOCK && running) usleep(1000);
+        }
+        // Commands take effect at the next block, RDS ones at the next group
+        control_command command;
+        while(ctx->Commands->Pop(&command, 1)) {
+            apply_command(ctx, &command.cmd);
+            uint64_t latency = monotonic_ns() - command.received_ns;
+            if(latency > ctx->LatencyMaxNs.load(std::memory_order_relaxed)) ctx->LatencyMaxNs.store(latency, std::memory_order_relaxed);
+            ctx->LatencySumNs.fetch_add(latency, std::memory_order_relaxed);
+            ctx->Applied.fetch_add(1, std::memory_order_relaxed);
+        }
+        if(fm_mpx_get_samples(audio_data, &ctx->Settings.mpx) < 0) break;
+        data_len = MPX_BLOCK;
+        for(int i=0;i< data_len;i++) {
+            devfreq[i] = audio_data[i]*ctx->Settings.deviation_scale_factor;
+            if(fabsf(devfreq[i]) > peak) peak = fabsf(devfreq[i]);
+        }
+        ctx->Ring->Push(devfreq, data_len);
+
+        peak_samples += data_len;
+        if(peak_samples >= PEAK_WINDOW) {
+            last_peak = peak;
+            peak = 0;
+            peak_samples = 0;
+        }
+        fm_mpx_stats stats;
+        fm_mpx_get_stats(&stats);
+        status.samples += data_len;
+        status.peak_deviation = peak > last_peak ? peak : last_peak;
+        status.compressor_gain = stats.compressor_gain;
+        status.pcm_fill = stats.pcm_fill;
+        status.pcm_capacity = stats.pcm_capacity;
+        status.pcm_underruns = stats.pcm_underruns;
+        status.track = stats.track;
+        status.mpx_fill = ctx->Ring->GetCapacity() - ctx->Ring->Free();
+        status.mpx_capacity = ctx->Ring->GetCapacity();
+        status.mpx_underruns = ctx->Underruns.load(std::memory_order_relaxed);
+        status.mpx_waits = ctx->Waits.load(std::memory_order_relaxed);
+        status.commands_applied = ctx->Applied.load(std::memory_order_relaxed);
+        status.latency_max_ms = ctx->LatencyMaxNs.load(std::memory_order_relaxed)/1e6;
+        if(stats.in_rate) status.drift = stats.frames_in - (double)status.samples * stats.in_rate / 228000;
+        if(status.samples - rate_samples >= RATE_WINDOW) {
+            uint64_t now = monotonic_ns();
+            if(rate_start_ns) {
+                double seconds = (now - rate_start_ns) / 1e9;
+                status.out_rate = (status.samples - rate_samples) / seconds;
+                status.in_rate = (stats.frames_in - rate_frames) / seconds;
+                if(ctx->data->measure) {
+                    fprintf(stderr, "Timebase : output %.2f Hz (%+.1f ppm against the system clock), input %.2f Hz, resampler drift %.3f frames\n",
+                        status.out_rate, (status.out_rate/228000 - 1)*1e6, status.in_rate, status.drift);
+                }
+            }
+            // The first window only starts the clock, it includes filling the ring
+            rate_start_ns = now;
+            rate_samples = status.samples;
+            rate_frames = stats.frames_in;
+        }
+        ctx->Status.Store(status);
+	}
+    ctx->Done.store(true, std::memory_order_release);
+    return NULL;
+}
+
+// Status requests are answered by the control thread from the last published snapshot
+static dsp_context *status_context = NULL;
+
+static void json_status(char *json, int size)
+{
+    tx_status status;
+    status_context->Status.Load(status);
+    snprintf(json, size, "{\"samples\":%llu,\"peak_deviation\":%.0f,\"compressor_gain\":%.3f,"
+        "\"pcm_fill\":%zu,\"pcm_capacity\":%zu,\"pcm_underruns\":%lu,\"track\":%d,"
+        "\"mpx_fill\":%zu,\"mpx_capacity\":%zu,\"mpx_underruns\":%lu,\"mpx_waits\":%lu,"
+        "\"commands_applied\":%lu,\"latency_max_ms\":%.2f,\"out_rate\":%.3f,\"in_rate\":%.3f,\"drift\":%.3f}",
+        (unsigned long long)status.samples, status.peak_deviation, status.compressor_gain,
+        status.pcm_fill, status.pcm_capacity, status.pcm_underruns, status.track,
+        status.mpx_fill, status.mpx_capacity, status.mpx_underruns, status.mpx_waits,
+        status.commands_applied, status.latency_max_ms, status.out_rate, status.in_rate, status.drift);
+}
+
+static void print_stats(dsp_context *ctx)
+{
+    fm_mpx_stats stats;
+    fm_mpx_get_stats(&stats);
+    fprintf(stderr, "PCM ring %zu/%zu samples : %lu underruns, %lu reads, longest read %.1f ms\n",
+        stats.pcm_fill, stats.pcm_capacity, stats.pcm_underruns, stats.decode_reads, stats.decode_max_read_ms);
+    fprintf(stderr, "MPX ring %zu/%zu samples : %lu underruns, %lu waits for room\n",
+        ctx->Ring->Available(), ctx->Ring->GetCapacity(), ctx->Underruns.load(std::memory_order_relaxed), ctx->Waits.load(std::memory_order_relaxed));
+    fprintf(stderr, "DMA %d samples free\n", fmmod->GetBufferAvailable());
+    unsigned long applied = ctx->Applied.load(std::memory_order_relaxed);
+    if(applied) fprintf(stderr, "Control : %lu commands applied, latency mean %.2f ms, max %.2f ms\n", applied,
+        ctx->LatencySumNs.load(std::memory_order_relaxed)/1e6/applied, ctx->LatencyMaxNs.load(std::memory_order_relaxed)/1e6);
+}
+
 int tx(tx_data *data) {
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
@@ -83,31 +367,28 @@ int tx(tx_data *data) {
     sigaction(SIGPWR, &sa, NULL);
     sigaction(SIGTSTP, &sa, NULL);
     sigaction(SIGSEGV, &sa, NULL); //seg fault
+    sa.sa_handler = statshandler;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL); // kill -USR1 prints the pipeline fill levels
+    if(data->playlist) {
+        sa.sa_handler = reloadhandler;
+        sigaction(SIGHUP, &sa, NULL); // kill -HUP reads the playlist again
+    }
     
-    // Data structures for baseband data
-    float audio_data[DATA_SIZE];
-	float devfreq[DATA_SIZE];
-    int data_len = 0;
-    int data_index = 0;
-
-    int generate_multiplex = 1;
     int dstereo = data->disablestereo;
     int drds = data->drds;
-    float audio_gain = data->audio_gain;
-    float compressor_decay = data->compressor_decay;
-    float compressor_attack = data->compressor_attack;
-    float compressor_max_gain_recip = data->compressor_max_gain_recip;
-    int enablecompressor = data->enablecompressor;
-    int rds_ct_enabled = data->rds_ct_enabled;
-    float rds_volume = data->rds_volume;
-    float limiter_threshold = data->limiter_threshold;
 
     //set the power
     padgpio gpiopad;
     gpiopad.setlevel(data->power);
 
     // Initialize the baseband generator
-    if(fm_mpx_open(data->audio_file, DATA_SIZE, data->raw, data->preemp, data->rawSampleRate, data->rawChannels, data->cutoff_freq) < 0) return 1;
+    if(data->composite) {
+        int format = data->mpxFormat == COMPOSITE_FILE && data->raw ? COMPOSITE_S16 : data->mpxFormat;
+        if(fm_mpx_open_composite(data->composite, MPX_BLOCK, format, data->mpxSampleRate) < 0) return 1;
+    } else if(data->playlist) {
+        if(fm_mpx_open_playlist(data->playlist, MPX_BLOCK, data->preemp, data->cutoff_freq, data->crossfade, data->resampler) < 0) return 1;
+    } else if(fm_mpx_open(data->audio_file, MPX_BLOCK, data->raw, data->preemp, data->rawSampleRate, data->rawChannels, data->cutoff_freq, data->resampler) < 0) return 1;
 
     // Initialize the RDS modulator
     char myps[9] = {0};
@@ -120,6 +401,10 @@ int tx(tx_data *data) {
     set_rds_ms(1); // yes
     set_rds_tp(data->tp);
     set_rds_ta(data->ta);
+    if(data->ptyn) set_rds_ptyn(data->ptyn);
+    if(data->eon_pi) set_rds_eon(data->eon_pi, data->eon_ps);
+    if(data->rtplus && set_rds_rtplus(data->rtplus) < 0) printf("Invalid RT+ tags: %s\n", data->rtplus);
+    if(data->rds_groups && set_rds_groups(data->rds_groups) < 0) printf("Invalid RDS group schedule: %s\n", data->rds_groups);
     if(dstereo == 1) {
         set_rds_di(0);
     } else {
@@ -155,83 +440,114 @@ int tx(tx_data *data) {
             data->control_pipe = NULL;
         }
     }
+    if(data->control_socket) {
+        if(open_control_socket(data->control_socket) == 0) {
+            if(data->log) printf("Reading control commands on socket %s.\n", data->control_socket);
+        } else {
+            if(data->log) printf("Failed to open control socket: %s.\n", data->control_socket);
+            data->control_socket = NULL;
+        }
+    }
     if(data->log) printf("Starting to transmit on %3.1f MHz.\n", data->carrier_freq/1e6);
-    float deviation_scale_factor;
+    // Pipeline : decode thread (fm_mpx) -> PCM ring -> DSP thread -> MPX ring -> DMA feeder (here)
+    // with the control thread queueing commands to the DSP thread
+    spscring<float> Ring(MPX_RING_SIZE);
+    spscring<control_command> Commands(CONTROL_QUEUE_SIZE);
+    dsp_context DspContext;
+    DspContext.data = data;
+    fm_mpx_data *mpx = &DspContext.Settings.mpx;
+    mpx->drds = drds;
+    mpx->compressor_decay = data->compressor_decay;
+    mpx->compressor_attack = data->compressor_attack;
+    mpx->compressor_max_gain_recip = data->compressor_max_gain_recip;
+    mpx->dstereo = dstereo;
+    mpx->audio_gain = data->audio_gain;
+    mpx->enablecompressor = data->enablecompressor;
+    mpx->rds_ct_enabled = data->rds_ct_enabled;
+    mpx->rds_volume = data->rds_volume;
+    mpx->paused = 0;
+    mpx->generate_multiplex = 1;
+    mpx->limiter_threshold = data->limiter_threshold;
+    mpx->processor_bands = data->processor_bands;
+    mpx->lookahead_ms = data->lookahead_ms;
+    mpx->composite_clip = data->composite_clip;
+    mpx->stereo_oversample = data->stereo_oversample;
+    mpx->wait_for_audio = 0;
     // The deviation specifies how wide the signal is (from its lowest bandwidht to its highest, but not including sub-carriers). 
     // Use 75kHz for WFM (broadcast radio, or 50khz can be used)
     // and about 2.5kHz for NFM (walkie-talkie style radio)
-    deviation_scale_factor=  0.1 * (data->deviation);
-    int paused = 0;
-    for (;;)
-	{
-        if(data->control_pipe) {
-            ResultAndArg pollResult = poll_control_pipe(data->log);
-            if(pollResult.res == CONTROL_PIPE_RDS_SET) {
-                drds = pollResult.arg_int;
-            } else if(pollResult.res == CONTROL_PIPE_PWR_SET) {
-                padgpio gpiopad;
-                gpiopad.setlevel(pollResult.arg_int);
-            } else if(pollResult.res == CONTROL_PIPE_DEVIATION_SET) {
-                data->deviation = std::stoi(pollResult.arg);
-                deviation_scale_factor=  0.1 * (data->deviation);
-            } else if(pollResult.res == CONTROL_PIPE_STEREO_SET) {
-                dstereo = pollResult.arg_int;
-            } else if(pollResult.res == CONTROL_PIPE_GAIN_SET) {
-                audio_gain = std::stof(pollResult.arg);
-            } else if(pollResult.res == CONTROL_PIPE_COMPRESSORDECAY_SET) {
-                compressor_decay = std::stof(pollResult.arg);
-            } else if(pollResult.res == CONTROL_PIPE_COMPRESSORATTACK_SET) {
-                compressor_attack = std::stof(pollResult.arg);
-            } else if(pollResult.res == CONTROL_PIPE_CT_SET) {
-                rds_ct_enabled = pollResult.arg_int;
-            } else if(pollResult.res == CONTROL_PIPE_RDSVOL_SET) {
-                rds_volume = std::stof(pollResult.arg);
-            } else if(pollResult.res == CONTROL_PIPE_PAUSE_SET) {
-                paused = pollResult.arg_int;
-            } else if(pollResult.res == CONTROL_PIPE_MPXGEN_SET) {
-                generate_multiplex = pollResult.arg_int;
-            } else if(pollResult.res == CONTROL_PIPE_COMPRESSOR_SET) {
-                enablecompressor = pollResult.arg_int;
-            } else if(pollResult.res == CONTROL_PIPE_COMPRESSORMAXGAINRECIP_SET) {
-                compressor_max_gain_recip = std::stof(pollResult.arg);
-            } else if(pollResult.res == CONTROL_PIPE_LIMITERTHRESHOLD_SET) {
-                limiter_threshold = std::stof(pollResult.arg);
+    DspContext.Settings.deviation_scale_factor=  0.1 * (data->deviation);
+    DspContext.Commands = &Commands;
+    DspContext.Ring = &Ring;
+    DspContext.Done = false;
+    DspContext.Waits = 0;
+    DspContext.Underruns = 0;
+    DspContext.Applied = 0;
+    DspContext.LatencyMaxNs = 0;
+    DspContext.LatencySumNs = 0;
+    pthread_t DspThread;
+    if(pthread_create(&DspThread, NULL, dsp_thread, &DspContext) != 0) {
+        fprintf(stderr, "Cannot start DSP thread\n");
+        return 1;
+    }
+    status_context = &DspContext;
+    set_control_status(json_status);
+    control_context ControlContext;
+    ControlContext.data = data;
+    ControlContext.Commands = &Commands;
+    bool Control = data->control_pipe || data->control_socket;
+    pthread_t ControlThread;
+    if(Control && pthread_create(&ControlThread, NULL, control_thread, &ControlContext) != 0) {
+        fprintf(stderr, "Cannot start control thread\n");
+        Control = false;
+    }
+
+    float devfreq[MPX_BLOCK];
+    bool Buffering = true;
+    while(running) {
+        if(dumpstats) {
+            dumpstats = 0;
+            print_stats(&DspContext);
+        }
+        bool DspDone = DspContext.Done.load(std::memory_order_acquire);
+        if(Buffering) {
+            if(Ring.Available() < MPX_PREBUFFER && !DspDone) {
+                usleep(1000);
+                continue;
             }
+            Buffering = false;
         }
-        fm_mpx_data *data2;
-        data2 = (fm_mpx_data *)malloc(sizeof(fm_mpx_data));
-        data2->drds = drds;
-        data2->compressor_decay = compressor_decay;
-        data2->compressor_attack = compressor_attack;
-        data2->compressor_max_gain_recip = compressor_max_gain_recip;
-        data2->dstereo = dstereo;
-        data2->audio_gain = audio_gain;
-        data2->enablecompressor = enablecompressor;
-        data2->rds_ct_enabled = rds_ct_enabled;
-        data2->rds_volume = rds_volume;
-        data2->paused = paused;
-        data2->generate_multiplex = generate_multiplex;
-        data2->limiter_threshold = limiter_threshold;
-        if(fm_mpx_get_samples(audio_data, data2) < 0 ) terminate(0);
-        data_len = DATA_SIZE;
-        for(int i=0;i< data_len;i++) {
-            devfreq[i] = audio_data[i]*deviation_scale_factor;
+        int data_len = Ring.Pop(devfreq, MPX_BLOCK);
+        if(data_len == 0) {
+            if(DspDone) break;
+            DspContext.Underruns.fetch_add(1, std::memory_order_relaxed);
+            Buffering = true;
+            continue;
         }
-        fmmod->SetFrequencySamples(devfreq,data_len);
-	}
+        fmmod->SetFrequencySamples(devfreq, data_len);
+    }
+    running = 0;
+    pthread_join(DspThread, NULL);
+    if(Control) pthread_join(ControlThread, NULL);
+    if(data->log) print_stats(&DspContext);
     return 0;
 }
 
-
 int main(int argc, char **argv) {
     tx_data data = {
         .carrier_freq = 100000000,
         .audio_file = NULL,
+        .playlist = NULL,
+        .composite = NULL,
+        .mpxFormat = COMPOSITE_FILE,
+        .mpxSampleRate = 0,        // -mpxrate, else -rawsamplerate when given, else 192000
+        .crossfade = 0,
         .pi = 0x00ff,
         .ecc = 0x0,
         .ps = "Pi-FmSa",
         .rt = "Broadcasting on a Raspberry Pi: Simply Advanced",
         .control_pipe = NULL,
+        .control_socket = NULL,
         .pty = 0,
         .af_array = {0},
         .raw = 0,
@@ -253,7 +569,18 @@ int main(int argc, char **argv) {
         .rds_volume = 1.0,
         .disablestereo = 0,
         .log = 1,
+        .resampler = RESAMPLER_FAST,
+        .measure = 0,
         .limiter_threshold = 0.9,
+        .processor_bands = 0,
+        .lookahead_ms = 0,
+        .composite_clip = 0,
+        .stereo_oversample = 1,
+        .ptyn = NULL,
+        .eon_pi = 0,
+        .eon_ps = NULL,
+        .rtplus = NULL,
+        .rds_groups = NULL,
     };
 
     int af_size = 0;
@@ -263,6 +590,7 @@ int main(int argc, char **argv) {
 
     int alternative_freq[100] = {};
     int bypassfreqrange = 0;
+    int rawSampleRateGiven = 0;
     // Parse command-line arguments
     for(int i=1; i<argc; i++) {
         char *arg = argv[i];
@@ -271,6 +599,25 @@ int main(int argc, char **argv) {
         if((strcmp("-audio", arg)==0) && param != NULL) {
             i++;
             data.audio_file = param;
+        } else if(strcmp("-playlist", arg)==0 && param != NULL) {
+            i++;
+            data.playlist = param;
+        } else if(strcmp("-mpx", arg)==0 && param != NULL) {
+            i++;
+            data.composite = param;
+        } else if(strcmp("-mpxformat", arg)==0 && param != NULL) {
+            i++;
+            if(strcmp("s16", param)==0) data.mpxFormat = COMPOSITE_S16;
+            else if(strcmp("f32", param)==0 || strcmp("float", param)==0) data.mpxFormat = COMPOSITE_FLOAT;
+            else fatal("-mpxformat is s16 or f32\n");
+        } else if(strcmp("-mpxrate", arg)==0 && param != NULL) {
+            i++;
+            data.mpxSampleRate = atoi(param);
+            if(data.mpxSampleRate <= 0) fatal("The -mpxrate sample rate must be positive\n");
+        } else if(strcmp("-crossfade", arg)==0 && param != NULL) {
+            i++;
+            data.crossfade = atof(param);
+            if(data.crossfade < 0 || data.crossfade > 10) fatal("Crossfade can be between 0 (gapless) and 10 seconds\n");
         } else if(strcmp("-freq", arg)==0 && param != NULL) {
             i++;
             data.carrier_freq = (uint32_t)(atof(param)*1e6);
@@ -287,6 +634,21 @@ int main(int argc, char **argv) {
         } else if(strcmp("-rt", arg)==0 && param != NULL) {
             i++;
             data.rt = param;
+        } else if(strcmp("-ptyn", arg)==0 && param != NULL) {
+            i++;
+            data.ptyn = param;
+        } else if(strcmp("-eon", arg)==0 && param != NULL) {
+            i++;
+            // Other network as pi_code,ps_text
+            data.eon_pi = (uint16_t)strtoul(param, &data.eon_ps, 16);
+            if(*data.eon_ps != ',') fatal("EON has to be given as pi_code,ps_text\n");
+            data.eon_ps++;
+        } else if(strcmp("-rtplus", arg)==0 && param != NULL) {
+            i++;
+            data.rtplus = param;
+        } else if(strcmp("-rdsgroups", arg)==0 && param != NULL) {
+            i++;
+            data.rds_groups = param;
         } else if(strcmp("-compressordecay", arg)==0 && param != NULL) {
             i++;
             data.compressor_decay = atof(param);
@@ -306,6 +668,21 @@ int main(int argc, char **argv) {
             if(data.limiter_threshold > 3.5) {
                 fatal("Limiter threshold too high!\n");
             }
+        } else if(strcmp("-bands", arg)==0 && param != NULL) {
+            i++;
+            data.processor_bands = atoi(param);
+            if(data.processor_bands < 0 || data.processor_bands > 5) fatal("The multiband processor has 1 to 5 bands (0 for off)\n");
+        } else if(strcmp("-lookahead", arg)==0 && param != NULL) {
+            i++;
+            data.lookahead_ms = atof(param);
+            if(data.lookahead_ms < 0 || data.lookahead_ms > 2.5) fatal("Limiter look-ahead can be between 0 and 2.5 ms\n");
+        } else if(strcmp("-compositeclip", arg)==0 && param != NULL) {
+            i++;
+            data.composite_clip = atof(param);
+        } else if(strcmp("-oversample", arg)==0 && param != NULL) {
+            i++;
+            data.stereo_oversample = atoi(param);
+            if(data.stereo_oversample != 1 && data.stereo_oversample != 2 && data.stereo_oversample != 4) fatal("The clipper oversamples 1, 2 or 4 times\n");
         } else if(strcmp("-rdsvolume", arg)==0 && param != NULL) {
             i++;
             data.rds_volume = atof(param);
@@ -336,6 +713,9 @@ int main(int argc, char **argv) {
         } else if(strcmp("-ctl", arg)==0 && param != NULL) {
             i++;
             data.control_pipe = param;
+        } else if(strcmp("-ctlsock", arg)==0 && param != NULL) {
+            i++;
+            data.control_socket = param;
         } else if(strcmp("-deviation", arg)==0 && param != NULL) {
             i++;
             if(strcmp("mono", param)==0) {
@@ -352,6 +732,8 @@ int main(int argc, char **argv) {
         } else if(strcmp("-rawsamplerate", arg)==0 && param != NULL) {
             i++;
             data.rawSampleRate = atoi(param);
+            if(data.rawSampleRate <= 0) fatal("The -rawsamplerate sample rate must be positive\n");
+            rawSampleRateGiven = 1;
         } else if(strcmp("-cutofffreq", arg)==0 && param != NULL) {
             i++;
             data.cutoff_freq = atof(param);
@@ -378,6 +760,13 @@ int main(int argc, char **argv) {
         } else if(strcmp("-disablect", arg)==0) {
             i++;
             data.rds_ct_enabled = 0;
+        } else if(strcmp("-resampler", arg)==0 && param != NULL) {
+            i++;
+            if(strcmp("fast", param)==0) data.resampler = RESAMPLER_FAST;
+            else if(strcmp("best", param)==0) data.resampler = RESAMPLER_BEST;
+            else fatal("The resampler is fast or best\n");
+        } else if(strcmp("-measure", arg)==0) {
+            data.measure = 1;
         } else if(strcmp("-preemphasis", arg)==0 && param != NULL) {
             i++;
             if(strcmp("us", param)==0) {
@@ -400,15 +789,20 @@ int main(int argc, char **argv) {
         else {
             fatal("Unrecognised argument: %s.\n"
             "Syntax: pi_fm_rds [-freq freq] [-audio file] [-pi pi_code] [-ecc ecc_code]\n"
-            "                  [-ps ps_text] [-rt rt_text] [-ctl control_pipe] [-pty program_type] [-raw play raw audio from stdin] [-disablerds] [-af alt freq] [-preemphasis us] [-rawchannels when using the raw option you can change this] [-rawsamplerate same business] [-deviation the deviation, default is 75000] [-tp] [-ta]\n", arg);
+            "                  [-ps ps_text] [-rt rt_text] [-ctl control_pipe] [-ctlsock control_socket] [-pty program_type] [-raw play raw audio from stdin] [-disablerds] [-af alt freq] [-preemphasis us] [-rawchannels when using the raw option you can change this] [-rawsamplerate same business] [-deviation the deviation, default is 75000] [-tp] [-ta]\n"
+            "                  [-ptyn ptyn_text] [-eon pi_code,ps_text] [-rtplus type,start,len,type,start,len] [-rdsgroups 0A:4,2A:4,1A:1,10A:1,14A:1,3A:1,11A:1]\n"
+            "                  [-bands 0-5] [-lookahead ms] [-compositeclip level] [-oversample 1|2|4]\n"
+            "                  [-playlist file] [-crossfade seconds] [-resampler fast|best] [-measure] [-mpx file] [-mpxformat s16|f32] [-mpxrate rate]\n", arg);
         }
     }
 
+    if(data.mpxSampleRate == 0) data.mpxSampleRate = rawSampleRateGiven ? data.rawSampleRate : 192000;
+
     alternative_freq[0] = af_size;
     memcpy(data.af_array, alternative_freq, sizeof(alternative_freq));
     int FifoSize=DATA_SIZE*2;
     //fmmod=new ngfmdmasync(carrier_freq,228000,14,FifoSize, false, gpiopin); //you can mod
     fmmod=new ngfmdmasync(data.carrier_freq,228000,14,FifoSize, false);
     int errcode = tx(&data);
-    terminate(errcode);
+    cleanup(errcode);
 }
@@ -0,0 +1,245 @@
+/*
+    playlist.c: playlist reader of the fm_mpx.c decode thread,
+    see playlist.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "playlist.h"
+
+#define PI 3.14159265359
+
+// Reads the list file, paths made relative to its directory. -1 if it cannot be read.
+static int load_list(const char *path, char ***tracks) {
+    FILE *f = fopen(path, "r");
+    if(f == NULL) return -1;
+    const char *slash = strrchr(path, '/');
+    int dir_len = slash ? slash - path + 1 : 0;
+
+    int count = 0, size = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    *tracks = NULL;
+    while(getline(&line, &line_size, f) >= 0) {
+        size_t len = strlen(line);
+        while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' || line[len-1] == ' ' || line[len-1] == '\t')) line[--len] = 0;
+        char *start = line;
+        while(*start == ' ' || *start == '\t') start++;
+        if(*start == 0 || *start == '#') continue;
+
+        if(count == size) {
+            size = size ? 2*size : 16;
+            *tracks = (char **)realloc(*tracks, size * sizeof(char *));
+        }
+        int relative = start[0] != '/' ? dir_len : 0;
+        char *track = (char *)malloc(relative + strlen(start) + 1);
+        memcpy(track, path, relative);
+        strcpy(track + relative, start);
+        (*tracks)[count++] = track;
+    }
+    free(line);
+    fclose(f);
+    return count;
+}
+
+static void free_list(char **tracks, int count) {
+    for(int i=0; i<count; i++) free(tracks[i]);
+    free(tracks);
+}
+
+static void close_track(playlist_track *t) {
+    if(t->file != NULL) sf_close(t->file);
+    t->file = NULL;
+}
+
+static int open_track(playlist *p, int index, playlist_track *t) {
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE *file = sf_open(p->tracks[index], SFM_READ, &info);
+    if(file == NULL) {
+        fprintf(stderr, "Playlist: could not open %s\n", p->tracks[index]);
+        return -1;
+    }
+    if(p->rate == 0) {
+        p->rate = info.samplerate;
+        p->channels = info.channels > 1 ? 2 : 1;
+    }
+    if(info.samplerate != p->rate || info.channels > PLAYLIST_MAX_CHANNELS) {
+        fprintf(stderr, "Playlist: skipping %s, %d Hz %d channels in a %d Hz stream\n",
+            p->tracks[index], info.samplerate, info.channels, p->rate);
+        sf_close(file);
+        return -1;
+    }
+    t->file = file;
+    t->index = index;
+    t->channels = info.channels;
+    t->frames = info.frames > 0 ? info.frames : 0;
+    t->position = 0;
+    return 0;
+}
+
+// First playable track after index, wrapping around
+static int open_following(playlist *p, int index, playlist_track *t) {
+    for(int tries=0; tries<p->count; tries++) {
+        index = (index + 1) % p->count;
+        if(open_track(p, index, t) == 0) return 0;
+    }
+    return -1;
+}
+
+static int read_track(playlist *p, playlist_track *t, float *out, int frames) {
+    sf_count_t n;
+    if(t->channels == p->channels) {
+        n = sf_readf_float(t->file, out, frames);
+    } else {
+        n = sf_readf_float(t->file, p->convert, frames);
+        for(sf_count_t i=0; i<n; i++) {
+            float *in = p->convert + i*t->channels;
+            if(p->channels == 2) {
+                out[2*i] = in[0];
+                out[2*i+1] = t->channels > 1 ? in[1] : in[0];
+            } else {
+                out[i] = 0.5f*(in[0] + in[1]);
+            }
+        }
+    }
+    if(n < 0) n = 0;
+    t->position += n;
+    return n;
+}
+
+// Crossfade length between current and next, constant while both are open
+static sf_count_t fade_length(playlist *p) {
+    if(p->crossfade <= 0 || p->next.file == NULL || p->current.frames == SF_COUNT_MAX) return 0;
+    sf_count_t fade = p->crossfade * p->rate;
+    if(fade > p->current.frames/2) fade = p->current.frames/2;
+    if(p->next.frames != SF_COUNT_MAX && fade > p->next.frames/2) fade = p->next.frames/2;
+    return fade;
+}
+
+static void advance(playlist *p) {
+    close_track(&p->current);
+    if(p->next.file != NULL) {
+        p->current = p->next;
+        p->next.file = NULL;
+        p->changes++;
+        printf("Playlist %d/%d: %s\n", p->current.index + 1, p->count, p->tracks[p->current.index]);
+    }
+}
+
+static void reload_list(playlist *p) {
+    char **tracks;
+    int count = load_list(p->path, &tracks);
+    if(count <= 0) {
+        fprintf(stderr, "Playlist: could not reload %s, keeping %d tracks\n", p->path, p->count);
+        if(count == 0) free(tracks);
+        return;
+    }
+    // The current track keeps playing, found again in the new list or played as if it were before the first
+    int index = -1;
+    if(p->current.index >= 0) {
+        for(int i=0; i<count && index < 0; i++) {
+            if(strcmp(tracks[i], p->tracks[p->current.index]) == 0) index = i;
+        }
+    }
+    free_list(p->tracks, p->count);
+    p->tracks = tracks;
+    p->count = count;
+    p->current.index = index;
+    close_track(&p->next);
+    printf("Playlist reloaded: %d tracks\n", count);
+}
+
+int playlist_open(playlist *p, const char *path, float crossfade) {
+    memset(p, 0, sizeof(*p));
+    p->path = strdup(path);
+    p->crossfade = crossfade;
+    p->count = load_list(path, &p->tracks);
+    if(p->count < 0) {
+        fprintf(stderr, "Error: could not read playlist %s.\n", path);
+        return -1;
+    }
+    p->convert = (float *)malloc(PLAYLIST_CHUNK * PLAYLIST_MAX_CHANNELS * sizeof(float));
+    p->incoming = (float *)malloc(PLAYLIST_CHUNK * 2 * sizeof(float));
+    if(p->convert == NULL || p->incoming == NULL) return -1;
+    if(p->count == 0 || open_following(p, -1, &p->current) < 0) {
+        fprintf(stderr, "Error: nothing playable in playlist %s.\n", path);
+        return -1;
+    }
+    printf("Playlist %d/%d: %s\n", p->current.index + 1, p->count, p->tracks[p->current.index]);
+    return 0;
+}
+
+int playlist_read(playlist *p, float *out, int frames) {
+    // Not in the middle of a crossfade, the incoming track would be cut
+    if(p->reload && p->next.position == 0) {
+        p->reload = 0;
+        reload_list(p);
+    }
+    if(frames > PLAYLIST_CHUNK) frames = PLAYLIST_CHUNK;
+
+    int done = 0;
+    int switches = 0;   // all tracks empty or failing : give up instead of spinning
+    while(done < frames && switches <= p->count) {
+        if(p->current.file == NULL) {
+            switches++;
+            if(open_following(p, p->current.index, &p->current) < 0) break;
+            continue;
+        }
+        if(p->next.file == NULL) open_following(p, p->current.index, &p->next);
+
+        float *dest = out + done*p->channels;
+        sf_count_t fade = fade_length(p);
+        sf_count_t left = p->current.frames - p->current.position;
+        if(fade > 0 && left <= fade) {
+            // Both tracks at once, equal power
+            int n = frames - done;
+            if(n > left) n = left;
+            int got = read_track(p, &p->current, dest, n);
+            for(int i=got*p->channels; i<n*p->channels; i++) dest[i] = 0; // shorter than it said
+            int incoming = read_track(p, &p->next, p->incoming, n);
+            for(int i=incoming*p->channels; i<n*p->channels; i++) p->incoming[i] = 0;
+            for(int i=0; i<n; i++) {
+                double x = (fade - left + i + 0.5) / fade * (PI/2);
+                float out_gain = cos(x), in_gain = sin(x);
+                for(int c=0; c<p->channels; c++) {
+                    dest[i*p->channels+c] = dest[i*p->channels+c]*out_gain + p->incoming[i*p->channels+c]*in_gain;
+                }
+            }
+            done += n;
+            if(got < n || n == left) {
+                advance(p);
+                switches++;
+            }
+            continue;
+        }
+
+        int n = frames - done;
+        if(fade > 0 && n > left - fade) n = left - fade;
+        int got = read_track(p, &p->current, dest, n);
+        if(got == 0) {
+            // End of the track, gapless
+            advance(p);
+            switches++;
+            continue;
+        }
+        done += got;
+    }
+    return done;
+}
+
+void playlist_reload(playlist *p) {
+    p->reload = 1;
+}
+
+void playlist_close(playlist *p) {
+    close_track(&p->current);
+    close_track(&p->next);
+    free_list(p->tracks, p->count > 0 ? p->count : 0);
+    free(p->convert);
+    free(p->incoming);
+    free(p->path);
+}
@@ -0,0 +1,57 @@
+/*
+    playlist.h: playlist reader of the fm_mpx.c decode thread
+
+    The playlist is a text file with one audio file per line (M3U works:
+    lines starting with # are skipped), relative paths being relative to the
+    playlist. It plays in a loop. The first playable track sets the stream
+    rate and channels (1 or 2), other channel counts are mixed or duplicated
+    to it; tracks at another rate are skipped.
+    The next track is opened while the current one plays, so the transition
+    is gapless, or crossfaded (equal power) over the last seconds when the
+    length of the current track is known. The decode thread keeps the PCM
+    ring ahead of the multiplex across the transitions.
+    playlist_reload() only raises a flag, so it can be called from a signal
+    handler: the list is read again by the decode thread, the current track
+    plays on and the next one is taken from the new list.
+*/
+
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <signal.h>
+#include <sndfile.h>
+
+#define PLAYLIST_MAX_CHANNELS 8
+#define PLAYLIST_CHUNK 4096     // largest read, frames
+
+typedef struct {
+    SNDFILE *file;              // NULL when closed
+    int index;                  // in the list, -1 once the list changed under it
+    int channels;
+    sf_count_t frames;          // SF_COUNT_MAX when not known (pipe)
+    sf_count_t position;
+} playlist_track;
+
+typedef struct {
+    char *path;
+    char **tracks;
+    int count;
+    int rate;
+    int channels;
+    float crossfade;            // seconds, 0 for gapless
+    playlist_track current;
+    playlist_track next;        // opened ahead
+    float *convert;             // file channels to stream channels
+    float *incoming;            // next track during a crossfade
+    volatile sig_atomic_t reload;
+    unsigned long changes;      // track changes, the status shows current.index
+} playlist;
+
+// Reads the list and opens the first playable track, -1 if there is none
+int playlist_open(playlist *p, const char *path, float crossfade);
+// Up to PLAYLIST_CHUNK interleaved frames at p->rate, p->channels. 0 when no track can be played.
+int playlist_read(playlist *p, float *out, int frames);
+void playlist_reload(playlist *p);
+void playlist_close(playlist *p);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+    proc_bench.c: cost of the audio_proc.h processor per band count, in ns per
+    stereo 44.1 kHz input frame and in percent of one core in real time, with and
+    without the look-ahead limiter. Also checks that with the compressors idle
+    the bands add up flat, and that the limiter never lets a peak through.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "audio_proc.h"
+
+#define INPUT_RATE  44100
+#define FRAMES      (1<<16)
+#define PASSES      20
+#define CHUNK       570         // frames behind one 5 ms MPX block at 228 kHz, rounded up
+
+static float audio[2*FRAMES];
+static float work[2*FRAMES];
+static audio_proc proc;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static double run(int bands, float lookahead_ms) {
+    audio_proc_init(&proc, INPUT_RATE, 2, 50e-6, bands, lookahead_ms);
+    double best = 1e9;
+    for(int pass=0; pass<PASSES; pass++) {
+        for(int i=0; i<2*FRAMES; i++) work[i] = audio[i];
+        double start = now();
+        for(int f=0; f<FRAMES; f+=CHUNK) audio_proc_process(&proc, work + 2*f, FRAMES-f < CHUNK ? FRAMES-f : CHUNK, 0.9);
+        double took = (now() - start) * 1e9 / FRAMES;
+        if(took < best) best = took;
+    }
+    return best;
+}
+
+// Gain in dB through the band split and sum, compressors at unity, AGC frozen
+static double band_sum_gain(int bands, float freq) {
+    audio_proc_init(&proc, INPUT_RATE, 2, 0, bands, 0);
+    proc.agc_up = proc.agc_down = 0;
+    for(int k=0; k<bands; k++) {
+        proc.comp[k].ratio = 1;
+        proc.comp[k].makeup = 0;
+        proc.comp[k].gain = 1;
+    }
+    double in = 0, out = 0;
+    for(int i=0; i<FRAMES; i++) {
+        work[2*i] = work[2*i+1] = 0.1*sin(2*M_PI*freq*i/INPUT_RATE);
+    }
+    audio_proc_process(&proc, work, FRAMES, 1);
+    for(int i=FRAMES/2; i<FRAMES; i++) {
+        double s = 0.1*sin(2*M_PI*freq*i/INPUT_RATE);
+        in += s*s;
+        out += work[2*i]*work[2*i];
+    }
+    return 10*log10(out/in);
+}
+
+// Largest output peak of the limiter alone over a loud input, threshold 0.5
+static double limiter_peak() {
+    audio_proc_init(&proc, INPUT_RATE, 2, 0, 0, 1.5);
+    for(int i=0; i<2*FRAMES; i++) work[i] = 3*audio[i];
+    double peak = 0;
+    for(int f=0; f<FRAMES; f+=CHUNK) audio_proc_process(&proc, work + 2*f, FRAMES-f < CHUNK ? FRAMES-f : CHUNK, 0.5);
+    for(int i=0; i<2*FRAMES; i++) if(fabs(work[i]) > peak) peak = fabs(work[i]);
+    return peak;
+}
+
+int main() {
+    srand(1);
+    // Music-like : a few tones and some noise, moving level
+    for(int i=0; i<FRAMES; i++) {
+        double t = (double)i/INPUT_RATE;
+        double env = 0.3 + 0.25*sin(2*M_PI*0.7*t);
+        double l = sin(2*M_PI*60*t) + 0.5*sin(2*M_PI*440*t) + 0.3*sin(2*M_PI*3150*t) + 0.2*((double)rand()/RAND_MAX - 0.5);
+        double r = sin(2*M_PI*65*t) + 0.5*sin(2*M_PI*660*t) + 0.3*sin(2*M_PI*5000*t) + 0.2*((double)rand()/RAND_MAX - 0.5);
+        audio[2*i] = env*l;
+        audio[2*i+1] = env*r;
+    }
+
+    printf("Stereo %d Hz input, ns per frame (%% of a core in real time)\n", INPUT_RATE);
+    printf("bands   processor            + look-ahead limiter\n");
+    double limiter = run(0, 1.5);
+    printf("0       -                    %6.1f (%5.2f%%)\n", limiter, limiter*INPUT_RATE*1e-7);
+    for(int bands=1; bands<=AUDIO_PROC_MAX_BANDS; bands++) {
+        double plain = run(bands, 0);
+        double full = run(bands, 1.5);
+        printf("%d       %6.1f (%5.2f%%)     %6.1f (%5.2f%%)\n", bands,
+            plain, plain*INPUT_RATE*1e-7, full, full*INPUT_RATE*1e-7);
+    }
+
+    static const float freqs[] = {40, 100, 150, 400, 800, 2000, 4000, 6000, 10000, 15000};
+    int failed = 0;
+    printf("Band sum ripple (compressors idle) :\n");
+    for(int bands=2; bands<=AUDIO_PROC_MAX_BANDS; bands++) {
+        double worst = 0;
+        for(unsigned f=0; f<sizeof(freqs)/sizeof(freqs[0]); f++) {
+            double g = band_sum_gain(bands, freqs[f]);
+            if(fabs(g) > fabs(worst)) worst = g;
+        }
+        printf("%d bands : %+.3f dB %s\n", bands, worst, fabs(worst) < 0.05 ? "ok" : "FAILED");
+        if(fabs(worst) >= 0.05) failed = 1;
+    }
+    double peak = limiter_peak();
+    printf("Limiter peak %.4f for threshold 0.5 %s\n", peak, peak <= 0.5001 ? "ok" : "FAILED");
+    if(peak > 0.5001) failed = 1;
+    return failed;
+}
@@ -40,7 +40,25 @@ struct {
     char rt[RT_LENGTH];
     int af[100];
     int di;
+    char ptyn[PTYN_LENGTH];
+    int ptyn_enabled;
+    int ptyn_ab;            // toggled when the name changes, receivers clear the old one
+    uint16_t eon_pi;        // 0 : no other network
+    char eon_ps[PS_LENGTH];
+    int rtplus_enabled;
+    int rtplus_running;
+    int rtplus_toggle;
+    int rtplus_tags[6];     // type, start, length marker of the two RT+ tags
 } rds_params = { 0 };
+
+/* Bumped by every set_rds_* call: encoded groups stamped with an older
+   version are stale and get re-encoded on their next turn.
+*/
+static unsigned rds_version = 1;
+
+static void rds_params_changed() {
+    __atomic_add_fetch(&rds_version, 1, __ATOMIC_RELEASE);
+}
 /* Here, the first member of the struct must be a scalar to avoid a
    warning on -Wmissing-braces with GCC < 4.8.3 
    (bug: https://gcc.gnu.org/bugzilla/show_bug.cgi?id=53119)
@@ -53,11 +71,16 @@ struct {
 uint16_t offset_words[] = {0x0FC, 0x198, 0x168, 0x1B4};
 // We don't handle offset word C' here for the sake of simplicity
 
-/* Classical CRC computation */
-uint16_t crc(uint16_t block) {
+/* Table-driven CRC, 8 bits at a time. The table is built on first use from the
+   classical bitwise computation below.
+*/
+static uint16_t crc_table[256];
+static int crc_table_ready = 0;
+
+static uint16_t crc_bitwise(uint16_t block, int bits) {
     uint16_t crc = 0;
 
-    for(int j=0; j<BLOCK_SIZE; j++) {
+    for(int j=0; j<bits; j++) {
         int bit = (block & MSB_BIT) != 0;
         block <<= 1;
 
@@ -67,6 +90,16 @@ uint16_t crc(uint16_t block) {
             crc = crc ^ POLY;
         }
     }
+    return crc & ((1<<POLY_DEG)-1);
+}
+
+uint16_t crc(uint16_t block) {
+    if(!crc_table_ready) {
+        for(int i=0; i<256; i++) crc_table[i] = crc_bitwise(i << 8, 8);
+        crc_table_ready = 1;
+    }
+    uint16_t crc = crc_table[block >> 8];
+    crc = ((crc << 8) & ((1<<POLY_DEG)-1)) ^ crc_table[((crc >> (POLY_DEG-8)) ^ block) & 0xFF];
     return crc;
 }
 
@@ -111,155 +144,289 @@ int get_rds_ct_group(uint16_t *blocks, int enabled) {
     } else return 0;
 }
 
-/* Creates an RDS group. This generates sequences of the form 0A, 0A, 0A, 0A, 2A, etc.
-   The pattern is of length 8, the variable 'state' keeps track of where we are in the
-   pattern. 'ps_state' and 'rt_state' keep track of where we are in the PS (0A) sequence
-   or RT (2A) sequence, respectively.
+/* Appends the checkword to each block and stores the 104 bits of a group */
+static void encode_group(uint16_t *blocks, uint8_t *bits) {
+    for(int i=0; i<GROUP_LENGTH; i++) {
+        uint16_t block = blocks[i];
+        uint16_t check = crc(block) ^ offset_words[i];
+        for(int j=0; j<BLOCK_SIZE; j++) {
+            *bits++ = ((block & (1<<(BLOCK_SIZE-1))) != 0);
+            block <<= 1;
+        }
+        for(int j=0; j<POLY_DEG; j++) {
+            *bits++ = ((check & (1<<(POLY_DEG-1))) != 0);
+            check <<= 1;
+        }
+    }
+}
+
+/* Group carousel. The schedule is an ordered list of group types, each sent
+   'count' times in a row per pass (the default reproduces the classic
+   0A x4, 2A x4, 1A sequence). Types without content (no ECC, PTYN, EON or RT+)
+   are skipped. The whole carousel is encoded once per parameter change,
+   over enough passes for every type to come back to its first segment, so
+   emitting a group is a pointer bump whatever the number of enabled types.
 */
-void get_rds_group(int *buffer, int stereo, int ct_clock_enabled) { //ptyn?
-    static int state = 0;
-    static int ps_state = 0;
-    static int rt_state = 0;
-    static int af_state = 0;
-    uint16_t blocks[GROUP_LENGTH] = {rds_params.pi, 0, 0, 0};
-    
-    // Generate block content
-    if(!get_rds_ct_group(blocks, ct_clock_enabled)) { // CT (clock time) has priority on other group types (when its on)
-        if(state < 4) {
-            blocks[1] = 0x0000 | rds_params.tp << 10 | rds_params.pty << 5 | rds_params.ta << 4 | rds_params.ms << 3 | ps_state;
+enum {RDS_GROUP_0A, RDS_GROUP_1A, RDS_GROUP_2A, RDS_GROUP_3A, RDS_GROUP_10A, RDS_GROUP_11A, RDS_GROUP_14A, RDS_GROUP_TYPES};
+static const char *rds_group_names[RDS_GROUP_TYPES] = {"0A", "1A", "2A", "3A", "10A", "11A", "14A"};
+
+#define RDS_MAX_SCHEDULE 16
+#define RDS_CAROUSEL_MAX_GROUPS 1024
+#define RTPLUS_AID 0x4BD7
+
+static struct {
+    int type;
+    int count;
+} rds_schedule[RDS_MAX_SCHEDULE] = {
+    {RDS_GROUP_0A, 4}, {RDS_GROUP_2A, 4}, {RDS_GROUP_1A, 1}, {RDS_GROUP_10A, 1},
+    {RDS_GROUP_14A, 1}, {RDS_GROUP_3A, 1}, {RDS_GROUP_11A, 1}
+};
+static int rds_schedule_len = 7;
+
+static uint8_t carousel[RDS_CAROUSEL_MAX_GROUPS * BITS_PER_GROUP];
+static int carousel_groups = 0;
+static int carousel_pos = 0;
+static unsigned carousel_version = 0;
+
+static int gcd(int a, int b) {
+    while(b) { int t = a % b; a = b; b = t; }
+    return a;
+}
+
+static int af_states() {
+    return rds_params.af[0] ? rds_params.af[0]/2 + 1 : 1;
+}
+
+/* Number of groups of a type before its content repeats, 0 if it has nothing to send */
+static int group_period(int type) {
+    switch(type) {
+        case RDS_GROUP_0A: { int af = af_states(); return 4 / gcd(4, af) * af; }
+        case RDS_GROUP_1A: return rds_params.ecc != 0;
+        case RDS_GROUP_2A: return 16;
+        case RDS_GROUP_3A: return rds_params.rtplus_enabled;
+        case RDS_GROUP_10A: return rds_params.ptyn_enabled ? 2 : 0;
+        case RDS_GROUP_11A: return rds_params.rtplus_enabled;
+        case RDS_GROUP_14A: return rds_params.eon_pi ? 4 : 0;
+    }
+    return 0;
+}
+
+/* Fills blocks 1 to 3 of the n-th group of a type */
+static void build_group(int type, int n, uint16_t *blocks) {
+    uint16_t header = rds_params.tp << 10 | rds_params.pty << 5;
+    switch(type) {
+        case RDS_GROUP_0A: {
+            int ps_state = n % 4;
+            int af_state = (n % af_states()) * 2;
+            blocks[1] = 0x0000 | header | rds_params.ta << 4 | rds_params.ms << 3 | ps_state;
             blocks[1] |= ((rds_params.di >> (3 - ps_state)) & 0x01) << 2;
             if(rds_params.af[0]) { // AF
                 if(af_state == 0) { 
-			        blocks[2] = (rds_params.af[0] + 224) << 8 | rds_params.af[1]; // Send number of AFs and the first AF
-		        } else {
+                    blocks[2] = (rds_params.af[0] + 224) << 8 | rds_params.af[1]; // Send number of AFs and the first AF
+                } else {
                     if(rds_params.af[af_state+1]) { // If we have something next
-				        blocks[2] = rds_params.af[af_state] << 8 | rds_params.af[af_state+1]; // We send this and the 2nd one
-			        } else {
-				        blocks[2] = rds_params.af[af_state] << 8 | 0xCD; // No? then we just send this one
-			        }
-		        }
-                af_state = af_state + 2;
-		        if(af_state > rds_params.af[0]) af_state = 0;
+                        blocks[2] = rds_params.af[af_state] << 8 | rds_params.af[af_state+1]; // We send this and the 2nd one
+                    } else {
+                        blocks[2] = rds_params.af[af_state] << 8 | 0xCD; // No? then we just send this one
+                    }
+                }
             } else {
                 blocks[2] = 224 << 8 | 0xCD; // 224 is the base, since 244+0 is still 244, 0 AFs, the CD is just a filler
             }
             blocks[3] = rds_params.ps[ps_state*2] << 8 | rds_params.ps[ps_state*2+1];
-            ps_state++;
-            if(ps_state >= 4) ps_state = 0;
-        } else if(state < 8) { // Type 2A groups
-            blocks[1] = 0x2000 | rds_params.tp << 10 | rds_params.pty << 5 | rds_params.ab << 4 | rt_state;
+            break;
+        }
+        case RDS_GROUP_1A:
+            blocks[1] = 0x1000 | header;
+            blocks[2] = rds_params.ecc; // Things like LIC would require the first 1-3 bits set, but ecc has just 0s there
+            blocks[3] = 0; // unused
+            break;
+        case RDS_GROUP_2A: {
+            int rt_state = n % 16;
+            blocks[1] = 0x2000 | header | rds_params.ab << 4 | rt_state;
             blocks[2] = rds_params.rt[rt_state*4+0] << 8 | rds_params.rt[rt_state*4+1];
             blocks[3] = rds_params.rt[rt_state*4+2] << 8 | rds_params.rt[rt_state*4+3];
-            rt_state++;
-            if(rt_state >= 16) rt_state = 0;
-        } else {
-            blocks[1] = 0x1000 | rds_params.tp << 10 | rds_params.pty << 5;
-            blocks[2] = rds_params.ecc; // Things like LIC would require the first 1-3 bits set, but ecc has just 0s there
-            // block 3 unused
+            break;
+        }
+        case RDS_GROUP_3A: // ODA announcement : RT+ carried in 11A
+            blocks[1] = 0x3000 | header | (11 << 1);
+            blocks[2] = 0; // RT+ template 0, no CB
+            blocks[3] = RTPLUS_AID;
+            break;
+        case RDS_GROUP_10A: { // PTYN
+            int seg = n % 2;
+            blocks[1] = 0xA000 | header | rds_params.ptyn_ab << 4 | seg;
+            blocks[2] = rds_params.ptyn[seg*4+0] << 8 | rds_params.ptyn[seg*4+1];
+            blocks[3] = rds_params.ptyn[seg*4+2] << 8 | rds_params.ptyn[seg*4+3];
+            break;
+        }
+        case RDS_GROUP_11A: { // RT+ tags
+            int *t = rds_params.rtplus_tags;
+            blocks[1] = 0xB000 | header | rds_params.rtplus_toggle << 4 | rds_params.rtplus_running << 3 | ((t[0] >> 3) & 0x07);
+            blocks[2] = (t[0] & 0x07) << 13 | (t[1] & 0x3F) << 7 | (t[2] & 0x3F) << 1 | ((t[3] >> 5) & 0x01);
+            blocks[3] = (t[3] & 0x1F) << 11 | (t[4] & 0x3F) << 5 | (t[5] & 0x1F);
+            break;
+        }
+        case RDS_GROUP_14A: { // EON, PS of the other network (variants 0-3)
+            int variant = n % 4;
+            blocks[1] = 0xE000 | header | variant;
+            blocks[2] = rds_params.eon_ps[variant*2] << 8 | rds_params.eon_ps[variant*2+1];
+            blocks[3] = rds_params.eon_pi;
+            break;
         }
-    
-        state++;
-        if(state >= 8 && rds_params.ecc == 0) state = 0;
-        if(state >= 9 && rds_params.ecc != 0) state = 0;
     }
-    
-    // Calculate the checkword for each block and emit the bits
-    for(int i=0; i<GROUP_LENGTH; i++) {
-        uint16_t block = blocks[i];
-        uint16_t check = crc(block) ^ offset_words[i];
-        for(int j=0; j<BLOCK_SIZE; j++) {
-            *buffer++ = ((block & (1<<(BLOCK_SIZE-1))) != 0);
-            block <<= 1;
+}
+
+static void build_carousel(unsigned version) {
+    int period[RDS_GROUP_TYPES];
+    int sent[RDS_GROUP_TYPES] = {0};
+    for(int t=0; t<RDS_GROUP_TYPES; t++) period[t] = group_period(t);
+
+    // Passes needed for every type to wrap around exactly
+    int pass_groups = 0;
+    int passes = 1;
+    for(int i=0; i<rds_schedule_len; i++) {
+        int p = period[rds_schedule[i].type];
+        if(!p || !rds_schedule[i].count) continue;
+        pass_groups += rds_schedule[i].count;
+        int wrap = p / gcd(p, rds_schedule[i].count);
+        passes = passes / gcd(passes, wrap) * wrap;
+        if(passes > RDS_CAROUSEL_MAX_GROUPS) passes = RDS_CAROUSEL_MAX_GROUPS;
+    }
+
+    int groups = 0;
+    uint16_t blocks[GROUP_LENGTH] = {rds_params.pi, 0, 0, 0};
+    for(int pass=0; pass<passes && pass_groups; pass++) {
+        if(groups + pass_groups > RDS_CAROUSEL_MAX_GROUPS) break; // Long AF lists, some segments restart early
+        for(int i=0; i<rds_schedule_len; i++) {
+            int type = rds_schedule[i].type;
+            if(!period[type]) continue;
+            for(int c=0; c<rds_schedule[i].count; c++) {
+                build_group(type, sent[type]++, blocks);
+                encode_group(blocks, carousel + groups*BITS_PER_GROUP);
+                groups++;
+            }
         }
-        for(int j=0; j<POLY_DEG; j++) {
-            *buffer++= ((check & (1<<(POLY_DEG-1))) != 0);
-            check <<= 1;
+    }
+    if(groups == 0) { // Empty schedule, PS only
+        for(int n=0; n<4; n++) {
+            build_group(RDS_GROUP_0A, n, blocks);
+            encode_group(blocks, carousel + groups*BITS_PER_GROUP);
+            groups++;
+        }
+    }
+    carousel_groups = groups;
+    carousel_pos %= groups; // Go on from the same place in the new carousel
+    carousel_version = version;
+}
+
+/* Next group to send : a CT group at each minute change, else the next carousel group */
+static const uint8_t *next_group(int ct_clock_enabled) {
+    static uint8_t ct_bits[BITS_PER_GROUP];
+    uint16_t blocks[GROUP_LENGTH] = {rds_params.pi, 0, 0, 0};
+
+    if(get_rds_ct_group(blocks, ct_clock_enabled)) { // CT (clock time) has priority on other group types (when its on)
+        encode_group(blocks, ct_bits);
+        return ct_bits;
+    }
+
+    unsigned version = __atomic_load_n(&rds_version, __ATOMIC_ACQUIRE);
+    if(version != carousel_version) build_carousel(version);
+    const uint8_t *bits = carousel + carousel_pos*BITS_PER_GROUP;
+    carousel_pos++;
+    if(carousel_pos >= carousel_groups) carousel_pos = 0;
+    return bits;
+}
+
+void get_rds_group(int *buffer, int stereo, int ct_clock_enabled) {
+    const uint8_t *bits = next_group(ct_clock_enabled);
+    for(int i=0; i<BITS_PER_GROUP; i++) buffer[i] = bits[i];
+}
+
+/* Modulated symbol waveforms. The biphase filter spans 3 bits, so each bit period
+   of output only depends on the last 3 differentially encoded symbols: the 8
+   possible overlaps, already multiplied by the 57 kHz carrier (57 kHz is 4 times
+   the sample frequency we are working at, 228 kHz, and SAMPLES_PER_BIT is a multiple
+   of 4), are computed once from the pre-generated elementary waveform.
+ */
+#define SYMBOL_SPAN (FILTER_SIZE/SAMPLES_PER_BIT)
+
+static float symbol_lut[1<<SYMBOL_SPAN][SAMPLES_PER_BIT];
+static int symbol_lut_ready = 0;
+
+static void build_symbol_lut() {
+    for(int pattern=0; pattern<(1<<SYMBOL_SPAN); pattern++) {
+        for(int n=0; n<SAMPLES_PER_BIT; n++) {
+            double val = 0;
+            // bit k of the pattern is the symbol sent k bits ago, 1 is an inverted waveform
+            for(int k=0; k<SYMBOL_SPAN; k++) {
+                double w = waveform_biphase[k*SAMPLES_PER_BIT + n];
+                val += ((pattern >> k) & 1) ? -w : w;
+            }
+            symbol_lut[pattern][n] = val * carrier_57[(n+1) & 3]; // the output lags the symbol clock by one sample
         }
     }
+    symbol_lut_ready = 1;
 }
 
-/* Get a number of RDS samples. This generates the envelope of the waveform using
-   pre-generated elementary waveform samples, and then it amplitude-modulates the 
-   envelope with a 57 kHz carrier, which is very efficient as 57 kHz is 4 times the
-   sample frequency we are working at (228 kHz).
+/* Get a number of RDS samples. The envelope and the 57 kHz modulation come straight
+   from the symbol table, so each sample costs a lookup and the volume scaling.
  */
 void get_rds_samples(float *buffer, int count, int stereo, int ct_clock_enabled, float sample_volume) {
-    static int bit_buffer[BITS_PER_GROUP];
+    static const uint8_t *bit_buffer = NULL;
     static int bit_pos = BITS_PER_GROUP;
-    static float sample_buffer[SAMPLE_BUFFER_SIZE] = {0};
     
-    static int prev_output = 0;
     static int cur_output = 0;
-    static int cur_bit = 0;
-    static int sample_count = SAMPLES_PER_BIT;
-    static int inverting = 0;
-    static int phase = 0;
+    static int pattern = 0;
+    static int sample_count = SAMPLES_PER_BIT-1; // one sample of lag, see build_symbol_lut()
 
-    static int in_sample_index = 0;
-    static int out_sample_index = SAMPLE_BUFFER_SIZE-1;
-        
-    for(int i=0; i<count; i++) {
+    if(!symbol_lut_ready) build_symbol_lut();
+
+    while(count > 0) {
         if(sample_count >= SAMPLES_PER_BIT) {
             if(bit_pos >= BITS_PER_GROUP) {
-                get_rds_group(bit_buffer, stereo, ct_clock_enabled);
+                bit_buffer = next_group(ct_clock_enabled);
                 bit_pos = 0;
             }
             
             // do differential encoding
-            cur_bit = bit_buffer[bit_pos];
-            prev_output = cur_output;
-            cur_output = prev_output ^ cur_bit;
-            
-            inverting = (cur_output == 1);
-
-            float *src = waveform_biphase;
-            int idx = in_sample_index;
-
-            for(int j=0; j<FILTER_SIZE; j++) {
-                double val = (*src++);
-                if(inverting) val = -val;
-                sample_buffer[idx++] += val;
-                if(idx >= SAMPLE_BUFFER_SIZE) idx = 0;
-            }
-
-            in_sample_index += SAMPLES_PER_BIT;
-            if(in_sample_index >= SAMPLE_BUFFER_SIZE) in_sample_index -= SAMPLE_BUFFER_SIZE;
+            cur_output ^= bit_buffer[bit_pos];
+            pattern = ((pattern << 1) | cur_output) & ((1<<SYMBOL_SPAN)-1);
             
             bit_pos++;
             sample_count = 0;
         }
-        
-        double sample = sample_buffer[out_sample_index];
-        sample_buffer[out_sample_index] = 0;
-        out_sample_index++;
-        if(out_sample_index >= SAMPLE_BUFFER_SIZE) out_sample_index = 0;
-        
-        // modulate at 57 kHz
-        sample = sample * carrier_57[phase];
-        phase++;
-        if(phase >= 4) phase = 0;
-        
-        *buffer++ = (sample * sample_volume);
-        sample_count++;
+
+        int n = SAMPLES_PER_BIT - sample_count;
+        if(n > count) n = count;
+        const float *src = &symbol_lut[pattern][sample_count];
+        for(int i=0; i<n; i++) buffer[i] = src[i] * sample_volume;
+        buffer += n;
+        count -= n;
+        sample_count += n;
     }
 }
 
 void set_rds_pi(uint16_t pi_code) {
     rds_params.pi = pi_code;
+    rds_params_changed();
+}
+
+// RDS text fields are space padded, not terminated
+static void set_rds_text(char *field, const char *text, size_t len) {
+    size_t n = strnlen(text, len);
+    memcpy(field, text, n);
+    memset(field + n, ' ', len - n);
 }
 
 void set_rds_rt(char *rt) {
-    strncpy(rds_params.rt, rt, 64);
-    for(int i=0; i<64; i++) {
-        if(rds_params.rt[i] == 0) rds_params.rt[i] = 32;
-    }
+    set_rds_text(rds_params.rt, rt, RT_LENGTH);
+    rds_params_changed();
 }
 
 void set_rds_ps(char *ps) {
-    strncpy(rds_params.ps, ps, 8);
-    for(int i=0; i<8; i++) {
-        if(rds_params.ps[i] == 0) rds_params.ps[i] = 32;
-    }
+    set_rds_text(rds_params.ps, ps, PS_LENGTH);
+    rds_params_changed();
 }
 
 void set_rds_af(int *af_array) {
@@ -268,32 +435,104 @@ void set_rds_af(int *af_array) {
 	for(f = 1; f < af_array[0]+1; f++) {
 		rds_params.af[f] = af_array[f];
 	}
+	rds_params_changed();
 }
 
 void set_rds_pty(int pty) {
 	rds_params.pty = pty;
+	rds_params_changed();
 }
 
 void set_rds_di(int di) {
     rds_params.di = di;
+    rds_params_changed();
 }
 
 void set_rds_ta(int ta) {
 	rds_params.ta = ta;
+	rds_params_changed();
 }
 
 void set_rds_tp(int tp) {
 	rds_params.tp = tp;
+	rds_params_changed();
 }
 
 void set_rds_ms(int ms) {
 	rds_params.ms = ms;
+	rds_params_changed();
 }
 
 void set_rds_ab(int ab) {
 	rds_params.ab = ab;
+	rds_params_changed();
 }
 
 void set_rds_ecc(uint16_t ecc) {
 	rds_params.ecc = ecc;
+	rds_params_changed();
+}
+
+void set_rds_ptyn(char *ptyn) {
+    char previous[PTYN_LENGTH];
+    memcpy(previous, rds_params.ptyn, PTYN_LENGTH);
+    set_rds_text(rds_params.ptyn, ptyn, PTYN_LENGTH);
+    if(rds_params.ptyn_enabled && memcmp(previous, rds_params.ptyn, PTYN_LENGTH) != 0) rds_params.ptyn_ab ^= 1;
+    rds_params.ptyn_enabled = (ptyn[0] != 0);
+    rds_params_changed();
+}
+
+void set_rds_eon(uint16_t pi_code, char *ps) {
+    rds_params.eon_pi = pi_code;
+    set_rds_text(rds_params.eon_ps, ps, PS_LENGTH);
+    rds_params_changed();
+}
+
+/* RT+ tags as "type1,start1,length1,type2,start2,length2", length being the
+   RT+ length marker (characters - 1). A new set of tags toggles the item bit.
+   Returns -1 if the tags cannot be parsed.
+*/
+int set_rds_rtplus(char *tags) {
+    int t[6];
+    if(sscanf(tags, "%d,%d,%d,%d,%d,%d", &t[0], &t[1], &t[2], &t[3], &t[4], &t[5]) != 6) return -1;
+    memcpy(rds_params.rtplus_tags, t, sizeof(t));
+    rds_params.rtplus_toggle ^= rds_params.rtplus_enabled;
+    rds_params.rtplus_enabled = 1;
+    rds_params.rtplus_running = 1;
+    rds_params_changed();
+    return 0;
+}
+
+/* Group schedule as "0A:4,2A:4,1A:1,...", in sending order. Returns -1 on an
+   unknown group type, the schedule is then left untouched.
+*/
+int set_rds_groups(char *schedule) {
+    int len = 0;
+    int types[RDS_MAX_SCHEDULE], counts[RDS_MAX_SCHEDULE];
+    char spec[128];
+    strncpy(spec, schedule, sizeof(spec)-1);
+    spec[sizeof(spec)-1] = 0;
+    for(char *item = strtok(spec, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *colon = strchr(item, ':');
+        int count = 1;
+        if(colon) {
+            *colon = 0;
+            count = atoi(colon+1);
+        }
+        int type = -1;
+        for(int t=0; t<RDS_GROUP_TYPES; t++) {
+            if(strcmp(item, rds_group_names[t]) == 0) type = t;
+        }
+        if(type < 0 || count < 0 || len >= RDS_MAX_SCHEDULE) return -1;
+        types[len] = type;
+        counts[len] = count;
+        len++;
+    }
+    for(int i=0; i<len; i++) {
+        rds_schedule[i].type = types[i];
+        rds_schedule[i].count = counts[i];
+    }
+    rds_schedule_len = len;
+    rds_params_changed();
+    return 0;
 }
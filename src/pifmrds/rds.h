@@ -23,6 +23,7 @@
 
 #define RT_LENGTH 64
 #define PS_LENGTH 8
+#define PTYN_LENGTH 8
 #define GROUP_LENGTH 4
 
 #define POLY 0x1B9
@@ -50,5 +51,9 @@ extern void set_rds_tp(int tp);
 extern void set_rds_ms(int ms);
 extern void set_rds_ab(int ab);
 extern void set_rds_ecc(uint16_t ecc);
+extern void set_rds_ptyn(char *ptyn);
+extern void set_rds_eon(uint16_t pi_code, char *ps);
+extern int set_rds_rtplus(char *tags);
+extern int set_rds_groups(char *schedule);
 
 #endif /* RDS_H */
\ No newline at end of file
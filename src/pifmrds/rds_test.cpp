@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 
 extern "C"
 {
@@ -7,19 +9,194 @@ extern "C"
 #include "control_pipe.h"
 }
 
+// Encodes a carousel, then decodes the bitstream back like a receiver would:
+// block sync on the checkwords, then PS, RT, PTYN, ECC, AF, EON and RT+ from the groups.
+
+#define GROUPS 400
+
+static const uint16_t offset_words[] = {0x0FC, 0x198, 0x168, 0x1B4};
+
+static uint16_t checkword(uint16_t block) {
+    uint32_t reg = (uint32_t)block << POLY_DEG;
+    for(int i=BLOCK_SIZE+POLY_DEG-1; i>=POLY_DEG; i--) {
+        if(reg & (1u << i)) reg ^= (uint32_t)(POLY | (1 << POLY_DEG)) << (i - POLY_DEG);
+    }
+    return reg;
+}
+
+// Returns the offset (0-3 for A-D) a 26 bit block was sent with, -1 if its checkword is wrong
+static int block_offset(const int *bits, uint16_t *block) {
+    uint16_t info = 0, check = 0;
+    for(int i=0; i<BLOCK_SIZE; i++) info = (info << 1) | bits[i];
+    for(int i=0; i<POLY_DEG; i++) check = (check << 1) | bits[BLOCK_SIZE+i];
+    for(int o=0; o<4; o++) {
+        if((checkword(info) ^ offset_words[o]) == check) {
+            *block = info;
+            return o;
+        }
+    }
+    return -1;
+}
+
+int failures = 0;
+
+static void expect(const char *what, const char *got, const char *wanted) {
+    int ok = strcmp(got, wanted) == 0;
+    printf("%-6s \"%s\" %s\n", what, got, ok ? "ok" : "FAILED");
+    if(!ok) {
+        printf("       expected \"%s\"\n", wanted);
+        failures++;
+    }
+}
+
+static void expect_int(const char *what, int got, int wanted) {
+    int ok = got == wanted;
+    printf("%-6s %d %s\n", what, got, ok ? "ok" : "FAILED");
+    if(!ok) {
+        printf("       expected %d\n", wanted);
+        failures++;
+    }
+}
+
 int main() {
     set_rds_pi(0xff);
     set_rds_ps("TEST");
-    set_rds_ecc(0xFF);
+    set_rds_rt("Artist - Title");
+    set_rds_ecc(0xE1);
     int af_array[] = {3, 2, 1, 0};
     set_rds_af(af_array);
-    for(int i = 0; i < 10; i++) {
-        int buffer[BITS_PER_GROUP];
-        get_rds_group(buffer, 0, 0);
-        for(int j = 0; j < BITS_PER_GROUP; j++) {
-            printf("%d", buffer[j]);
+    set_rds_ptyn("JAZZ");
+    set_rds_eon(0x1234, "OTHER");
+    set_rds_rtplus("4,0,5,1,9,4");
+    if(set_rds_groups("0A:4,2A:2,1A:1,10A:1,14A:1,3A:1,11A:2") < 0) printf("Group schedule rejected\n");
+
+    static int stream[GROUPS * BITS_PER_GROUP + 13];
+    int len = 13; // Start off block boundary, the decoder has to find it
+    for(int g=0; g<GROUPS; g++) {
+        get_rds_group(stream+len, 0, 0);
+        len += BITS_PER_GROUP;
+    }
+
+    // Block sync : first position where A, B, C, D follow each other
+    int pos = 0;
+    uint16_t block;
+    while(pos + BITS_PER_GROUP <= len) {
+        int o = 0;
+        while(o < GROUP_LENGTH && block_offset(stream + pos + o*(BLOCK_SIZE+POLY_DEG), &block) == o) o++;
+        if(o == GROUP_LENGTH) break;
+        pos++;
+    }
+    expect_int("sync", pos, 13);
+
+    char ps[PS_LENGTH+1] = {0}, rt[RT_LENGTH+1] = {0}, ptyn[PTYN_LENGTH+1] = {0}, eon_ps[PS_LENGTH+1] = {0};
+    int counts[16] = {0};
+    int ecc = -1, ptyn_ab = -1, eon_pi = -1, oda_aid = -1, oda_group = -1, af_count = -1, af_seen = 0;
+    int rtplus[6] = {-1, -1, -1, -1, -1, -1};
+    int bad = 0;
+    for(; pos + BITS_PER_GROUP <= len; pos += BITS_PER_GROUP) {
+        uint16_t b[GROUP_LENGTH];
+        for(int i=0; i<GROUP_LENGTH; i++) {
+            if(block_offset(stream + pos + i*(BLOCK_SIZE+POLY_DEG), &b[i]) != i) bad++;
+        }
+        if(b[0] != 0xff) bad++;
+        int type = b[1] >> 12;
+        if(b[1] & 0x0800) bad++; // Only version A groups are sent
+        counts[type]++;
+        switch(type) {
+            case 0: {
+                int seg = b[1] & 3;
+                ps[seg*2] = b[3] >> 8;
+                ps[seg*2+1] = b[3] & 0xFF;
+                for(int i=0; i<2; i++) {
+                    int code = i ? (b[2] & 0xFF) : (b[2] >> 8);
+                    if(code >= 224 && code <= 249) af_count = code - 224;
+                    else if(code >= 1 && code <= 204) af_seen |= 1 << code;
+                }
+                break;
+            }
+            case 1: ecc = b[2] & 0xFF; break;
+            case 2: {
+                int seg = b[1] & 0xF;
+                rt[seg*4] = b[2] >> 8;
+                rt[seg*4+1] = b[2] & 0xFF;
+                rt[seg*4+2] = b[3] >> 8;
+                rt[seg*4+3] = b[3] & 0xFF;
+                break;
+            }
+            case 3: oda_group = b[1] & 0x1F; oda_aid = b[3]; break;
+            case 10: {
+                int seg = b[1] & 1;
+                ptyn_ab = (b[1] >> 4) & 1;
+                ptyn[seg*4] = b[2] >> 8;
+                ptyn[seg*4+1] = b[2] & 0xFF;
+                ptyn[seg*4+2] = b[3] >> 8;
+                ptyn[seg*4+3] = b[3] & 0xFF;
+                break;
+            }
+            case 11:
+                rtplus[0] = (b[1] & 7) << 3 | b[2] >> 13;
+                rtplus[1] = (b[2] >> 7) & 0x3F;
+                rtplus[2] = (b[2] >> 1) & 0x3F;
+                rtplus[3] = (b[2] & 1) << 5 | b[3] >> 11;
+                rtplus[4] = (b[3] >> 5) & 0x3F;
+                rtplus[5] = b[3] & 0x1F;
+                break;
+            case 14: {
+                int variant = b[1] & 0xF;
+                if(variant < 4) {
+                    eon_ps[variant*2] = b[2] >> 8;
+                    eon_ps[variant*2+1] = b[2] & 0xFF;
+                }
+                eon_pi = b[3];
+                break;
+            }
         }
     }
-    printf("\n");
-    return 0;
-}
\ No newline at end of file
+    expect_int("errors", bad, 0);
+    expect("PS", ps, "TEST    ");
+    expect("RT", rt, "Artist - Title                                                  ");
+    expect("PTYN", ptyn, "JAZZ    ");
+    expect_int("PTYN AB", ptyn_ab, 0);
+    expect("EON PS", eon_ps, "OTHER   ");
+    expect_int("EON PI", eon_pi, 0x1234);
+    expect_int("ECC", ecc, 0xE1);
+    expect_int("AF n", af_count, 3);
+    expect_int("AFs", af_seen, (1<<2) | (1<<1));
+    expect_int("ODA", oda_aid, 0x4BD7);
+    expect_int("ODA gr", oda_group, 11 << 1);
+    char tags[64];
+    snprintf(tags, sizeof(tags), "%d,%d,%d,%d,%d,%d", rtplus[0], rtplus[1], rtplus[2], rtplus[3], rtplus[4], rtplus[5]);
+    expect("RT+", tags, "4,0,5,1,9,4");
+
+    // Share of each group type follows the schedule (13 groups per pass)
+    int total = 0;
+    for(int t=0; t<16; t++) total += counts[t];
+    printf("Groups : 0A %d, 1A %d, 2A %d, 3A %d, 10A %d, 11A %d, 14A %d of %d\n",
+        counts[0], counts[1], counts[2], counts[3], counts[10], counts[11], counts[14], total);
+    expect_int("0A", (counts[0] * 13 + total/2) / total, 4);
+    expect_int("11A", (counts[11] * 13 + total/2) / total, 2);
+    expect_int("4A", counts[4], 0);
+
+    // A new PTYN flips its A/B flag, so receivers clear the old name. Groups from here on start on
+    // a block boundary.
+    set_rds_ptyn("ROCK");
+    memset(ptyn, 0, sizeof(ptyn));
+    ptyn_ab = -1;
+    for(int g=0; g<GROUPS/10; g++) {
+        uint16_t b[GROUP_LENGTH];
+        get_rds_group(stream, 0, 0);
+        for(int i=0; i<GROUP_LENGTH; i++) block_offset(stream + i*(BLOCK_SIZE+POLY_DEG), &b[i]);
+        if(b[1] >> 12 != 10) continue;
+        int seg = b[1] & 1;
+        ptyn_ab = (b[1] >> 4) & 1;
+        ptyn[seg*4] = b[2] >> 8;
+        ptyn[seg*4+1] = b[2] & 0xFF;
+        ptyn[seg*4+2] = b[3] >> 8;
+        ptyn[seg*4+3] = b[3] & 0xFF;
+    }
+    expect("PTYN", ptyn, "ROCK    ");
+    expect_int("PTYN AB", ptyn_ab, 1);
+
+    printf(failures ? "FAILED\n" : "PASSED\n");
+    return failures != 0;
+}
@@ -0,0 +1,272 @@
+/*
+    render.c: pifmrds-render, writes the pifmrds multiplex to a file instead of
+    transmitting it. Same fm_mpx_get_samples and RDS path as pi_fm_rds, run as
+    fast as the CPU allows, 228 kHz mono float, 1.0 being 100% modulation
+    (75 kHz deviation). A .wav output is a float WAV, anything else raw
+    native float (- for stdout). Throughput is reported at the end, so this is
+    also the way to profile the DSP path (perf record) on any machine: it
+    needs libsndfile only.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sndfile.h>
+
+#include "rds.h"
+#include "fm_mpx.h"
+
+#define MPX_RATE 228000
+#define MPX_BLOCK (MPX_RATE/200)    // as pi_fm_rds
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void usage(const char *arg) {
+    fprintf(stderr, "Unrecognised argument: %s.\n"
+        "Syntax: pifmrds-render -o file.wav|file.raw|- [-audio file] [-playlist file] [-mpx file] [-mpxformat s16|f32] [-mpxrate rate]\n"
+        "                       [-crossfade seconds] [-duration seconds] [-raw] [-rawsamplerate rate] [-rawchannels channels]\n"
+        "                       [-pi pi_code] [-ecc ecc_code] [-ps ps_text] [-rt rt_text]\n"
+        "                       [-pty program_type] [-disablerds] [-disablestereo] [-ct] [-preemphasis us|eu|off] [-resampler fast|best]\n"
+        "                       [-audiogain gain] [-nocompressor] [-bands 0-5] [-lookahead ms] [-compositeclip level] [-oversample 1|2|4]\n", arg);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    char *output = NULL, *audio_file = NULL, *playlist = NULL, *composite = NULL;
+    char *ps = "Pi-FmSa", *rt = "Broadcasting on a Raspberry Pi: Simply Advanced";
+    uint16_t pi = 0x00ff, ecc = 0;
+    int pty = 0, raw = 0, raw_rate = 44100, raw_channels = 2, resampler = RESAMPLER_FAST;
+    int mpx_format = COMPOSITE_FILE, mpx_rate = 0, raw_rate_given = 0;
+    double preemphasis = 50e-6, duration = 0;
+    float crossfade = 0;
+    fm_mpx_data data = {
+        .drds = 0,
+        .compressor_decay = 0.999995,
+        .compressor_attack = 1.0,
+        .compressor_max_gain_recip = 0.01,
+        .dstereo = 0,
+        .audio_gain = 1,
+        .enablecompressor = 1,
+        .rds_ct_enabled = 0,        // the clock time of the render is not the one of the broadcast
+        .rds_volume = 1.0,
+        .paused = 0,
+        .generate_multiplex = 1,
+        .limiter_threshold = 0.9,
+        .processor_bands = 0,
+        .lookahead_ms = 0,
+        .composite_clip = 0,
+        .stereo_oversample = 1,
+        .wait_for_audio = 1,
+    };
+
+    for(int i=1; i<argc; i++) {
+        char *arg = argv[i];
+        char *param = i+1 < argc ? argv[i+1] : NULL;
+        if(strcmp("-o", arg)==0 && param != NULL) {
+            i++;
+            output = param;
+        } else if(strcmp("-audio", arg)==0 && param != NULL) {
+            i++;
+            audio_file = param;
+        } else if(strcmp("-playlist", arg)==0 && param != NULL) {
+            i++;
+            playlist = param;
+        } else if(strcmp("-mpx", arg)==0 && param != NULL) {
+            i++;
+            composite = param;
+        } else if(strcmp("-mpxformat", arg)==0 && param != NULL) {
+            i++;
+            if(strcmp("s16", param)==0) mpx_format = COMPOSITE_S16;
+            else if(strcmp("f32", param)==0 || strcmp("float", param)==0) mpx_format = COMPOSITE_FLOAT;
+            else usage(param);
+        } else if(strcmp("-mpxrate", arg)==0 && param != NULL) {
+            i++;
+            mpx_rate = atoi(param);
+            if(mpx_rate <= 0) usage(param);
+        } else if(strcmp("-crossfade", arg)==0 && param != NULL) {
+            i++;
+            crossfade = atof(param);
+        } else if(strcmp("-duration", arg)==0 && param != NULL) {
+            i++;
+            duration = atof(param);
+        } else if(strcmp("-raw", arg)==0) {
+            raw = 1;
+        } else if(strcmp("-rawsamplerate", arg)==0 && param != NULL) {
+            i++;
+            raw_rate = atoi(param);
+            if(raw_rate <= 0) usage(param);
+            raw_rate_given = 1;
+        } else if(strcmp("-rawchannels", arg)==0 && param != NULL) {
+            i++;
+            raw_channels = atoi(param);
+        } else if(strcmp("-pi", arg)==0 && param != NULL) {
+            i++;
+            pi = (uint16_t)strtoul(param, NULL, 16);
+        } else if(strcmp("-ecc", arg)==0 && param != NULL) {
+            i++;
+            ecc = (uint16_t)strtoul(param, NULL, 16);
+        } else if(strcmp("-ps", arg)==0 && param != NULL) {
+            i++;
+            ps = param;
+        } else if(strcmp("-rt", arg)==0 && param != NULL) {
+            i++;
+            rt = param;
+        } else if(strcmp("-pty", arg)==0 && param != NULL) {
+            i++;
+            pty = atoi(param);
+        } else if(strcmp("-disablerds", arg)==0) {
+            data.drds = 1;
+        } else if(strcmp("-disablestereo", arg)==0) {
+            data.dstereo = 1;
+        } else if(strcmp("-ct", arg)==0) {
+            data.rds_ct_enabled = 1;
+        } else if(strcmp("-preemphasis", arg)==0 && param != NULL) {
+            i++;
+            if(strcmp("us", param)==0) preemphasis = 75e-6;
+            else if(strcmp("eu", param)==0) preemphasis = 50e-6;
+            else if(strcmp("off", param)==0 || strcmp("0", param)==0) preemphasis = 0;
+            else preemphasis = atof(param) * 1e-6;
+        } else if(strcmp("-resampler", arg)==0 && param != NULL) {
+            i++;
+            if(strcmp("best", param)==0) resampler = RESAMPLER_BEST;
+            else if(strcmp("fast", param)==0) resampler = RESAMPLER_FAST;
+            else usage(param);
+        } else if(strcmp("-audiogain", arg)==0 && param != NULL) {
+            i++;
+            data.audio_gain = atof(param);
+        } else if(strcmp("-nocompressor", arg)==0) {
+            data.enablecompressor = 0;
+        } else if(strcmp("-bands", arg)==0 && param != NULL) {
+            i++;
+            data.processor_bands = atoi(param);
+        } else if(strcmp("-lookahead", arg)==0 && param != NULL) {
+            i++;
+            data.lookahead_ms = atof(param);
+        } else if(strcmp("-compositeclip", arg)==0 && param != NULL) {
+            i++;
+            data.composite_clip = atof(param);
+        } else if(strcmp("-oversample", arg)==0 && param != NULL) {
+            i++;
+            data.stereo_oversample = atoi(param);
+        } else {
+            usage(arg);
+        }
+    }
+    if(output == NULL) usage("(no -o output)");
+
+    // Without a duration : one pass over the audio file, or until stdin closes
+    if(composite) {
+        audio_file = composite;
+        if(mpx_format == COMPOSITE_FILE && raw) mpx_format = COMPOSITE_S16;
+        if(mpx_rate == 0) mpx_rate = raw_rate_given ? raw_rate : 192000;
+    }
+    if(duration <= 0 && audio_file != NULL && audio_file[0] != '-') {
+        SF_INFO info;
+        memset(&info, 0, sizeof(info));
+        if(composite && mpx_format != COMPOSITE_FILE) {
+            info.format = SF_FORMAT_RAW | (mpx_format == COMPOSITE_FLOAT ? SF_FORMAT_FLOAT : SF_FORMAT_PCM_16);
+            info.samplerate = mpx_rate;
+            info.channels = 1;
+        } else if(raw) {
+            info.format = SF_FORMAT_RAW | SF_FORMAT_PCM_16;
+            info.samplerate = raw_rate;
+            info.channels = raw_channels;
+        }
+        SNDFILE *probe = sf_open(audio_file, SFM_READ, &info);
+        if(probe != NULL) {
+            duration = (double)info.frames / info.samplerate;
+            sf_close(probe);
+        }
+    }
+    int until_input_ends = duration <= 0 && audio_file != NULL && audio_file[0] == '-';
+    if(duration <= 0 && !until_input_ends) {
+        fprintf(stderr, "Error: give a -duration for a playlist or without audio.\n");
+        return 1;
+    }
+
+    // The multiplex on stdout, the messages of fm_mpx and rds go to stderr
+    FILE *out = NULL;
+    if(strcmp(output, "-") == 0) {
+        out = fdopen(dup(STDOUT_FILENO), "wb");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    if(composite) {
+        if(fm_mpx_open_composite(composite, MPX_BLOCK, mpx_format, mpx_rate) < 0) return 1;
+    } else if(playlist) {
+        if(fm_mpx_open_playlist(playlist, MPX_BLOCK, preemphasis, 15000, crossfade, resampler) < 0) return 1;
+    } else if(fm_mpx_open(audio_file, MPX_BLOCK, raw, preemphasis, raw_rate, raw_channels, 15000, resampler) < 0) {
+        return 1;
+    }
+    set_rds_pi(pi);
+    set_rds_ecc(ecc);
+    set_rds_ps(ps);
+    set_rds_rt(rt);
+    set_rds_pty(pty);
+    set_rds_ab(0);
+    set_rds_ms(1);
+    set_rds_tp(0);
+    set_rds_ta(0);
+    set_rds_di(!data.dstereo);
+
+    SNDFILE *wav = NULL;
+    size_t len = strlen(output);
+    if(len > 4 && strcasecmp(output + len - 4, ".wav") == 0) {
+        SF_INFO info;
+        memset(&info, 0, sizeof(info));
+        info.samplerate = MPX_RATE;
+        info.channels = 1;
+        info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+        wav = sf_open(output, SFM_WRITE, &info);
+    } else if(out == NULL) {
+        out = fopen(output, "wb");
+    }
+    if(wav == NULL && out == NULL) {
+        fprintf(stderr, "Error: could not open %s for writing.\n", output);
+        return 1;
+    }
+
+    fflush(stdout);
+    uint64_t total = until_input_ends ? UINT64_MAX : (uint64_t)(duration * MPX_RATE);
+    uint64_t samples = 0;
+    float mpx[MPX_BLOCK];
+    double wall = clock_seconds(CLOCK_MONOTONIC), cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    double generate = 0;
+    while(samples < total) {
+        fm_mpx_stats stats;
+        fm_mpx_get_stats(&stats);
+        if(until_input_ends && stats.input_ended) break;
+        double start = clock_seconds(CLOCK_MONOTONIC);
+        if(fm_mpx_get_samples(mpx, &data) < 0) break;
+        generate += clock_seconds(CLOCK_MONOTONIC) - start;
+
+        int n = total - samples < MPX_BLOCK ? total - samples : MPX_BLOCK;
+        for(int i=0; i<n; i++) mpx[i] *= 0.1f; // 10 is 100% modulation
+        if(wav ? sf_writef_float(wav, mpx, n) != n : fwrite(mpx, sizeof(float), n, out) != (size_t)n) {
+            fprintf(stderr, "Error writing %s\n", output);
+            break;
+        }
+        samples += n;
+    }
+    wall = clock_seconds(CLOCK_MONOTONIC) - wall;
+    cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+    if(wav) sf_close(wav);
+    if(out) fclose(out);
+    fm_mpx_close();
+
+    double seconds = (double)samples / MPX_RATE;
+    fprintf(stderr, "Rendered %.1f s of multiplex in %.2f s (%.1fx realtime), %.2f s CPU with the decoder\n",
+        seconds, wall, wall > 0 ? seconds/wall : 0, cpu);
+    fprintf(stderr, "fm_mpx_get_samples : %.1f ns per sample, %.2f Msamples/s\n",
+        samples ? generate*1e9/samples : 0, generate > 0 ? samples/generate/1e6 : 0);
+    return 0;
+}
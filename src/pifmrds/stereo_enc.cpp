@@ -0,0 +1,196 @@
+/*
+    stereo_enc.cpp: band-limited stereo multiplex generator of fm_mpx.c and
+    its instances, see stereo_enc.h
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "stereo_enc.h"
+
+#define PI 3.14159265359
+#define MPX_RATE 228000
+
+#define ERROR_CUTOFF    15500.0 // clip error low-pass, stop band from 19 kHz
+#define ERROR_KAISER    4.55    // about 50 dB of stop band
+#define PILOT_LEVEL     0.9f
+#define AUDIO_LEVEL     4.5f    // sum and difference, 9 is 100% audio modulation
+
+// Worst case cost bound : at most one corrected sample in this many (per channel, whatever the
+// oversampling), the others are clipped plain. Only reached on grossly overdriven audio.
+#define CLIP_BUDGET     4
+
+static double bessel_i0(double x) {
+    double sum = 1, term = 1;
+    for(int k=1; k<30; k++) {
+        term *= (x/(2*k)) * (x/(2*k));
+        sum += term;
+    }
+    return sum;
+}
+
+static void notch_init(stereo_biquad *f, double freq, double q) {
+    double w0 = 2*PI*freq/MPX_RATE;
+    double alpha = sin(w0)/(2*q);
+    double a0 = 1 + alpha;
+    f->b0 = 1/a0;
+    f->b1 = -2*cos(w0)/a0;
+    f->b2 = 1/a0;
+    f->a1 = -2*cos(w0)/a0;
+    f->a2 = (1 - alpha)/a0;
+    f->z1 = f->z2 = 0;
+}
+
+static inline float biquad_run(stereo_biquad *f, float x) {
+    float y = f->b0*x + f->z1;
+    f->z1 = f->b1*x - f->a1*y + f->z2;
+    f->z2 = f->b2*x - f->a2*y;
+    return y;
+}
+
+void stereo_enc_init(stereo_enc *e, int oversample) {
+    memset(e, 0, sizeof(*e));
+    if(oversample > 2) oversample = 4;
+    else if(oversample < 1) oversample = 1;
+    e->oversample = oversample;
+
+    // Kaiser windowed sinc at oversample*228 kHz, split in phases
+    int len = oversample*2*STEREO_ENC_DELAY + 1;
+    int center = oversample*STEREO_ENC_DELAY;
+    double full[STEREO_ENC_MAX_OVERSAMPLE*2*STEREO_ENC_DELAY + 1];
+    double sum = 0;
+    for(int i=0; i<len; i++) {
+        double t = (double)(i - center)/oversample; // in 228 kHz samples
+        double r = (double)(i - center)/center;
+        double sinc = t == 0 ? 1 : sin(2*PI*ERROR_CUTOFF/MPX_RATE*t)/(2*PI*ERROR_CUTOFF/MPX_RATE*t);
+        full[i] = sinc * bessel_i0(ERROR_KAISER*sqrt(1 - r*r)) / bessel_i0(ERROR_KAISER);
+        sum += full[i];
+    }
+    for(int p=0; p<oversample; p++) {
+        for(int j=0; j<=2*STEREO_ENC_DELAY; j++) {
+            int i = oversample*j - p;
+            e->error_filter[p][j] = i >= 0 ? full[i]/sum : 0;
+        }
+    }
+    // Hann windowed sinc for the samples between, the audio being under 16 kHz 8 taps are plenty
+    for(int p=1; p<oversample; p++) {
+        double frac = (double)p/oversample;
+        for(int k=0; k<2*STEREO_ENC_INTERP; k++) {
+            double t = k - (STEREO_ENC_INTERP-1) - frac; // taps at -3..+4 around the point
+            double w = 0.5 + 0.5*cos(PI*t/STEREO_ENC_INTERP);
+            e->interp[p][k] = sin(PI*t)/(PI*t) * w;
+        }
+    }
+
+    for(int i=0; i<12; i++) e->sine[i] = sin(2*PI*i/12);
+    notch_init(&e->protect[0], 19000, 4);
+    notch_init(&e->protect[1], 55600, 6);
+    notch_init(&e->protect[2], 58400, 6);
+}
+
+// Clip error of one channel at high rate sample oversample*tau+p, spread over the outputs tau-DELAY..tau+DELAY
+static inline void scatter(stereo_enc *e, float *corr, unsigned tau, int p, float err) {
+    const float *h = e->error_filter[p];
+    unsigned base = tau - STEREO_ENC_DELAY;
+    for(int j=0; j<=2*STEREO_ENC_DELAY; j++) corr[(base + j) & (STEREO_ENC_RING-1)] += err * h[j];
+}
+
+static inline float clip_error(float x, float threshold) {
+    if(x > threshold) return threshold - x;
+    if(x < -threshold) return -threshold - x;
+    return 0;
+}
+
+template<unsigned Flags> static void run(stereo_enc *e, const float *left, const float *right, float *mpx, int n,
+    float threshold, float composite_clip) {
+    const bool stereo = Flags & STEREO_ENC_STEREO;
+    const bool composite = stereo && (Flags & STEREO_ENC_COMPOSITE);
+    const bool oversampled = Flags & STEREO_ENC_OVERSAMPLE;
+    const unsigned mask = STEREO_ENC_RING-1;
+    const int channels = stereo ? 2 : 1;
+    const int os = e->oversample;
+    int budget = n*channels/CLIP_BUDGET;
+    float full_scale = threshold > 1 ? threshold : 1;
+
+    for(int i=0; i<n; i++) {
+        unsigned t = e->count++;
+        e->x[0][t & mask] = left[i];
+        e->x[1][t & mask] = stereo ? right[i] : 0;
+        unsigned tau = t - STEREO_ENC_INTERP;
+        unsigned u = tau - STEREO_ENC_DELAY;
+        float y[2];
+
+        for(int c=0; c<channels; c++) {
+            float *x = e->x[c];
+            float *corr = e->corr[c];
+            float now = x[tau & mask];
+            float err = clip_error(now, threshold);
+            if(err != 0 && budget > 0) {
+                scatter(e, corr, tau, 0, err);
+                budget--;
+                e->clipped++;
+            }
+            // Peaks between samples, only looked for near the threshold
+            if(oversampled && (fabsf(now) > 0.7f*threshold || fabsf(x[(tau+1) & mask]) > 0.7f*threshold)) {
+                for(int p=1; p<os; p++) {
+                    float between = 0;
+                    for(int k=0; k<2*STEREO_ENC_INTERP; k++) between += e->interp[p][k] * x[(tau - (STEREO_ENC_INTERP-1) + k) & mask];
+                    err = clip_error(between, threshold);
+                    if(err != 0 && budget > 0) {
+                        scatter(e, corr, tau, p, err);
+                        budget--;
+                    }
+                }
+            }
+            y[c] = x[u & mask] + corr[u & mask];
+            corr[u & mask] = 0;
+            if(!composite && fabsf(y[c]) > full_scale) {
+                // Filter overshoot or budget exhausted
+                y[c] = y[c] > 0 ? full_scale : -full_scale;
+                e->hard_clipped++;
+            }
+        }
+
+        if(stereo) {
+            float c19 = e->sine[e->phase];
+            float c38 = e->sine[(2*e->phase) % 12];
+            float audio = AUDIO_LEVEL*(y[0]+y[1]) + AUDIO_LEVEL*c38*(y[0]-y[1]);
+            if(composite) {
+                float level = 2*AUDIO_LEVEL*composite_clip;
+                float err = clip_error(audio, level);
+                // The filters run on every sample, their state rings down after a clip
+                err = biquad_run(&e->protect[0], err);
+                err = biquad_run(&e->protect[1], err);
+                err = biquad_run(&e->protect[2], err);
+                audio += err;
+            }
+            mpx[i] += audio + PILOT_LEVEL*c19;
+        } else {
+            mpx[i] += AUDIO_LEVEL*y[0];
+        }
+        if(++e->phase == 12) e->phase = 0;
+    }
+    // Ringing down between clips the notch state would go denormal
+    for(int k=0; k<3; k++) {
+        if(fabsf(e->protect[k].z1) < 1e-20f) e->protect[k].z1 = 0;
+        if(fabsf(e->protect[k].z2) < 1e-20f) e->protect[k].z2 = 0;
+    }
+}
+
+static const stereo_enc_fn variants[STEREO_ENC_VARIANTS] = {
+    run<0>, run<1>, run<2>, run<3>, run<4>, run<5>, run<6>, run<7>,
+};
+
+stereo_enc_fn stereo_enc_select(unsigned flags) {
+    return variants[flags % STEREO_ENC_VARIANTS];
+}
+
+unsigned stereo_enc_flags(const stereo_enc *e, int stereo, float composite_clip) {
+    return (stereo ? STEREO_ENC_STEREO : 0) | (composite_clip > 0 ? STEREO_ENC_COMPOSITE : 0) |
+        (e->oversample > 1 ? STEREO_ENC_OVERSAMPLE : 0);
+}
+
+void stereo_enc_process(stereo_enc *e, const float *left, const float *right, float *mpx, int n,
+    int stereo, float threshold, float composite_clip) {
+    stereo_enc_select(stereo_enc_flags(e, stereo, composite_clip))(e, left, right, mpx, n, threshold, composite_clip);
+}
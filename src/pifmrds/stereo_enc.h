@@ -0,0 +1,76 @@
+/*
+    stereo_enc.h: stereo multiplex generator of fm_mpx.c
+
+    Takes the 228 kHz L and R from the upsampling FIR, a block at a time.
+    Peaks over the limiter threshold are clipped band-limited: the clip error
+    goes through a linear phase 15.5 kHz low-pass before it is added back (the
+    audio being delayed by the filter's half length), so clipping puts nothing
+    into the pilot, the upper sideband edge or the RDS band. The error is only
+    nonzero on clipped samples, so the filter is applied by scattering those
+    alone, and costs nothing while the audio stays under the threshold.
+    With oversampling the clipper also sees the peaks between samples
+    (polyphase interpolation, one phase per extra sample).
+    The composite clipper runs its error through a 19 kHz notch and a 57 kHz
+    band-stop, pilot and RDS are added afterwards and never clipped.
+    Pilot and subcarrier come from one phase counter that runs on every sample,
+    so they stay locked to the RDS 57 kHz whether stereo is on or not.
+
+    As for mpx_kernel.h, every combination of the STEREO_ENC_ flags is its own
+    instance of one C++ template (stereo_enc.cpp), so the loop carries no test
+    of a setting. fm_mpx.c looks up another instance only when they change.
+*/
+
+#ifndef STEREO_ENC_H
+#define STEREO_ENC_H
+
+#define STEREO_ENC_DELAY 47         // half length of the clip error filter, samples at 228 kHz
+#define STEREO_ENC_MAX_OVERSAMPLE 4
+#define STEREO_ENC_INTERP 4         // half length of the interpolator, so look-ahead at 228 kHz
+#define STEREO_ENC_RING 256         // power of 2, more than 2*STEREO_ENC_DELAY+STEREO_ENC_INTERP
+
+#define STEREO_ENC_STEREO       1   // L and R, pilot ; otherwise mono, left only
+#define STEREO_ENC_COMPOSITE    2   // composite clipper, stereo only
+#define STEREO_ENC_OVERSAMPLE   4   // clips the peaks between samples too, oversample > 1
+#define STEREO_ENC_VARIANTS     8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    float b0, b1, b2, a1, a2;
+    float z1, z2;
+} stereo_biquad;
+
+typedef struct {
+    int oversample;                 // 1, 2 or 4
+    float error_filter[STEREO_ENC_MAX_OVERSAMPLE][2*STEREO_ENC_DELAY+1]; // per phase, unity DC gain over all phases
+    float interp[STEREO_ENC_MAX_OVERSAMPLE][2*STEREO_ENC_INTERP];       // phase p : sample at +p/oversample
+    float x[2][STEREO_ENC_RING];    // L, R input
+    float corr[2][STEREO_ENC_RING]; // clip corrections waiting for their output sample
+    unsigned count;                 // input samples, wraps
+    int phase;                      // pilot phase, 12 samples per period at 228 kHz
+    float sine[12];
+    stereo_biquad protect[3];       // composite clip error : 19 kHz notch, 57 kHz band-stop
+    unsigned long clipped;          // samples corrected by the band-limited clipper
+    unsigned long hard_clipped;     // over budget or over full scale, clipped plain
+} stereo_enc;
+
+// Adds the audio multiplex of n samples to mpx. Mono uses left only.
+// composite_clip : level of the composite clipper (1 = 100% audio modulation), ignored without STEREO_ENC_COMPOSITE
+typedef void (*stereo_enc_fn)(stereo_enc *e, const float *left, const float *right, float *mpx, int n,
+    float threshold, float composite_clip);
+
+void stereo_enc_init(stereo_enc *e, int oversample);
+stereo_enc_fn stereo_enc_select(unsigned flags);
+// Flags for the settings, composite_clip 0 is off
+unsigned stereo_enc_flags(const stereo_enc *e, int stereo, float composite_clip);
+// Looks up the instance on every call
+void stereo_enc_process(stereo_enc *e, const float *left, const float *right, float *mpx, int n,
+    int stereo, float threshold, float composite_clip);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,6 +26,8 @@
 #include <cstring>
 #include <signal.h>
 #include <stdlib.h>
+#include "../iqdsp/iqconvert.h"
+#include "../iqdsp/iqreader.h"
 
 
 #define PROGRAM_VERSION "2.0"
@@ -83,9 +85,7 @@ int main(int argc, char* argv[])
 	float ppmpll=0.0;
 	int SetDma=0;
     char *FileName=NULL;
-    FILE *FileInHandle=NULL;
     bool loop_mode_flag=false;
-    bool useStdin;
     int Harmonic=1;
 	while(1)
 	{
@@ -164,19 +164,23 @@ int main(int argc, char* argv[])
 		}/* end switch a */
 	}/* end while getopt() */
 
+	typedef struct {
+		double Frequency;
+		uint32_t WaitForThisSample;
+	} samplerf_t;
+
 	//Open File Input for modes which need it
+	iqreader FileIn;
 	if((Mode==MODE_RPITX_IQ)||(Mode==MODE_RPITX_IQ_FLOAT)||(Mode==MODE_RPITX_RF)||(Mode==MODE_RPITX_RFA))
 	{
-		if(FileName && strcmp(FileName,"-")==0)
-		{
-			FileInHandle = stdin;
-			useStdin = true;
-		}
-		else FileInHandle = fopen(FileName	,"rb");
-		if (FileInHandle ==NULL)
+		size_t RecordSize=sizeof(samplerf_t);
+		if(Mode==MODE_RPITX_IQ) RecordSize=iqconvert_pairsize(typeiq_i16);
+		if(Mode==MODE_RPITX_IQ_FLOAT) RecordSize=iqconvert_pairsize(typeiq_float);
+		if((FileName==NULL)||!FileIn.Open(FileName,RecordSize,loop_mode_flag))
 		{
 			fatal("Failed to read Filein %s\n",FileName);
 		}
+		FileIn.SetRunning(&running);
 	}
 
     for (int i = 0; i < 64; i++) {
@@ -240,55 +244,32 @@ int main(int argc, char* argv[])
                 {
                     case MODE_RPITX_IQ://I16
                     {
-                        static short IQBuffer[IQBURST*2];
-                       
-                        int nbread=fread(IQBuffer,sizeof(short),IQBURST*2,FileInHandle);
-                        //if(nbread==0) continue;
+                        const void *IQBuffer;
+                        int nbread=FileIn.Read(&IQBuffer,IQBURST);
                         if(nbread>0)
                         {
-                            for(int i=0;i<nbread/2;i++)
-                            {
-                                if(i%Decimation==0)
-                                {		
-                                    CIQBuffer[CplxSampleNumber++]=std::complex<float>(IQBuffer[i*2]/32768.0,IQBuffer[i*2+1]/32768.0); 
-                                }
-                            }
+                            CplxSampleNumber=iqconvert(typeiq_i16,IQBuffer,nbread,CIQBuffer,Decimation);
                         }
                         else 
                         {
                             printf("End of file\n");
-                            if(loop_mode_flag&&!useStdin)
-                            fseek ( FileInHandle , 0 , SEEK_SET );
-                            else
-                                running=false;
+                            running=false;
                         }
                         
                     }
                     break;
                     case MODE_RPITX_IQ_FLOAT:
                     {
-                        static float IQBuffer[IQBURST*2];
-                        int nbread=fread(IQBuffer,sizeof(float),IQBURST*2,FileInHandle);
-                        //if(nbread==0) continue;
+                        const void *IQBuffer;
+                        int nbread=FileIn.Read(&IQBuffer,IQBURST);
                         if(nbread>0)
                         {
-                            for(int i=0;i<nbread/2;i++)
-                            {
-                                if(i%Decimation==0)
-                                {	
-                                    CIQBuffer[CplxSampleNumber++]=std::complex<float>(IQBuffer[i*2],IQBuffer[i*2+1]);
-                                            
-                                }		 
-                                //printf("%f %f\n",(IQBuffer[i*2]-127.5)/128.0,(IQBuffer[i*2+1]-127.5)/128.0);
-                            }
+                            CplxSampleNumber=iqconvert(typeiq_float,IQBuffer,nbread,CIQBuffer,Decimation);
                         }
                         else 
                         {
                             printf("End of file\n");
-                            if(loop_mode_flag&&useStdin)
-                            fseek ( FileInHandle , 0 , SEEK_SET );
-                            else
-                                running=false;
+                            running=false;
                         }
                     }
                     break;	
@@ -303,14 +284,10 @@ int main(int argc, char* argv[])
             case MODE_RPITX_RF://Frequence
             {
                 
-                        typedef struct {
-		                 double Frequency;
-		                uint32_t WaitForThisSample;
-	                    } samplerf_t;
-
                         int SampleNumber=0;    
-                        static samplerf_t RfBuffer[IQBURST];
-                        int nbread=fread(RfBuffer,sizeof(samplerf_t),IQBURST,FileInHandle);
+                        const void *RfData;
+                        int nbread=FileIn.Read(&RfData,IQBURST);
+                        const samplerf_t *RfBuffer=(const samplerf_t *)RfData;
                         //if(nbread==0) continue;
                         if(nbread>0)
                         {
@@ -323,10 +300,7 @@ int main(int argc, char* argv[])
                         else 
                         {
                             printf("End of file\n");
-                            if(loop_mode_flag&&useStdin)
-                            fseek ( FileInHandle , 0 , SEEK_SET );
-                            else
-                                running=false;
+                            running=false;
                         }
                 switch(Mode)
                 {
@@ -5,46 +5,44 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <sys/shm.h>		//Used for shared memory
+#include <sys/resource.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#include "iqdsp/iqconvert.h"
+#include "iqdsp/iqresampler.h"
+#include "iqdsp/iqreader.h"
+#include "iqdsp/spscring.h"
+#include "iqdsp/iqcontrol.h"
+#include "iqdsp/hopdmasync.h"
 // =============================================================================================
-// ----- SHARED MEMORY STRUCTURE -----
-// All commands sent by a partner program towards sendiq
+// ----- SHARED MEMORY CONTROL -----
+// Commands sent by a partner program towards sendiq, see iqdsp/iqcontrol.h for the block layout
 // Operation tips
-//      1-Partner program creates a shared memory block with a given arbitrary token id
-//        (any integer non-zero integer number).
-//      2-sendiq is started with the -m {token} argument, without it no shared memory commands
-//        are honored.
-//      3-Partner program willing to alter the operation of sendiq place the
-//        appropriate command plus optional associated data and/or common_data
-//        if needed (see table below).
-//      4-Partner program set updated=true.
-//      5-sendiq checks periodically for condition updated==true.
-//      6-if detected updated==true at step -5- the command is evaluated and executed.
-//      7-sendiq set updated=false.
-//      8-Partner program must refrain to send any command while the condition updated==true is on
+//      1-sendiq is started with the -m {token} argument (any non-zero integer), without it no
+//        shared memory commands are honored. sendiq creates/attaches the block and sets its magic.
+//      2-Partner program attaches the same token, checks magic and version.
+//      3-Partner program queues commands with iqcontrol_push(), up to IQCONTROL_SLOTS pending.
+//        The timestamp is the output sample index to apply at (0 = as soon as possible),
+//        iqcontrol_samples() gives the current one.
+//      4-sendiq checks the queue once per burst and applies due commands at the exact sample.
 //
 //      Table
 //      ---------------------------------------------------------------------------
-//      Command       Meaning                  data                    common_data
-//       1111         Switch to I/Q mode       N/A                     N/A
-//       2222         Switch to Freq & A mode  N/A                     N/A
-//       3333         Set drive level          Drive level {0..7}      N/A
-//       4444         Change Frequency         Frequency in Hz         N/A
+//      Command       Meaning                  data
+//       1111         Switch to I/Q mode       N/A
+//       2222         Switch to Freq & A mode  N/A
+//       3333         Set drive level          Drive level {0..7}
+//       4444         Change Frequency         Frequency in Hz
+//       5555         Switch to channel        Channel index in the -c list
 //      ---------------------------------------------------------------------------
 //
-// Note: with current level if shared memory is enabled the data incoming thru standart input
-// or file is expected to be in float format. Other data formats aren't supported together with
-// commands, for them sendiq will work but no commands will be honored.
-//
-// *--- Memory structure
-
-struct shared_memory_struct {
-        bool  updated;
-        int   command;
-        float data;
-	char  common_data[1024];
-};
+// Retunes never disable the clock : channels sharing the PLL integer part of the current one
+// switch exactly at the burst boundary, others once the queued samples have been played.
+// Commands are honored with every input type.
+// =============================================================================================
 
-bool  running=true;
+volatile bool running=true;
 bool  fdds=false;            //operate as a DDS
 float drivedds=0.1;          //drive level
 
@@ -53,7 +51,7 @@ float drivedds=0.1;          //drive level
 // *----- Shared memory Variables
 
       void    *pshared = (void *)0;	      //pointer to IPC structure
-      struct shared_memory_struct *sharedmem; //Actual shared memory area
+      iqcontrol_block *sharedmem=NULL;        //Actual shared memory area
       int    sharedmem_id;                    //token is an unique ID for shared memory
       int    sharedmem_token=0;               //key ID, =0 means no shared memory
 // *----- End of shared memory  definitions
@@ -65,15 +63,19 @@ fprintf(stderr,\
 "\nsendiq -%s\n\
 Usage:\nsendiq [-i File Input][-s Samplerate][-l] [-f Frequency] [-h Harmonic number] \n\
 -i            path to File Input \n\
--s            SampleRate 10000-250000 \n\
+-s            SampleRate 10000-250000, higher rates are resampled to 200000 \n\
+-q float      resampler stopband attenuation in dB (default 60, lower is faster)\n\
+-b float      pre-buffer depth in ms before (re)starting the DMA feed (default 100)\n\
 -f float      central frequency Hz(50 kHz to 1500 MHz),\n\
 -m int        shared memory token,\n\
+-c list       comma separated channel frequencies in Hz for the 5555 command,\n\
 -d            dds mode,\n\
 -p            power level (0.00 to 7.00),\n\
 -l            loop mode for file input\n\
 -h            Use harmonic number n\n\
 -t            IQ type (i16 default) {i16,u8,float,double}\n\
 -?            help (this help).\n\
+SIGUSR1 prints the input ring underruns and waits for room (full-ring flow control)\n\
 \n",\
 PROGRAM_VERSION);
 
@@ -87,7 +89,97 @@ terminate(int num)
    
 }
 
+volatile sig_atomic_t dumpstats=0;
+
+static void
+requeststats(int num)
+{
+	dumpstats=1;
+}
+
 #define MAX_SAMPLERATE 200000
+#define IQBURST 4000
+
+// *----- Input reader thread : reads, converts and resamples into the ring drained by the DMA feeder (main thread)
+struct reader_context {
+	iqreader *Reader;
+	int InputType;
+	iqresampler *Resampler;
+	spscring<std::complex<float> > *Ring;
+	std::atomic<bool> Done;
+	std::atomic<unsigned long> Waits;	// Bursts that found the ring full and waited for the feeder, flow control, not a loss
+	std::atomic<unsigned long> Pushed;
+};
+
+static void *reader_thread(void *arg)
+{
+	reader_context *ctx=(reader_context *)arg;
+	std::complex<float> CIQBuffer[IQBURST];
+	std::vector<std::complex<float> > CIQResampled(ctx->Resampler?ctx->Resampler->MaxOutput(IQBURST):0);
+	while(running)
+	{
+		const void *IQRaw;
+		int nbread=ctx->Reader->Read(&IQRaw,IQBURST);
+		if(nbread<=0) break;
+		std::complex<float> *CIQSamples=CIQBuffer;
+		size_t CplxSampleNumber=iqconvert(ctx->InputType,IQRaw,nbread,CIQBuffer);
+		if(ctx->Resampler)
+		{
+			CplxSampleNumber=ctx->Resampler->Process(CIQBuffer,CplxSampleNumber,CIQResampled.data());
+			CIQSamples=CIQResampled.data();
+		}
+		size_t Pushed=ctx->Ring->Push(CIQSamples,CplxSampleNumber);
+		if(Pushed<CplxSampleNumber) ctx->Waits.fetch_add(1,std::memory_order_relaxed);
+		while((Pushed<CplxSampleNumber)&&running)
+		{
+			usleep(1000);
+			Pushed+=ctx->Ring->Push(CIQSamples+Pushed,CplxSampleNumber-Pushed);
+		}
+		ctx->Pushed.fetch_add(Pushed,std::memory_order_relaxed);
+	}
+	ctx->Done.store(true,std::memory_order_release);
+	return NULL;
+}
+
+static void print_stats(reader_context *ctx,size_t PreBuffer,unsigned long Underruns,unsigned long Popped)
+{
+	fprintf(stderr,"Ring %zu/%zu samples (prebuffer %zu) : %lu underruns, %lu waits for room, %lu samples in, %lu samples out\n",
+		ctx->Ring->Available(),ctx->Ring->GetCapacity(),PreBuffer,Underruns,
+		ctx->Waits.load(std::memory_order_relaxed),ctx->Pushed.load(std::memory_order_relaxed),Popped);
+}
+
+// *----- Apply one shared memory command, called by the DMA feeder between two bursts
+static void apply_command(hopdmasync &iqtest,const iqcontrol_command &Command,float SampleRate)
+{
+	switch(Command.command)
+	{
+		case IQCONTROL_MODE_IQ:
+			iqtest.ModeIQ=MODE_IQ;
+			printf("MODE_IQ selected\n");
+			break;
+		case IQCONTROL_MODE_FREQ_A:
+			iqtest.ModeIQ=MODE_FREQ_A;
+			printf("MODE_FREQ_A selected\n");
+			break;
+		case IQCONTROL_DRIVE:
+			drivedds=Command.data;
+			if (drivedds<0.0) {drivedds=0.0;}
+			if (drivedds>7.0) {drivedds=7.0;}
+			printf("Drive level set (%f)\n",drivedds);
+			break;
+		case IQCONTROL_FREQUENCY:
+			printf("Frequency set %f\n",Command.data);
+			iqtest.RetuneFrequency((uint64_t)Command.data);
+			break;
+		case IQCONTROL_CHANNEL:
+			if (iqtest.Retune((int)Command.data)) printf("Channel %d selected\n",(int)Command.data);
+			else fprintf(stderr,"No channel %d\n",(int)Command.data);
+			break;
+		default:
+			fprintf(stderr,"Unknown command %u\n",Command.command);
+			break;
+	}
+}
 
 int main(int argc, char* argv[])
 {
@@ -98,13 +190,15 @@ int main(int argc, char* argv[])
 	bool loop_mode_flag=false;
 	char* FileName=NULL;
 	int Harmonic=1;
-	enum {typeiq_i16,typeiq_u8,typeiq_float,typeiq_double};
 	int InputType=typeiq_i16;
-	int Decimation=1;
+	float InputSampleRate=48000;
+	float ResamplerAttenuation=60;
+	float PreBufferMs=100;
+	char *ChannelList=NULL;
         
 	while(1)
 	{
-		a = getopt(argc, argv, "i:f:s:m:p:h:ldt:");
+		a = getopt(argc, argv, "i:f:s:m:p:h:ldt:q:b:c:");
 	
 		if(a == -1) 
 		{
@@ -131,32 +225,26 @@ int main(int argc, char* argv[])
 			break;
                 case 'm': // Shared memory token
                         sharedmem_token = atoi(optarg);
-     	                InputType=typeiq_float;      //if using shared memory force float pipe
 			break;
 		case 's': // SampleRate (Only needed in IQ mode)
-			SampleRate = atoi(optarg);
+			InputSampleRate = atoi(optarg);
+			SampleRate = InputSampleRate;
 			if(SampleRate>MAX_SAMPLERATE) 
 			{
-				for(int i=2;i<12;i++) //Max 10 times samplerate
-				{
-					if(SampleRate/i<MAX_SAMPLERATE) 
-					{
-						SampleRate=SampleRate/i;
-						Decimation=i;
-						break;
-					}
-				}
-				if(Decimation==1)
-				{
-					 fprintf(stderr,"SampleRate too high : >%d sample/s",10*MAX_SAMPLERATE);
-					 exit(1);
-				} 
-				else
-				{
-					fprintf(stderr,"Warning samplerate too high, decimation by %d will be performed",Decimation);	 
-				}
+				SampleRate=MAX_SAMPLERATE;
+				fprintf(stderr,"Warning samplerate too high, resampling to %d will be performed\n",MAX_SAMPLERATE);
 			};
 			break;
+		case 'q': // Resampler stopband attenuation
+			ResamplerAttenuation = atof(optarg);
+			break;
+		case 'b': // Pre-buffer depth
+			PreBufferMs = atof(optarg);
+			if (PreBufferMs<0) PreBufferMs=0;
+			break;
+		case 'c': // Channel list
+			ChannelList = optarg;
+			break;
 		case 'h': // help
 			Harmonic=atoi(optarg);
 			break;
@@ -164,10 +252,7 @@ int main(int argc, char* argv[])
 			loop_mode_flag = true;
 			break;
 		case 't': // input type
-			if(strcmp(optarg,"i16")==0) InputType=typeiq_i16;
-			if(strcmp(optarg,"u8")==0) InputType=typeiq_u8;
-			if(strcmp(optarg,"float")==0) InputType=typeiq_float;
-			if(strcmp(optarg,"double")==0) InputType=typeiq_double;
+			if(iqconvert_type(optarg)>=0) InputType=iqconvert_type(optarg);
 			break;
 		case -1:
         	break;
@@ -200,23 +285,38 @@ int main(int argc, char* argv[])
         sa.sa_handler = terminate;
         sigaction(i, &sa, NULL);
     }
+	{
+		struct sigaction sa;
+		std::memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = requeststats;
+		sa.sa_flags = SA_RESTART; // Do not break the reader thread blocking read
+		sigaction(SIGUSR1, &sa, NULL);
+	}
 
-	FILE *iqfile=NULL;
-	if(strcmp(FileName,"-")==0)
-		iqfile=fopen("/dev/stdin","rb");
-	else	
-		iqfile=fopen(FileName	,"rb");
-	if (iqfile==NULL) 
+	iqreader Reader;
+	if(!Reader.Open(FileName,iqconvert_pairsize(InputType),loop_mode_flag)) 
 	{	
 		printf("input file issue\n");
 		exit(0);
 	}
+	Reader.SetRunning(&running);
 
-	#define IQBURST 4000
 	int SR=48000;
 	int FifoSize=IQBURST*4;
-	iqdmasync iqtest(SetFrequency,SampleRate,14,FifoSize,MODE_IQ);
+	hopdmasync iqtest(SetFrequency,SampleRate,14,FifoSize,MODE_IQ);
 	iqtest.SetPLLMasterLoop(3,4,0);
+	for(char *Channel=ChannelList?strtok(ChannelList,","):NULL;Channel!=NULL;Channel=strtok(NULL,","))
+	{
+		int Index=iqtest.AddChannel((uint64_t)atof(Channel));
+		fprintf(stderr,"Channel %d : %.0f Hz%s\n",Index,atof(Channel),iqtest.IsFastRetune(Index)?"":" (PLL reprogram)");
+	}
+
+	iqresampler *Resampler=NULL;
+	if(InputSampleRate!=SampleRate)
+	{
+		Resampler=new iqresampler(InputSampleRate,SampleRate,ResamplerAttenuation);
+		fprintf(stderr,"Resampling %.0f to %.0f : %d phases, %d taps\n",InputSampleRate,SampleRate,Resampler->GetPhases(),Resampler->GetTaps());
+	}
 
         if (fdds==true) {           //if instructed to operate as DDS start with carrier, otherwise I/Q mode it is
            iqtest.ModeIQ=MODE_FREQ_A;
@@ -228,7 +328,7 @@ int main(int argc, char* argv[])
 // *------ Shared memory definitions if enabled
 //=========================================================================================================
    if (sharedmem_token != 0) {
-       sharedmem_id = shmget((key_t)sharedmem_token, sizeof(struct shared_memory_struct), 0666 | IPC_CREAT);		//<<<<< SET THE SHARED MEMORY KEY    (Shared memory key , Size in bytes, Permission flags)
+       sharedmem_id = shmget((key_t)sharedmem_token, sizeof(iqcontrol_block), 0666 | IPC_CREAT);		//<<<<< SET THE SHARED MEMORY KEY    (Shared memory key , Size in bytes, Permission flags)
        if (sharedmem_id == -1) {
            printf("Shared memory shmget() failed\n");
            exit(8);
@@ -242,166 +342,98 @@ int main(int argc, char* argv[])
        }
 
 // *----- Assign the shared_memory segment
-       sharedmem = (struct shared_memory_struct *)pshared;
-
-       sharedmem->updated=false;
-       sharedmem->command=0x00;
-       sharedmem->data=0;
+       sharedmem = (iqcontrol_block *)pshared;
+       iqcontrol_init(sharedmem,(uint32_t)SampleRate);
    }
 //=========================================================================================================
 
+	size_t PreBuffer=(size_t)(SampleRate*PreBufferMs/1000.0);
+	spscring<std::complex<float> > Ring(2*PreBuffer+4*IQBURST);
+	reader_context ReaderContext;
+	ReaderContext.Reader=&Reader;
+	ReaderContext.InputType=InputType;
+	ReaderContext.Resampler=Resampler;
+	ReaderContext.Ring=&Ring;
+	ReaderContext.Done=false;
+	ReaderContext.Waits=0;
+	ReaderContext.Pushed=0;
+	pthread_t ReaderThread;
+	if(pthread_create(&ReaderThread,NULL,reader_thread,&ReaderContext)!=0)
+	{
+		fprintf(stderr,"Cannot start input thread\n");
+		exit(1);
+	}
+
 	std::complex<float> CIQBuffer[IQBURST];	
+	unsigned long Underruns=0,Popped=0;
+	uint64_t SamplesOut=0;	// Output sample index, the timeline of command timestamps
+	bool Buffering=true;
 	while(running)
 	{
-		
-			int CplxSampleNumber=0;
-			switch(InputType)
+		if(dumpstats)
+		{
+			dumpstats=0;
+			print_stats(&ReaderContext,PreBuffer,Underruns,Popped);
+		}
+		bool InputDone=ReaderContext.Done.load(std::memory_order_acquire);
+		if(Buffering)
+		{
+			if((Ring.Available()<PreBuffer)&&!InputDone)
 			{
-				case typeiq_i16:
-				{
-					static short IQBuffer[IQBURST*2];
-					int nbread=fread(IQBuffer,sizeof(short),IQBURST*2,iqfile);
-					if(nbread>0)
-					{
-						for(int i=0;i<nbread/2;i++)
-						{
-							if(i%Decimation==0)
-							{		
-								CIQBuffer[CplxSampleNumber++]=std::complex<float>(IQBuffer[i*2]/32768.0,IQBuffer[i*2+1]/32768.0); 
-							}
-						}
-					}
-					else 
-					{
-						printf("End of file\n");
-						if(loop_mode_flag)
-						fseek ( iqfile , 0 , SEEK_SET );
-						else
-							running=false;
-					}
-					
-				}
-				break;
-				case typeiq_u8:
-				{
-					static unsigned char IQBuffer[IQBURST*2];
-					int nbread=fread(IQBuffer,sizeof(unsigned char),IQBURST*2,iqfile);
-					
-					if(nbread>0)
-					{
-						for(int i=0;i<nbread/2;i++)
-						{
-							if(i%Decimation==0)
-							{	
-								CIQBuffer[CplxSampleNumber++]=std::complex<float>((IQBuffer[i*2]-127.5)/128.0,(IQBuffer[i*2+1]-127.5)/128.0);
-										
-							}		 
-						}
-					}
-					else 
-					{
-						printf("End of file\n");
-						if(loop_mode_flag)
-						fseek ( iqfile , 0 , SEEK_SET );
-						else
-							running=false;
-					}
+				usleep(1000);
+				continue;
+			}
+			Buffering=false;
+		}
+		// Apply due commands, cut the burst at the next pending one so it lands on its exact sample
+		size_t BurstSize=IQBURST;
+		if (sharedmem != NULL) {
+			iqcontrol_command Command;
+			while (iqcontrol_peek(sharedmem,&Command)) {
+				if (Command.timestamp>SamplesOut) {
+					if (Command.timestamp-SamplesOut<BurstSize) BurstSize=Command.timestamp-SamplesOut;
+					break;
 				}
+				apply_command(iqtest,Command,SampleRate);
+				iqcontrol_pop(sharedmem);
+			}
+		}
+		int CplxSampleNumber=Ring.Pop(CIQBuffer,BurstSize);
+		if(CplxSampleNumber==0)
+		{
+			if(InputDone)
+			{
+				printf("End of file\n");
 				break;
-				case typeiq_float:
-				{
-					static float IQBuffer[IQBURST*2];
-					int nbread=fread(IQBuffer,sizeof(float),IQBURST*2,iqfile);
-					if(nbread>0)
-					{
-						for(int i=0;i<nbread/2;i++)
-						{
-
-// *-----------------------------------------------------[Patch to introduce IPC handling]-------------------------------------------------------
-// * this modification operates only when using the float stream for a  minimum intervention into the original sendiq
-// * for consistency and transparence it should be propagated to all pipe modes eventually
-// *---------------------------------------------------------------------------------------------------------------------------------------------
-           						if (sharedmem_token != 0) {
-							   if (sharedmem->updated==true) {
-							      if (sharedmem->command == 1111) {
-								  iqtest.ModeIQ=MODE_IQ;
-								  printf("MODE_IQ selected\n");
- 							      }
-							      if (sharedmem->command == 2222) {
-							  	  iqtest.ModeIQ=MODE_FREQ_A;
-						                  printf("MODE_FREQ_A selected\n");
-							      }
-
-							      if (sharedmem->command == 3333) {
-								  drivedds=sharedmem->data;
-								  printf("Drive level set (%f)\n",drivedds);
-							      }
-							      if (sharedmem->command == 4444) {
-								  SetFrequency=sharedmem->data;
-								  printf("Frequency set %f\n",SetFrequency);
-					                          iqtest.clkgpio::disableclk(4);
-					                          iqtest.clkgpio::SetAdvancedPllMode(true);
-					                          iqtest.clkgpio::SetCenterFrequency(SetFrequency,SampleRate);
-					                          iqtest.clkgpio::SetFrequency(0);
-					                          iqtest.clkgpio::enableclk(4);
-							      }
-							      sharedmem->updated=false;
-    							   }
-                                                        }
-							if (iqtest.ModeIQ==MODE_FREQ_A) {  //if into Frequency-Amplitude mode then only drive a constant carrier
-                             				    IQBuffer[i*2]=10.0;            //should be 10 Hz 
-                                                            IQBuffer[i*2+1]=drivedds;      //at the defined drive level
-                          				}
-// *---------------------------------------------------------------------------------------------------------------------------------------------
-							if(i%Decimation==0)
-							{
-								CIQBuffer[CplxSampleNumber++]=std::complex<float>(IQBuffer[i*2],IQBuffer[i*2+1]);
-							}
-						}
-					}
-					else 
-					{
-						printf("End of file\n");
-						if(loop_mode_flag)
-						fseek ( iqfile , 0 , SEEK_SET );
-						else
-							running=false;
-					}
-				}
-				break;	
-				case typeiq_double:
-				{
-					static double IQBuffer[IQBURST*2];
-					int nbread=fread(IQBuffer,sizeof(double),IQBURST*2,iqfile);
-					//if(nbread==0) continue;
-					if(nbread>0)
-					{
-						for(int i=0;i<nbread/2;i++)
-						{
-							if(i%Decimation==0)
-							{	
-								CIQBuffer[CplxSampleNumber++]=std::complex<float>(IQBuffer[i*2],IQBuffer[i*2+1]);
-										
-							}		 
-						}
-					}
-					else 
-					{
-						printf("End of file\n");
-						if(loop_mode_flag)
-						fseek ( iqfile , 0 , SEEK_SET );
-						else
-							running=false;
-					}
-				}
-				break;	
-			
+			}
+			Underruns++;
+			Buffering=true;
+			continue;
+		}
+		Popped+=CplxSampleNumber;
+		if (iqtest.ModeIQ==MODE_FREQ_A) {  //if into Frequency-Amplitude mode then only drive a constant carrier
+			for(int i=0;i<CplxSampleNumber;i++)
+				CIQBuffer[i]=std::complex<float>(10.0,drivedds); //should be 10 Hz at the defined drive level
 		}
 		iqtest.SetIQSamples(CIQBuffer,CplxSampleNumber,Harmonic);
+		SamplesOut+=CplxSampleNumber;
+		if (sharedmem != NULL) iqcontrol_publish(sharedmem,SamplesOut);
 	}
+	running=false;
+	pthread_cancel(ReaderThread); // May be blocked on an idle pipe
+	pthread_join(ReaderThread,NULL);
+	print_stats(&ReaderContext,PreBuffer,Underruns,Popped);
 
 
+	if(iqtest.GetFastRetunes()+iqtest.GetSlowRetunes())
+		fprintf(stderr,"Retunes : %lu fast, %lu slow, ~%lu samples lost\n",iqtest.GetFastRetunes(),iqtest.GetSlowRetunes(),iqtest.GetLostSamples());
 	iqtest.stop();
+	delete Resampler;
+
+	struct rusage ru;
+	getrusage(RUSAGE_SELF,&ru);
+	fprintf(stderr,"Input %s : %lu syscalls, %lu loops, cpu user %.2fs sys %.2fs\n",Reader.IsMapped()?"mmap":"read",
+		Reader.GetSyscalls(),Reader.GetLoops(),ru.ru_utime.tv_sec+ru.ru_utime.tv_usec*1e-6,ru.ru_stime.tv_sec+ru.ru_stime.tv_usec*1e-6);
 
 // *--- Detach and delete shared memory
         if (sharedmem_token != 0) {
@@ -13,6 +13,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <pthread.h>
+#include <vector>
 
 
 #include <librpitx/librpitx.h>
@@ -23,35 +25,66 @@ int FileFreqTiming;
 ngfmdmasync *fmmod;
 static double GlobalTuningFrequency=00000.0;
 int FifoSize=10000; //10ms
-bool running=true;
+volatile bool running=true;
+
+// The whole transmission is rendered first into a timeline of tones, then a feeder thread expands
+// it into blocks for SetFrequencySamples, which sleeps until the DMA buffer has room. The modulator
+// carries its phase from one frequency sample to the next, so the tones are phase continuous.
+#define SAMPLE_RATE 100000
+#define TIMING_PER_SAMPLE (10000000/SAMPLE_RATE) // Timing in 0.1us
+#define FEED_BLOCK 2500 //25ms
+
+struct tone
+{
+	float Frequency;
+	uint32_t Samples;
+};
+
+std::vector<tone> Timeline;
+uint64_t TimelineEnd=0;		// 0.1us, exact end of the last tone
+uint64_t TimelineSamples=0;	// Samples in the timeline, TimelineEnd to the nearest sample
 
 void playtone(double Frequency,uint32_t Timing)//Timing in 0.1us
 {
-		uint32_t SumTiming=0;
-		SumTiming+=Timing%100;
- 		if(SumTiming>=100) 
-		{
-			Timing+=100;
-			SumTiming=SumTiming-100;
-		}
-		int NbSamples=(Timing/100);
+	// Each tone ends on the sample nearest its exact due time, so the fractions of a sample
+	// (45.76 for a Martin 1 pixel) do not add up along a line and slant the picture
+	TimelineEnd+=Timing;
+	uint64_t End=(TimelineEnd+TIMING_PER_SAMPLE/2)/TIMING_PER_SAMPLE;
+	if(End==TimelineSamples) return;
+	uint32_t NbSamples=(uint32_t)(End-TimelineSamples);
+	TimelineSamples=End;
+	if(!Timeline.empty()&&(Timeline.back().Frequency==(float)Frequency))
+	{
+		Timeline.back().Samples+=NbSamples;
+		return;
+	}
+	tone Tone={(float)Frequency,NbSamples};
+	Timeline.push_back(Tone);
+}
 
-		while(NbSamples>0)
+static void *feeder_thread(void *arg)
+{
+	static float Block[FEED_BLOCK];
+	size_t Fill=0;
+	for(size_t i=0;(i<Timeline.size())&&running;i++)
+	{
+		uint32_t Left=Timeline[i].Samples;
+		while((Left>0)&&running)
 		{
-			usleep(10);
-			int Available=fmmod->GetBufferAvailable();
-			if(Available>FifoSize/2)
-			{	
-				int Index=fmmod->GetUserMemIndex();
-				if(Available>NbSamples) Available=NbSamples;
-				for(int j=0;j<Available;j++)
-				{
-					fmmod->SetFrequencySample(Index+j,Frequency);
-					NbSamples--;
-			
-				}
+			uint32_t Count=FEED_BLOCK-Fill;
+			if(Count>Left) Count=Left;
+			for(uint32_t j=0;j<Count;j++) Block[Fill+j]=Timeline[i].Frequency;
+			Fill+=Count;
+			Left-=Count;
+			if(Fill==FEED_BLOCK)
+			{
+				fmmod->SetFrequencySamples(Block,Fill);
+				Fill=0;
 			}
-		}	
+		}
+	}
+	if((Fill>0)&&running) fmmod->SetFrequencySamples(Block,Fill);
+	return NULL;
 }
 
 void addvisheader()
@@ -192,9 +225,17 @@ int main(int argc, char **argv)
         sigaction(i, &sa, NULL);
     }
 
-	fmmod=new ngfmdmasync(frequency,100000,14,FifoSize);	
+	fmmod=new ngfmdmasync(frequency,SAMPLE_RATE,14,FifoSize);	
 	ProcessMartin1();
-    close(FilePicture);
+	close(FilePicture);
+	printf("Transmitting %.1f s (%zu tones)\n",(double)TimelineSamples/SAMPLE_RATE,Timeline.size());
+	pthread_t FeederThread;
+	if(pthread_create(&FeederThread,NULL,feeder_thread,NULL)!=0)
+	{
+		fprintf(stderr,"Cannot start feeder thread\n");
+		exit(1);
+	}
+	pthread_join(FeederThread,NULL);
 	delete fmmod;
 	return 0;
 }
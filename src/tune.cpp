@@ -4,8 +4,15 @@
 #include <cstring>
 #include <signal.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <atomic>
 
-bool running=true;
+std::atomic<bool> running(true);	// Lock-free : set by the signal handler, read by the hop thread
 
 #define PROGRAM_VERSION "0.2"
 
@@ -15,8 +22,10 @@ void print_usage(void)
 
 fprintf(stderr,\
 "\ntune -%s\n\
-Usage:\ntune  [-f Frequency] [-h] \n\
+Usage:\ntune  [-f Frequency] [-t HopTable [-n Passes]] [-h] \n\
 -f float      frequency carrier Hz(50 kHz to 1500 MHz),\n\
+-t file       hop table, one \"frequency(Hz) dwell(us)\" per line, # for comments\n\
+-n int        number of passes through the hop table (default 0 : until killed)\n\
 -e exit immediately without killing the carrier,\n\
 -p set clock ppm instead of ntp adjust\n\
 -h            help (this help).\n\
@@ -33,6 +42,86 @@ terminate(int num)
    
 }
 
+// *----- Hop table scheduler
+struct hop {
+	double Frequency;
+	long Dwell;	// us
+};
+
+struct hop_context {
+	clkgpio *clk;
+	double Center;
+	std::vector<hop> *Table;
+	int Passes;
+	std::vector<unsigned long> Jitter;	// Histogram of the late switch relative to the deadline, 1 us bins, last one open
+	double JitterMin,JitterMax,JitterSum;
+	unsigned long Hops;
+};
+
+static bool load_hops(const char *FileName,std::vector<hop> &Table)
+{
+	FILE *f=fopen(FileName,"r");
+	if(f==NULL) return false;
+	char Line[256];
+	while(fgets(Line,sizeof(Line),f))
+	{
+		hop Hop;
+		char *Comment=strchr(Line,'#');
+		if(Comment) *Comment=0;
+		if(sscanf(Line,"%lf %ld",&Hop.Frequency,&Hop.Dwell)!=2) continue;
+		if(Hop.Dwell<=0) continue;
+		Table.push_back(Hop);
+	}
+	fclose(f);
+	return !Table.empty();
+}
+
+static void *hop_thread(void *arg)
+{
+	hop_context *ctx=(hop_context *)arg;
+	struct timespec Deadline,Now;
+	clock_gettime(CLOCK_MONOTONIC,&Deadline);
+	Deadline.tv_sec+=1; // Leave time to settle before the first hop
+	for(int Pass=0;running&&((ctx->Passes==0)||(Pass<ctx->Passes));Pass++)
+	{
+		for(size_t i=0;running&&(i<ctx->Table->size());i++)
+		{
+			const hop &Hop=(*ctx->Table)[i];
+			while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&Deadline,NULL)!=0)
+			{
+				if(!running) return NULL;
+			}
+			ctx->clk->SetFrequency(Hop.Frequency-ctx->Center);
+			clock_gettime(CLOCK_MONOTONIC,&Now);
+			float Late=(Now.tv_sec-Deadline.tv_sec)*1e6+(Now.tv_nsec-Deadline.tv_nsec)*1e-3;
+			if(ctx->Hops==0) ctx->JitterMin=ctx->JitterMax=Late;
+			if(Late<ctx->JitterMin) ctx->JitterMin=Late;
+			if(Late>ctx->JitterMax) ctx->JitterMax=Late;
+			ctx->JitterSum+=Late;
+			size_t Bin=(Late>0)?(size_t)Late:0;
+			ctx->Jitter[std::min(Bin,ctx->Jitter.size()-1)]++;
+			ctx->Hops++;
+			Deadline.tv_nsec+=(Hop.Dwell%1000000)*1000;
+			Deadline.tv_sec+=Hop.Dwell/1000000+Deadline.tv_nsec/1000000000;
+			Deadline.tv_nsec%=1000000000;
+		}
+	}
+	running=false;
+	return NULL;
+}
+
+static void print_jitter(hop_context *ctx)
+{
+	if(ctx->Hops==0) return;
+	// Same hops as min/mean/max, p99 is the upper edge of its bin
+	unsigned long Rank=(ctx->Hops*99+99)/100,Count=0;
+	size_t Bin=0;
+	while((Count+=ctx->Jitter[Bin])<Rank) Bin++;
+	double p99=(Bin==ctx->Jitter.size()-1)?ctx->JitterMax:std::min((double)(Bin+1),ctx->JitterMax);
+	fprintf(stderr,"%lu hops, jitter min/mean/p99/max %.1f/%.1f/%.1f/%.1f us\n",ctx->Hops,
+		ctx->JitterMin,ctx->JitterSum/ctx->Hops,p99,ctx->JitterMax);
+}
+
 int main(int argc, char* argv[])
 {
 	int a;
@@ -42,9 +131,12 @@ int main(int argc, char* argv[])
 	bool NotKill=false;
 	float ppm=1000.0;
 	int ppmset=0;
+	char *HopFile=NULL;
+	int Passes=0;
+	int Bandwidth=10;
 	while(1)
 	{
-		a = getopt(argc, argv, "f:ehp:");
+		a = getopt(argc, argv, "f:ehp:t:n:");
 	
 		if(a == -1) 
 		{
@@ -65,6 +157,12 @@ int main(int argc, char* argv[])
 			ppm=atof(optarg);
 			ppmset=1;
 			break;	
+		case 't': // Hop table
+			HopFile=optarg;
+			break;
+		case 'n': // Hop table passes
+			Passes=atoi(optarg);
+			break;
 		case 'h': // help
 			print_usage();
 			exit(1);
@@ -93,6 +191,26 @@ int main(int argc, char* argv[])
 
 	
 	
+	std::vector<hop> HopTable;
+	if((HopFile!=NULL)&&!load_hops(HopFile,HopTable))
+	{
+		fprintf(stderr,"Cannot read hop table %s\n",HopFile);
+		exit(1);
+	}
+	if(!HopTable.empty())
+	{
+		// Hops are offsets from a center in the middle of the table span
+		double Min=HopTable[0].Frequency,Max=HopTable[0].Frequency;
+		for(size_t i=0;i<HopTable.size();i++)
+		{
+			Min=std::min(Min,HopTable[i].Frequency);
+			Max=std::max(Max,HopTable[i].Frequency);
+		}
+		SetFrequency=(Min+Max)/2;
+		Bandwidth=std::max(10.0,Max-Min);
+		NotKill=false;
+	}
+
 	 for (int i = 0; i < 64; i++) {
         struct sigaction sa;
 
@@ -109,9 +227,37 @@ int main(int argc, char* argv[])
 		clk->SetAdvancedPllMode(true);
 		if(ppmset)	//ppm is set else use ntp
 			clk->Setppm(ppm);
-		clk->SetCenterFrequency(SetFrequency,10);
+		clk->SetCenterFrequency(SetFrequency,Bandwidth);
 		clk->SetFrequency(000);
 		clk->enableclk(4);
+		if(!HopTable.empty())
+		{
+			hop_context ctx;
+			ctx.clk=clk;
+			ctx.Center=SetFrequency;
+			ctx.Table=&HopTable;
+			ctx.Passes=Passes;
+			ctx.Jitter.assign(10001,0);	// Up to 10 ms late
+			ctx.JitterMin=ctx.JitterMax=ctx.JitterSum=0;
+			ctx.Hops=0;
+			if(mlockall(MCL_CURRENT|MCL_FUTURE)!=0) fprintf(stderr,"Warning : mlockall failed\n");
+			pthread_attr_t attr;
+			pthread_attr_init(&attr);
+			struct sched_param param;
+			param.sched_priority=sched_get_priority_max(SCHED_FIFO);
+			pthread_attr_setinheritsched(&attr,PTHREAD_EXPLICIT_SCHED);
+			pthread_attr_setschedpolicy(&attr,SCHED_FIFO);
+			pthread_attr_setschedparam(&attr,&param);
+			pthread_t HopThread;
+			if(pthread_create(&HopThread,&attr,hop_thread,&ctx)!=0)
+			{
+				fprintf(stderr,"Warning : no realtime priority, hop jitter will suffer\n");
+				pthread_create(&HopThread,NULL,hop_thread,&ctx);
+			}
+			pthread_attr_destroy(&attr);
+			pthread_join(HopThread,NULL);
+			print_jitter(&ctx);
+		}
 		
 		//clk->enableclk(6);//CLK2 : experimental
 		//clk->enableclk(20);//CLK1 duplicate on GPIO20 for more power ? (kuba's note: it can extend range, but not far (depending on the antenna), also no more power, because its impossible, you cant get more than your receiving, youd need to receive more then and not appear it out of nowhere)